@@ -0,0 +1,67 @@
+// Syscall-heavy process tree for measuring tracer throughput: forks
+// `workers` processes that each open, read and close a file `iterations`
+// times, then reports how many monitored syscalls per second went through.
+//
+// Usage: fork_bench [workers] [iterations] [file]
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void worker(int iterations, const char *file) {
+  char buf[64];
+  for (int i = 0; i < iterations; i++) {
+    int fd = open(file, O_RDONLY);
+    if (fd == -1) {
+      perror("open");
+      _exit(1);
+    }
+    if (read(fd, buf, sizeof(buf)) < 0) {
+      perror("read");
+      _exit(1);
+    }
+    close(fd);
+  }
+  _exit(0);
+}
+
+int main(int argc, char *argv[]) {
+  int workers = argc > 1 ? atoi(argv[1]) : 8;
+  int iterations = argc > 2 ? atoi(argv[2]) : 20000;
+  const char *file = argc > 3 ? argv[3] : "/etc/hostname";
+
+  double start = now_sec();
+  for (int w = 0; w < workers; w++) {
+    pid_t pid = fork();
+    if (pid == -1) {
+      perror("fork");
+      return 1;
+    }
+    if (pid == 0) {
+      worker(iterations, file);
+    }
+  }
+
+  int failed = 0;
+  int status;
+  while (wait(&status) > 0) {
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      failed++;
+    }
+  }
+  double elapsed = now_sec() - start;
+
+  // open + read + close per iteration
+  double syscalls = 3.0 * workers * iterations;
+  printf("workers=%d iterations=%d elapsed=%.3fs syscalls/s=%.0f failed=%d\n",
+         workers, iterations, elapsed, syscalls / elapsed, failed);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,198 @@
+// Policy matching benchmark: compiles a few thousand generated rules and
+// matches millions of paths against them, checking a sample against a
+// naive first-match glob evaluator.
+//
+// Usage: policy_bench [num_rules] [num_lookups]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "path_policy.h"
+
+#define NUM_PATHS 50000
+#define VERIFY_PATHS 20000
+
+static double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Reference glob matcher with backtracking, same syntax as the policy
+static int glob_match(const char *pat, const char *str) {
+  if (*pat == '\0') {
+    return *str == '\0';
+  }
+  if (pat[0] == '*' && pat[1] == '*') {
+    while (*pat == '*') {
+      pat++;
+    }
+    for (const char *s = str; ; s++) {
+      if (glob_match(pat, s)) {
+        return 1;
+      }
+      if (*s == '\0') {
+        return 0;
+      }
+    }
+  }
+  if (*pat == '*') {
+    for (const char *s = str; ; s++) {
+      if (glob_match(pat + 1, s)) {
+        return 1;
+      }
+      if (*s == '\0' || *s == '/') {
+        return 0;
+      }
+    }
+  }
+  if (*str == '\0') {
+    return 0;
+  }
+  if (*pat == '?') {
+    return *str != '/' && glob_match(pat + 1, str + 1);
+  }
+  return *pat == *str && glob_match(pat + 1, str + 1);
+}
+
+static policy_action_t naive_evaluate(const path_policy_t *policy, const char *path, policy_op_t op) {
+  for (int r = 0; r < policy_rule_count(policy); r++) {
+    const policy_rule_t *rule = policy_rule(policy, r);
+    if ((rule->ops & (1u << op)) && glob_match(rule->pattern, path)) {
+      return rule->action;
+    }
+  }
+  return policy_default_action(policy, op);
+}
+
+static const char *actions[] = { "allow", "deny", "ask" };
+static const char *ops[] = { "*", "read", "write", "open,read", "delete", "write,delete" };
+static const char *exts[] = { "c", "h", "o", "log", "tmp", "txt" };
+
+static char *generate_rules(int num_rules) {
+  size_t cap = (size_t)num_rules * 96 + 64;
+  char *text = malloc(cap);
+  size_t len = 0;
+
+  for (int i = 0; i < num_rules; i++) {
+    const char *action = actions[rand() % 3];
+    const char *op = ops[rand() % 6];
+    int a = rand() % 200, b = rand() % 50;
+    switch (i % 8) {
+      case 0: case 1: case 2:
+        len += snprintf(text + len, cap - len, "%s %s /home/user%d/proj%d/\n", action, op, a, b);
+        break;
+      case 3:
+        len += snprintf(text + len, cap - len, "%s %s /srv/data%d/*.%s\n", action, op, a, exts[b % 6]);
+        break;
+      case 4:
+        len += snprintf(text + len, cap - len, "%s %s /opt/app%d/**/cache/*\n", action, op, a);
+        break;
+      case 5:
+        len += snprintf(text + len, cap - len, "%s %s /home/user%d/*/build/**.%s\n", action, op, a, exts[b % 6]);
+        break;
+      case 6:
+        len += snprintf(text + len, cap - len, "%s %s /var/lib/svc%d/db?/\n", action, op, a);
+        break;
+      default:
+        len += snprintf(text + len, cap - len, "%s %s /usr/share/pkg%d/%d/**\n", action, op, a, b);
+        break;
+    }
+  }
+  snprintf(text + len, cap - len, "default ask\n");
+  return text;
+}
+
+static char *generate_path(void) {
+  char buf[512];
+  int a = rand() % 220, b = rand() % 60;
+  const char *ext = exts[rand() % 6];
+  switch (rand() % 7) {
+    case 0:
+      snprintf(buf, sizeof(buf), "/home/user%d/proj%d/src/module%d/file%d.%s", a, b, rand() % 40, rand() % 1000, ext);
+      break;
+    case 1:
+      snprintf(buf, sizeof(buf), "/srv/data%d/record%d.%s", a, rand() % 100000, ext);
+      break;
+    case 2:
+      snprintf(buf, sizeof(buf), "/opt/app%d/lib/%d/cache/blob%d", a, b, rand() % 1000);
+      break;
+    case 3:
+      snprintf(buf, sizeof(buf), "/home/user%d/proj%d/build/obj/out%d.%s", a, b, rand() % 1000, ext);
+      break;
+    case 4:
+      snprintf(buf, sizeof(buf), "/var/lib/svc%d/db%d/table%d", a, rand() % 12, rand() % 100);
+      break;
+    case 5:
+      snprintf(buf, sizeof(buf), "/usr/share/pkg%d/%d/doc/README", a, b);
+      break;
+    default:
+      snprintf(buf, sizeof(buf), "/tmp/scratch%d/%d.%s", a, b, ext);
+      break;
+  }
+  return strdup(buf);
+}
+
+int main(int argc, char *argv[]) {
+  int num_rules = argc > 1 ? atoi(argv[1]) : 3000;
+  long num_lookups = argc > 2 ? atol(argv[2]) : 5000000;
+  srand(42);
+
+  char *text = generate_rules(num_rules);
+  double t0 = now_sec();
+  path_policy_t *policy = policy_from_string(text, "<generated>");
+  double t1 = now_sec();
+  free(text);
+  if (!policy) {
+    fprintf(stderr, "Failed to compile generated policy\n");
+    return 1;
+  }
+
+  char **paths = malloc(NUM_PATHS * sizeof(char *));
+  for (int i = 0; i < NUM_PATHS; i++) {
+    paths[i] = generate_path();
+  }
+
+  // Cold pass builds the DFA states the workload needs
+  double t2 = now_sec();
+  unsigned long checksum = 0;
+  for (int i = 0; i < NUM_PATHS; i++) {
+    checksum += policy_evaluate(policy, paths[i], (policy_op_t)(i % POLICY_OP_COUNT));
+  }
+  double t3 = now_sec();
+
+  for (long i = 0; i < num_lookups; i++) {
+    checksum += policy_evaluate(policy, paths[i % NUM_PATHS], (policy_op_t)(i % POLICY_OP_COUNT));
+  }
+  double t4 = now_sec();
+
+  int mismatches = 0;
+  double t5 = now_sec();
+  for (int i = 0; i < VERIFY_PATHS; i++) {
+    policy_op_t op = (policy_op_t)(i % POLICY_OP_COUNT);
+    if (naive_evaluate(policy, paths[i], op) != policy_evaluate(policy, paths[i], op)) {
+      if (mismatches++ < 5) {
+        fprintf(stderr, "Mismatch for %s (%s)\n", paths[i], policy_op_name(op));
+      }
+    }
+  }
+  double t6 = now_sec();
+
+  printf("rules:            %d\n", num_rules);
+  printf("compile:          %.3f ms\n", (t1 - t0) * 1e3);
+  printf("cold pass:        %d paths in %.3f ms (%d DFA states)\n", NUM_PATHS, (t3 - t2) * 1e3,
+         policy_dfa_states(policy));
+  printf("warm lookups:     %ld in %.3f s\n", num_lookups, t4 - t3);
+  printf("per lookup:       %.1f ns (%.2f M paths/s)\n", (t4 - t3) * 1e9 / num_lookups,
+         num_lookups / (t4 - t3) / 1e6);
+  printf("naive first-match: %.1f ns per lookup (over %d paths, includes DFA check)\n",
+         (t6 - t5) * 1e9 / VERIFY_PATHS, VERIFY_PATHS);
+  printf("mismatches:       %d (checksum %lu)\n", mismatches, checksum);
+
+  for (int i = 0; i < NUM_PATHS; i++) {
+    free(paths[i]);
+  }
+  free(paths);
+  policy_free(policy);
+  return mismatches ? 1 : 0;
+}
@@ -0,0 +1,222 @@
+// Runs the syscall_bench workloads natively, under the ptrace backend and
+// under --seccomp, and reports what the sandbox adds per syscall, how many
+// tracee stops per second it causes and how much CPU the tracer burns.
+// Every run is also written as a CSV row to --out, and with
+// --max-overhead-ns the exit status is 1 if a sandboxed workload exceeds
+// that overhead per syscall, so a CTest can catch regressions.
+//
+// Usage: sandbox_bench [--sandbox path] [--bench path] [--iterations n]
+//                      [--workers n] [--out file] [--max-overhead-ns n] [workloads...]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static const char *default_workloads[] = {
+  "read-tracked", "write-tracked", "read-untracked", "open-close",
+  "unlink", "dir-walk", "threads", "fork", NULL
+};
+
+typedef struct {
+  const char *name;
+  const char *flag;   // Extra sandbox option, NULL for the native run
+  int sandboxed;
+} bench_mode_t;
+
+static const bench_mode_t modes[] = {
+  { "native", NULL, 0 },
+  { "ptrace", NULL, 1 },
+  { "seccomp", "--seccomp", 1 },
+};
+
+typedef struct {
+  long long ops;
+  long long syscalls;
+  long long elapsed_ns;
+  long long cpu_ns;       // The workload itself
+  long long total_cpu_ns; // Everything the run spawned, tracer included
+  long vcsw;
+} result_t;
+
+static long long rusage_ns(const struct rusage *usage) {
+  return (usage->ru_utime.tv_sec + usage->ru_stime.tv_sec) * 1000000000LL +
+         (usage->ru_utime.tv_usec + usage->ru_stime.tv_usec) * 1000LL;
+}
+
+// Run argv with stdout on a pipe and parse the workload's result line.
+// Returns 0 on success, -1 if the run failed.
+static int run(char *const argv[], result_t *result) {
+  int pipefd[2];
+  if (pipe(pipefd) == -1) {
+    perror("pipe");
+    return -1;
+  }
+  pid_t pid = fork();
+  if (pid == -1) {
+    perror("fork");
+    return -1;
+  }
+  if (pid == 0) {
+    dup2(pipefd[1], STDOUT_FILENO);
+    close(pipefd[0]);
+    close(pipefd[1]);
+    execv(argv[0], argv);
+    perror("execv");
+    _exit(127);
+  }
+  close(pipefd[1]);
+
+  // The sandbox prints its own banner; skip to the workload's line
+  FILE *out = fdopen(pipefd[0], "r");
+  char line[512];
+  int found = 0;
+  while (fgets(line, sizeof(line), out)) {
+    char *start = strstr(line, "workload=");
+    if (start && sscanf(start, "workload=%*s ops=%lld syscalls=%lld elapsed_ns=%lld cpu_ns=%lld vcsw=%ld",
+                        &result->ops, &result->syscalls, &result->elapsed_ns, &result->cpu_ns,
+                        &result->vcsw) == 5) {
+      found = 1;
+    }
+  }
+  fclose(out);
+
+  int status;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) == -1) {
+    perror("wait4");
+    return -1;
+  }
+  result->total_cpu_ns = rusage_ns(&usage);
+  if (!found || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    return -1;
+  }
+  return 0;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [--sandbox path] [--bench path] [--iterations n] [--workers n]\n"
+          "       [--out file] [--max-overhead-ns n] [workloads...]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+  const char *sandbox = "bin/sandbox";
+  const char *bench = "bin/syscall_bench";
+  const char *iterations = "20000";
+  const char *workers = "4";
+  const char *out_name = NULL;
+  double max_overhead_ns = 0;
+
+  int argi = 1;
+  for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; argi += 2) {
+    if (argi + 1 >= argc) {
+      usage(argv[0]);
+      return 2;
+    }
+    const char *value = argv[argi + 1];
+    if (strcmp(argv[argi], "--sandbox") == 0) {
+      sandbox = value;
+    } else if (strcmp(argv[argi], "--bench") == 0) {
+      bench = value;
+    } else if (strcmp(argv[argi], "--iterations") == 0) {
+      iterations = value;
+    } else if (strcmp(argv[argi], "--workers") == 0) {
+      workers = value;
+    } else if (strcmp(argv[argi], "--out") == 0) {
+      out_name = value;
+    } else if (strcmp(argv[argi], "--max-overhead-ns") == 0) {
+      max_overhead_ns = atof(value);
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  const char **workloads = argi < argc ? (const char **)&argv[argi] : default_workloads;
+
+  // Allow everything so no prompt gets in the way
+  char policy[] = "/tmp/sandbox_bench.XXXXXX";
+  int policy_fd = mkstemp(policy);
+  if (policy_fd == -1 || write(policy_fd, "default allow\n", 14) != 14) {
+    perror("policy");
+    return 2;
+  }
+  close(policy_fd);
+
+  FILE *out = NULL;
+  if (out_name) {
+    out = fopen(out_name, "w");
+    if (!out) {
+      perror(out_name);
+      unlink(policy);
+      return 2;
+    }
+    fprintf(out, "workload,mode,syscalls,elapsed_ns,ns_per_syscall,overhead_ns,stops_per_sec,"
+            "tracer_cpu_ns\n");
+  }
+
+  printf("%-15s %-8s %12s %12s %14s %14s\n", "workload", "mode", "ns/syscall", "overhead ns",
+         "stops/s", "tracer cpu ms");
+  int failed = 0;
+  int over = 0;
+  for (const char **w = workloads; *w; w++) {
+    result_t native = {0};
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+      char *args[12];
+      int n = 0;
+      if (modes[m].sandboxed) {
+        args[n++] = (char *)sandbox;
+        args[n++] = "--policy";
+        args[n++] = policy;
+        if (modes[m].flag) {
+          args[n++] = (char *)modes[m].flag;
+        }
+      }
+      args[n++] = (char *)bench;
+      args[n++] = (char *)*w;
+      args[n++] = (char *)iterations;
+      args[n++] = (char *)workers;
+      args[n] = NULL;
+
+      result_t result = {0};
+      if (run(args, &result) == -1 || result.syscalls == 0) {
+        printf("%-15s %-8s failed\n", *w, modes[m].name);
+        failed = 1;
+        continue;
+      }
+      if (!modes[m].sandboxed) {
+        native = result;
+      }
+
+      double per_syscall = (double)result.elapsed_ns / result.syscalls;
+      double overhead = 0, stops = 0;
+      long long tracer_cpu = 0;
+      if (modes[m].sandboxed && native.syscalls) {
+        overhead = per_syscall - (double)native.elapsed_ns / native.syscalls;
+        // Each stop parks the tracee: a voluntary context switch more than
+        // the native run had
+        stops = (result.vcsw - native.vcsw) * 1e9 / result.elapsed_ns;
+        tracer_cpu = result.total_cpu_ns - result.cpu_ns;
+        if (max_overhead_ns > 0 && overhead > max_overhead_ns) {
+          over = 1;
+        }
+      }
+      printf("%-15s %-8s %12.0f %12.0f %14.0f %14.1f\n", *w, modes[m].name, per_syscall, overhead,
+             stops < 0 ? 0 : stops, tracer_cpu / 1e6);
+      if (out) {
+        fprintf(out, "%s,%s,%lld,%lld,%.1f,%.1f,%.0f,%lld\n", *w, modes[m].name, result.syscalls,
+                result.elapsed_ns, per_syscall, overhead, stops < 0 ? 0 : stops, tracer_cpu);
+      }
+      fflush(stdout);
+    }
+  }
+
+  if (out) {
+    fclose(out);
+  }
+  unlink(policy);
+  if (over) {
+    printf("Overhead above %.0f ns per syscall\n", max_overhead_ns);
+  }
+  return failed || over ? 1 : 0;
+}
@@ -0,0 +1,280 @@
+// Syscall microbenchmarks for measuring what the sandbox costs. Each
+// workload runs `iterations` operations in a scratch directory and prints
+// one machine-readable line:
+//
+//   workload=<name> ops=<n> syscalls=<n> elapsed_ns=<n> cpu_ns=<n> vcsw=<n>
+//
+// `syscalls` is how many of the timed syscalls the sandbox inspects or may
+// stop on (an estimate for dir-walk, whose libc calls vary).
+// cpu_ns and vcsw (voluntary context switches) include the workload's
+// threads and child processes. Every ptrace stop is a voluntary switch,
+// so the difference to a native run counts the stops.
+//
+// Usage: syscall_bench <workload> [iterations] [workers]
+//   read-tracked    lseek + read on an opened file
+//   write-tracked   lseek + write on an opened file
+//   read-untracked  write + read through a pipe
+//   open-close      open and close an existing file
+//   unlink          create, close and unlink a file
+//   dir-walk        open and list the directories of a small tree
+//   threads         read-tracked in `workers` threads
+//   fork            read-tracked in `workers` child processes
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TREE_DEPTH 4
+#define TREE_FANOUT 3
+// openat, fstat, two getdents64 and close per directory
+#define SYSCALLS_PER_DIR 5
+
+static char scratch[] = "/tmp/syscall_bench.XXXXXX";
+static char data_file[64];
+static int iterations;
+
+static long long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void fail(const char *what) {
+  perror(what);
+  exit(1);
+}
+
+static void read_tracked(void) {
+  char buf[64];
+  int fd = open(data_file, O_RDONLY);
+  if (fd == -1) {
+    fail("open");
+  }
+  for (int i = 0; i < iterations; i++) {
+    if (lseek(fd, 0, SEEK_SET) == -1 || read(fd, buf, sizeof(buf)) != sizeof(buf)) {
+      fail("read");
+    }
+  }
+  close(fd);
+}
+
+static void write_tracked(void) {
+  char buf[64];
+  memset(buf, 'x', sizeof(buf));
+  int fd = open(data_file, O_WRONLY);
+  if (fd == -1) {
+    fail("open");
+  }
+  for (int i = 0; i < iterations; i++) {
+    if (lseek(fd, 0, SEEK_SET) == -1 || write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+      fail("write");
+    }
+  }
+  close(fd);
+}
+
+static void read_untracked(void) {
+  int pipefd[2];
+  char byte = 0;
+  if (pipe(pipefd) == -1) {
+    fail("pipe");
+  }
+  for (int i = 0; i < iterations; i++) {
+    if (write(pipefd[1], &byte, 1) != 1 || read(pipefd[0], &byte, 1) != 1) {
+      fail("pipe io");
+    }
+  }
+  close(pipefd[0]);
+  close(pipefd[1]);
+}
+
+static void open_close(void) {
+  for (int i = 0; i < iterations; i++) {
+    int fd = open(data_file, O_RDONLY);
+    if (fd == -1) {
+      fail("open");
+    }
+    close(fd);
+  }
+}
+
+static void unlink_storm(void) {
+  char path[96];
+  for (int i = 0; i < iterations; i++) {
+    snprintf(path, sizeof(path), "%s/victim%d", scratch, i);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1) {
+      fail("create");
+    }
+    close(fd);
+    if (unlink(path) == -1) {
+      fail("unlink");
+    }
+  }
+}
+
+static void make_tree(const char *dir, int depth) {
+  if (depth == 0) {
+    return;
+  }
+  char child[512];
+  for (int i = 0; i < TREE_FANOUT; i++) {
+    snprintf(child, sizeof(child), "%s/d%d", dir, i);
+    if (mkdir(child, 0700) == -1) {
+      fail("mkdir");
+    }
+    make_tree(child, depth - 1);
+  }
+}
+
+// Returns the number of directories opened
+static int walk(const char *dir) {
+  DIR *d = opendir(dir);
+  if (!d) {
+    fail("opendir");
+  }
+  int opened = 1;
+  struct dirent *entry;
+  char child[512];
+  while ((entry = readdir(d))) {
+    if (entry->d_type == DT_DIR && entry->d_name[0] != '.') {
+      snprintf(child, sizeof(child), "%s/%s", dir, entry->d_name);
+      opened += walk(child);
+    }
+  }
+  closedir(d);
+  return opened;
+}
+
+static long long dir_walk(void) {
+  char root[96];
+  snprintf(root, sizeof(root), "%s/tree", scratch);
+  if (mkdir(root, 0700) == -1) {
+    fail("mkdir");
+  }
+  make_tree(root, TREE_DEPTH);
+
+  // Walk the whole tree until `iterations` directories have been opened
+  long long opened = 0;
+  while (opened < iterations) {
+    opened += walk(root);
+  }
+  return opened;
+}
+
+static void *read_thread(void *arg) {
+  (void)arg;
+  read_tracked();
+  return NULL;
+}
+
+static void remove_tree(const char *dir) {
+  DIR *d = opendir(dir);
+  if (!d) {
+    return;
+  }
+  struct dirent *entry;
+  char child[512];
+  while ((entry = readdir(d))) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    snprintf(child, sizeof(child), "%s/%s", dir, entry->d_name);
+    if (entry->d_type == DT_DIR) {
+      remove_tree(child);
+    } else {
+      unlink(child);
+    }
+  }
+  closedir(d);
+  rmdir(dir);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <workload> [iterations] [workers]\n", argv[0]);
+    return 1;
+  }
+  const char *workload = argv[1];
+  iterations = argc > 2 ? atoi(argv[2]) : 100000;
+  int workers = argc > 3 ? atoi(argv[3]) : 4;
+
+  if (!mkdtemp(scratch)) {
+    fail("mkdtemp");
+  }
+  snprintf(data_file, sizeof(data_file), "%s/data", scratch);
+  int fd = open(data_file, O_WRONLY | O_CREAT, 0600);
+  char block[4096] = {0};
+  if (fd == -1 || write(fd, block, sizeof(block)) != sizeof(block)) {
+    fail("data file");
+  }
+  close(fd);
+
+  long long ops = iterations;
+  int per_op = 2;
+  long long start = now_ns();
+  if (strcmp(workload, "read-tracked") == 0) {
+    read_tracked();
+  } else if (strcmp(workload, "write-tracked") == 0) {
+    write_tracked();
+  } else if (strcmp(workload, "read-untracked") == 0) {
+    read_untracked();
+  } else if (strcmp(workload, "open-close") == 0) {
+    open_close();
+  } else if (strcmp(workload, "unlink") == 0) {
+    unlink_storm();
+    per_op = 3;
+  } else if (strcmp(workload, "dir-walk") == 0) {
+    ops = dir_walk();
+    per_op = SYSCALLS_PER_DIR;
+  } else if (strcmp(workload, "threads") == 0) {
+    pthread_t threads[64];
+    workers = workers > 64 ? 64 : workers;
+    for (int i = 0; i < workers; i++) {
+      pthread_create(&threads[i], NULL, read_thread, NULL);
+    }
+    for (int i = 0; i < workers; i++) {
+      pthread_join(threads[i], NULL);
+    }
+    ops *= workers;
+  } else if (strcmp(workload, "fork") == 0) {
+    for (int i = 0; i < workers; i++) {
+      pid_t pid = fork();
+      if (pid == -1) {
+        fail("fork");
+      }
+      if (pid == 0) {
+        read_tracked();
+        _exit(0);
+      }
+    }
+    while (wait(NULL) > 0);
+    ops *= workers;
+  } else {
+    fprintf(stderr, "Unknown workload: %s\n", workload);
+    remove_tree(scratch);
+    return 1;
+  }
+  long long elapsed = now_ns() - start;
+
+  struct rusage self, children;
+  getrusage(RUSAGE_SELF, &self);
+  getrusage(RUSAGE_CHILDREN, &children);
+  long long cpu_ns = (self.ru_utime.tv_sec + self.ru_stime.tv_sec + children.ru_utime.tv_sec +
+                      children.ru_stime.tv_sec) * 1000000000LL +
+                     (self.ru_utime.tv_usec + self.ru_stime.tv_usec + children.ru_utime.tv_usec +
+                      children.ru_stime.tv_usec) * 1000LL;
+  long vcsw = self.ru_nvcsw + children.ru_nvcsw;
+
+  remove_tree(scratch);
+  printf("workload=%s ops=%lld syscalls=%lld elapsed_ns=%lld cpu_ns=%lld vcsw=%ld\n", workload,
+         ops, ops * per_op, elapsed, cpu_ns, vcsw);
+  return 0;
+}
@@ -0,0 +1,31 @@
+#!/bin/bash
+# Throughput of the ptrace backend (with --seccomp, which spreading
+# processes over tracer threads needs) against the number of tracer threads.
+# Runs bin/fork_bench under the sandbox with --tracers 1..N and prints
+# monitored syscalls per second for each.
+#
+# Usage: bench/tracer_scaling.sh [max_tracers] [workers] [iterations] [extra sandbox options...]
+
+cd "$(dirname "$0")/.." || exit 1
+
+MAX_TRACERS=${1:-$(nproc)}
+WORKERS=${2:-32}
+ITERATIONS=${3:-5000}
+shift 3 2>/dev/null
+
+if [ ! -x bin/sandbox ] || [ ! -x bin/fork_bench ]; then
+  echo "Build first: cmake -S . -B build && cmake --build build" >&2
+  exit 1
+fi
+
+# Allow everything so no prompt gets in the way
+POLICY=$(mktemp)
+echo "default allow" > "$POLICY"
+trap 'rm -f "$POLICY"' EXIT
+
+echo "tracers  syscalls/s"
+for ((n = 1; n <= MAX_TRACERS; n++)); do
+  result=$(bin/sandbox --seccomp --tracers "$n" --policy "$POLICY" "$@" bin/fork_bench "$WORKERS" "$ITERATIONS" \
+           | grep -o 'syscalls/s=[0-9]*' | cut -d= -f2)
+  printf "%7d  %s\n" "$n" "${result:-failed}"
+done
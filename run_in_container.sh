@@ -1,12 +1,61 @@
 #!/bin/bash
 
+usage() {
+  echo "Usage: $0 [--no-pool] <program_to_sandbox> [program_args...]"
+  echo "       $0 --pool-start <count> dir:ro... [dir...]  Start idle containers mounting the :ro dirs (programs)"
+  echo "                                               read-only and the others (default: current directory) writable"
+  echo "       $0 --pool-stop                              Remove the idle containers"
+  echo "       $0 --pool-status                            List the idle containers and which are busy"
+  echo "Example: $0 /bin/rm /path/to/file.txt"
+}
+
 # Check if at least one argument is provided
 if [ $# -lt 1 ]; then
-  echo "Usage: $0 <program_to_sandbox> [program_args...]"
-  echo "Example: $0 /bin/rm /path/to/file.txt"
+  usage
   exit 1
 fi
 
+# Time spent in each phase goes to stderr, so it never mixes with the program's output
+now_ns() {
+  date +%s%N
+}
+report_phase() {
+  local label="$1" start="$2" note="$3"
+  local elapsed=$(( $(now_ns) - start ))
+  printf "[sandcon] %-8s %d.%03ds%s\n" "$label:" $((elapsed / 1000000000)) $((elapsed / 1000000 % 1000)) \
+    "${note:+ ($note)}" >&2
+}
+
+POOL_ACTION=""
+USE_POOL=1
+case "$1" in
+  --pool-start)
+    if [[ ! "$2" =~ ^[0-9]+$ ]] || [ "$2" -lt 1 ]; then
+      echo "Error: --pool-start needs a positive number of containers"
+      exit 1
+    fi
+    POOL_ACTION="start"
+    POOL_SIZE="$2"
+    shift 2
+    POOL_MOUNTS=("$@")
+    ;;
+  --pool-stop|--pool-status)
+    POOL_ACTION="${1#--pool-}"
+    ;;
+  --no-pool)
+    USE_POOL=0
+    shift
+    if [ $# -lt 1 ]; then
+      usage
+      exit 1
+    fi
+    ;;
+  -h|--help)
+    usage
+    exit 0
+    ;;
+esac
+
 # Determine if this is the development version or installed version
 SCRIPT_NAME=$(basename "$0")
 if [ "$SCRIPT_NAME" = "sandcon" ]; then
@@ -61,13 +110,113 @@ else
   DOCKERFILE_DIR="$SCRIPT_DIR"
 fi
 
-# Build the Docker image
-echo "Building Docker image from $DOCKERFILE_DIR..."
-docker build -t sandbox-container "$DOCKERFILE_DIR" || {
-  echo "Docker build failed. Please check the Dockerfile and ensure Docker is running."
-  exit 1
+# Tag the image with a hash of everything that goes into it, so it is only
+# rebuilt when the sources change
+PHASE_START=$(now_ns)
+SOURCE_HASH=$(cd "$DOCKERFILE_DIR" &&
+  find Dockerfile CMakeLists.txt src bench -type f 2>/dev/null | LC_ALL=C sort |
+  xargs sha256sum | sha256sum | cut -c1-16)
+IMAGE="sandbox-container:$SOURCE_HASH"
+if docker image inspect "$IMAGE" > /dev/null 2>&1; then
+  report_phase "image" "$PHASE_START" "cached $IMAGE"
+else
+  # Build the Docker image
+  echo "Building Docker image $IMAGE from $DOCKERFILE_DIR..."
+  docker build -t "$IMAGE" -t sandbox-container:latest "$DOCKERFILE_DIR" || {
+    echo "Docker build failed. Please check the Dockerfile and ensure Docker is running."
+    exit 1
+  }
+  report_phase "image" "$PHASE_START" "built $IMAGE"
+fi
+
+# Idle containers are named after the image they run, so a rebuild never
+# dispatches into a container with stale binaries. A busy container is
+# claimed by creating its lock directory, which holds the claimer's PID.
+POOL_PREFIX="sandcon-pool-$SOURCE_HASH"
+LOCK_DIR="${XDG_RUNTIME_DIR:-/tmp}/sandcon-$(id -u)"
+mkdir -p "$LOCK_DIR"
+
+pool_containers() {
+  docker ps --filter "label=sandcon.pool=$SOURCE_HASH" --format '{{.Names}}'
+}
+
+# Start one idle container with the ':'-separated read-only and writable
+# directories `ro` and `rw` mounted at the same paths as on the host
+start_pool_container() {
+  local ro="$1" rw="$2" dir
+  local args=()
+  IFS=':' read -ra DIRS <<< "$ro"
+  for dir in "${DIRS[@]}"; do
+    args+=(-v "$dir:$dir:ro")
+  done
+  IFS=':' read -ra DIRS <<< "$rw"
+  for dir in "${DIRS[@]}"; do
+    args+=(-v "$dir:$dir")
+  done
+  docker run -d --rm \
+    --cap-add=SYS_PTRACE \
+    --security-opt seccomp=unconfined \
+    "${args[@]}" \
+    --label "sandcon.pool=$SOURCE_HASH" \
+    --label "sandcon.ro=$ro" \
+    --label "sandcon.rw=$rw" \
+    --name "$POOL_PREFIX-$(date +%s%N | tail -c 9)-$RANDOM" \
+    --entrypoint sleep \
+    "$IMAGE" infinity > /dev/null
 }
 
+# Same as the image's entrypoint: the tree's own build, else an installed sandbox
+SANDBOX_CMD=(sh -c 'if [ -f /app/bin/sandbox ]; then exec /app/bin/sandbox "$@"; else exec sandbox "$@"; fi' --)
+
+case "$POOL_ACTION" in
+  start)
+    PHASE_START=$(now_ns)
+    RO_MOUNTS=""
+    RW_MOUNTS=""
+    for DIR in "${POOL_MOUNTS[@]}"; do
+      if [[ "$DIR" == *:ro ]]; then
+        DIR=$(cd "${DIR%:ro}" && pwd) || exit 1
+        RO_MOUNTS="${RO_MOUNTS:+$RO_MOUNTS:}$DIR"
+      else
+        DIR=$(cd "$DIR" && pwd) || exit 1
+        RW_MOUNTS="${RW_MOUNTS:+$RW_MOUNTS:}$DIR"
+      fi
+    done
+    # Programs are only ever mounted read-only, as in a fresh container
+    if [ -z "$RO_MOUNTS" ]; then
+      echo "Error: --pool-start needs a dir:ro holding the programs to run"
+      exit 1
+    fi
+    [ -z "$RW_MOUNTS" ] && RW_MOUNTS=$(pwd)
+    STARTED=0
+    for ((i = 0; i < POOL_SIZE; i++)); do
+      start_pool_container "$RO_MOUNTS" "$RW_MOUNTS" && STARTED=$((STARTED + 1))
+    done
+    report_phase "pool" "$PHASE_START" \
+      "started $STARTED idle containers mounting $RO_MOUNTS read-only and $RW_MOUNTS writable"
+    exit 0
+    ;;
+  stop)
+    CONTAINERS=$(docker ps --filter "label=sandcon.pool" --format '{{.Names}}')
+    if [ -n "$CONTAINERS" ]; then
+      docker rm -f $CONTAINERS > /dev/null
+    fi
+    rm -rf "$LOCK_DIR"
+    echo "Removed $(echo -n "$CONTAINERS" | grep -c .) idle containers"
+    exit 0
+    ;;
+  status)
+    for NAME in $(pool_containers); do
+      if [ -d "$LOCK_DIR/$NAME" ]; then
+        echo "$NAME busy (pid $(cat "$LOCK_DIR/$NAME/pid" 2>/dev/null))"
+      else
+        echo "$NAME idle"
+      fi
+    done
+    exit 0
+    ;;
+esac
+
 # Get the program and arguments
 PROGRAM="$1"
 shift
@@ -116,14 +265,80 @@ echo "Program name: $PROGRAM_NAME"
 echo "Working directory: $(pwd)"
 echo "Arguments: ${PROGRAM_ARGS[@]}"
 
+# Whether `path` lies inside one of the ':'-separated directories in `mounts`
+is_mounted() {
+  local path="$1" mounts="$2" dir
+  IFS=':' read -ra DIRS <<< "$mounts"
+  for dir in "${DIRS[@]}"; do
+    if [ "$path" = "$dir" ] || [[ "$path" == "$dir"/* ]]; then
+      return 0
+    fi
+  done
+  return 1
+}
+
+# Claim an idle container that mounts the program read-only and the current
+# directory writable, as a fresh container would. Locks left behind by a
+# dead claimer are taken over.
+claim_container() {
+  local name ro rw
+  for name in $(pool_containers); do
+    ro=$(docker inspect --format '{{index .Config.Labels "sandcon.ro"}}' "$name" 2>/dev/null)
+    rw=$(docker inspect --format '{{index .Config.Labels "sandcon.rw"}}' "$name" 2>/dev/null)
+    is_mounted "$PROGRAM_DIR" "$ro" && is_mounted "$(pwd)" "$rw" || continue
+    if [ -d "$LOCK_DIR/$name" ] && ! kill -0 "$(cat "$LOCK_DIR/$name/pid" 2>/dev/null)" 2>/dev/null; then
+      rm -rf "$LOCK_DIR/$name"
+    fi
+    if mkdir "$LOCK_DIR/$name" 2>/dev/null; then
+      echo $$ > "$LOCK_DIR/$name/pid"
+      CLAIMED="$name"
+      CLAIMED_RO="$ro"
+      CLAIMED_RW="$rw"
+      return 0
+    fi
+  done
+  return 1
+}
+
+# Only ask Docker for a terminal when there is one
+if [ -t 0 ]; then
+  TTY_ARGS=(-it)
+else
+  TTY_ARGS=(-i)
+fi
+
+PHASE_START=$(now_ns)
+CLAIMED=""
+if [ "$USE_POOL" -eq 1 ] && claim_container; then
+  trap 'rm -rf "$LOCK_DIR/$CLAIMED"' EXIT
+  report_phase "dispatch" "$PHASE_START" "idle container $CLAIMED"
+
+  echo "Running sandbox in pooled container with program: $PROGRAM ${PROGRAM_ARGS[@]}"
+  PHASE_START=$(now_ns)
+  docker exec "${TTY_ARGS[@]}" -w "$(pwd)" "$CLAIMED" "${SANDBOX_CMD[@]}" "$PROGRAM" "${PROGRAM_ARGS[@]}"
+  STATUS=$?
+  report_phase "run" "$PHASE_START"
+
+  # A container runs one command: whatever it left behind (in /tmp, say)
+  # goes with it, and a clean one takes its place in the background
+  docker rm -f "$CLAIMED" > /dev/null 2>&1
+  start_pool_container "$CLAIMED_RO" "$CLAIMED_RW" > /dev/null 2>&1 &
+  exit $STATUS
+fi
+report_phase "dispatch" "$PHASE_START" "no idle container, starting a new one"
+
 # Run the Docker container with SYS_PTRACE capability
 # Mount the program directory and current directory
 echo "Running sandbox in container with program: $PROGRAM ${PROGRAM_ARGS[@]}"
-docker run --rm -it \
+PHASE_START=$(now_ns)
+docker run --rm "${TTY_ARGS[@]}" \
   --cap-add=SYS_PTRACE \
   --security-opt seccomp=unconfined \
   -v "$PROGRAM_DIR:$PROGRAM_DIR:ro" \
   -v "$(pwd):$(pwd)" \
   -w "$(pwd)" \
-  --name sandbox-instance \
-  sandbox-container "$PROGRAM" "${PROGRAM_ARGS[@]}"
\ No newline at end of file
+  --name "sandbox-instance-$$" \
+  "$IMAGE" "$PROGRAM" "${PROGRAM_ARGS[@]}"
+STATUS=$?
+report_phase "run" "$PHASE_START" "including container start and removal"
+exit $STATUS
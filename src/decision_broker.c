@@ -0,0 +1,491 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "decision_broker.h"
+#include "event_log.h"
+#include "sandbox_common.h"
+#include "verdict_cache.h"
+
+// One event waiting for an answer
+typedef struct request {
+  unsigned long id;
+  monitor_event_t event;         // `event.path` points at `path`, `event.path2` at `path2`
+  char path[MAX_PATH];
+  char path2[MAX_PATH];
+  char details[2 * MAX_PATH + 100];
+  long deadline;                 // Monotonic ms when the default applies, 0 = never. Set
+                                 // once the question is shown, not while it waits its turn.
+  decision_done_t done;
+  void *ctx;
+  struct request *next;
+} request_t;
+
+// An answer as typed at the prompt or sent by the daemon
+typedef struct {
+  verdict_t verdict;
+  verdict_scope_t scope;
+  int remember;
+} answer_t;
+
+static broker_config_t config;
+
+// Submitted requests, oldest first. Submitters also write a byte to
+// wake_pipe so the broker can wait for requests and daemon replies at once.
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static request_t *queue_head = NULL;
+static request_t *queue_tail = NULL;
+static unsigned long next_id = 1;
+static int wake_pipe[2] = {-1, -1};
+
+// Daemon connection; only the broker thread touches these
+static int daemon_fd = -1;
+static request_t *sent = NULL;   // Sent to the daemon, waiting for its reply
+static char reply_buf[MAX_PATH + 128];
+static size_t reply_len = 0;
+
+static long now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+// Parse "y", "n", "a [dir|all]" or "v [dir|all]" (or the long forms).
+// Anything else denies this once.
+static answer_t parse_answer(char *line) {
+  answer_t answer = { VERDICT_DENY, VERDICT_SCOPE_FILE, 0 };
+  char *save = NULL;
+  char *word = strtok_r(line, " \t\r\n", &save);
+  char *scope_word = word ? strtok_r(NULL, " \t\r\n", &save) : NULL;
+  if (!word) {
+    return answer;
+  }
+
+  if (strcasecmp(word, "y") == 0 || strcasecmp(word, "yes") == 0) {
+    answer.verdict = VERDICT_ALLOW;
+  } else if (strcasecmp(word, "a") == 0 || strcasecmp(word, "always") == 0) {
+    answer.verdict = VERDICT_ALLOW;
+    answer.remember = 1;
+  } else if (strcasecmp(word, "v") == 0 || strcasecmp(word, "never") == 0) {
+    answer.remember = 1;
+  }
+
+  if (scope_word && (strcasecmp(scope_word, "dir") == 0 || strcasecmp(scope_word, "d") == 0)) {
+    answer.scope = VERDICT_SCOPE_DIR;
+  } else if (scope_word && (strcasecmp(scope_word, "all") == 0 || strcmp(scope_word, "*") == 0)) {
+    answer.scope = VERDICT_SCOPE_ALL;
+  }
+  return answer;
+}
+
+// Report an answer, remember it if asked to and pass it on. `who` answered
+// about `what`.
+static void finish_request(request_t *req, answer_t answer, event_source_t source, const char *who,
+                           const char *what) {
+  monitor_event_t *event = &req->event;
+  int remember = answer.remember;
+  if (remember && verdict_cache_remember(event->op, event->path, answer.scope, answer.verdict) == -1) {
+    fprintf(stderr, "Could not remember the answer for %s\n", event->path);
+    remember = 0;
+  }
+
+  char note[MAX_PATH + 64] = "";
+  if (remember) {
+    if (answer.scope == VERDICT_SCOPE_ALL) {
+      snprintf(note, sizeof(note), " (remembered for every path)");
+    } else if (answer.scope == VERDICT_SCOPE_DIR) {
+      const char *slash = strrchr(event->path, '/');
+      int dir_len = slash ? (int)(slash - event->path) + 1 : 0;
+      snprintf(note, sizeof(note), " (remembered for %.*s)", dir_len, event->path);
+    } else {
+      snprintf(note, sizeof(note), " (remembered)");
+    }
+  }
+
+  int allowed = answer.verdict == VERDICT_ALLOW;
+  if (allowed) {
+    printf("%s[+] ALLOWED: %s permitted %s%s%s\n", ALLOWED_COLOR, who, what, note, COLOR_RESET);
+  } else {
+    printf("%s[-] BLOCKED: %s denied %s%s%s\n", BLOCKED_COLOR, who, what, note, COLOR_RESET);
+  }
+  fflush(stdout);
+
+  event_log_record(event, allowed, source);
+  req->done(req->ctx, allowed);
+  free(req);
+}
+
+// Answer with the configured default because nobody else did
+static void finish_default(request_t *req, const char *why) {
+  if (config.default_allow) {
+    printf("\n%s[+] ALLOWED: %s, allowing by default: %s%s\n", ALLOWED_COLOR, why, req->details,
+           COLOR_RESET);
+  } else {
+    printf("\n%s[-] BLOCKED: %s, denying by default: %s%s\n", BLOCKED_COLOR, why, req->details,
+           COLOR_RESET);
+  }
+  fflush(stdout);
+
+  event_log_record(&req->event, config.default_allow, EVENT_SOURCE_DEFAULT);
+  req->done(req->ctx, config.default_allow);
+  free(req);
+}
+
+// An answer given while the request waited may already cover it
+static int settle_from_cache(request_t *req) {
+  verdict_t remembered = verdict_cache_lookup(req->event.op, req->event.path);
+  if (remembered == VERDICT_NONE) {
+    return 0;
+  }
+  event_log_record(&req->event, remembered == VERDICT_ALLOW, EVENT_SOURCE_REMEMBERED);
+  req->done(req->ctx, remembered == VERDICT_ALLOW);
+  free(req);
+  return 1;
+}
+
+// Read one non-empty line of input before `deadline` (0 = no limit).
+// Returns 1 on success, 0 on EOF or error, -1 on timeout.
+static int read_answer(char *buf, size_t size, long deadline) {
+  for (;;) {
+    if (deadline) {
+      long left = deadline - now_ms();
+      if (left <= 0) {
+        return -1;
+      }
+      struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+      int ready = poll(&pfd, 1, (int)left);
+      if (ready == 0) {
+        return -1;
+      }
+      if (ready == -1 && errno == EINTR) {
+        continue;
+      }
+    }
+
+    if (!fgets(buf, (int)size, stdin)) {
+      return 0;
+    }
+    size_t len = strlen(buf);
+    // Discard the rest of an over-long line
+    if (len && buf[len - 1] != '\n') {
+      int c;
+      while ((c = getchar()) != '\n' && c != EOF);
+    }
+    if (strspn(buf, " \t\n") != len) {
+      return 1;
+    }
+  }
+}
+
+// Give `req` the full --timeout from now on
+static void start_deadline(request_t *req) {
+  req->deadline = config.timeout_ms ? now_ms() + config.timeout_ms : 0;
+}
+
+// Prompt on the terminal and wait for the answer or the deadline
+static void ask_user(request_t *req) {
+  printf("\n%s[!] ALERT: Program is attempting to %s%s\n", ALERT_COLOR, req->details, COLOR_RESET);
+  printf("%sAllow this operation? (y/n, a = always, v = never; add 'dir' or 'all' to a/v to cover "
+         "the directory or every %s): %s", PROMPT_COLOR, req->event.operation, COLOR_RESET);
+  fflush(stdout);
+  start_deadline(req);
+
+  char line[64] = "";
+  int got = read_answer(line, sizeof(line), req->deadline);
+  if (got == -1) {
+    char why[64];
+    snprintf(why, sizeof(why), "No answer within %gs", config.timeout_ms / 1000.0);
+    finish_default(req, why);
+    return;
+  }
+
+  // EOF or a read error leaves the line empty, which denies
+  char what[64];
+  snprintf(what, sizeof(what), "%s operation", req->event.operation);
+  finish_request(req, parse_answer(line), EVENT_SOURCE_USER, "User", what);
+}
+
+// Answer everything still waiting on the daemon with the default
+static void daemon_lost(void) {
+  if (daemon_fd != -1) {
+    fprintf(stderr, "Lost the connection to the policy daemon\n");
+    close(daemon_fd);
+    daemon_fd = -1;
+  }
+  while (sent) {
+    request_t *req = sent;
+    sent = req->next;
+    finish_default(req, "Policy daemon is gone");
+  }
+}
+
+// Send `<id> <operation> <path>` and wait for the reply in the main loop
+static void send_to_daemon(request_t *req) {
+  if (daemon_fd == -1) {
+    finish_default(req, "Policy daemon is gone");
+    return;
+  }
+  if (strchr(req->path, '\n')) {
+    finish_default(req, "Path cannot be sent to the policy daemon");
+    return;
+  }
+
+  char line[MAX_PATH + 64];
+  int len = snprintf(line, sizeof(line), "%lu %s %s\n", req->id, req->event.operation, req->path);
+  // A cut-off line would ask about a different path
+  if (len < 0 || (size_t)len >= sizeof(line)) {
+    finish_default(req, "Path cannot be sent to the policy daemon");
+    return;
+  }
+  for (int off = 0; off < len;) {
+    ssize_t n = send(daemon_fd, line + off, (size_t)(len - off), MSG_NOSIGNAL);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      daemon_lost();
+      finish_default(req, "Policy daemon is gone");
+      return;
+    }
+    off += (int)n;
+  }
+
+  start_deadline(req);
+  req->next = sent;
+  sent = req;
+}
+
+// Handle one `<id> <answer> [dir|all]` line from the daemon
+static void handle_reply(char *line) {
+  char *rest;
+  unsigned long id = strtoul(line, &rest, 10);
+  request_t **link = &sent;
+  while (*link && (*link)->id != id) {
+    link = &(*link)->next;
+  }
+  if (rest == line || !*link) {
+    fprintf(stderr, "Ignoring unexpected reply from the policy daemon: %s\n", line);
+    return;
+  }
+
+  request_t *req = *link;
+  *link = req->next;
+  answer_t answer = parse_answer(rest);
+  char what[sizeof(req->details)];
+  snprintf(what, sizeof(what), "%s", req->details);
+  finish_request(req, answer, EVENT_SOURCE_DAEMON, "Policy daemon", what);
+
+  // A remembered answer may settle other events it was asked about
+  if (answer.remember) {
+    for (link = &sent; *link;) {
+      request_t *other = *link;
+      *link = other->next;
+      if (!settle_from_cache(other)) {
+        *link = other;
+        link = &other->next;
+      }
+    }
+  }
+}
+
+static void read_daemon_replies(void) {
+  ssize_t n = read(daemon_fd, reply_buf + reply_len, sizeof(reply_buf) - 1 - reply_len);
+  if (n == -1 && errno == EINTR) {
+    return;
+  }
+  if (n <= 0) {
+    daemon_lost();
+    return;
+  }
+  reply_len += (size_t)n;
+
+  char *line = reply_buf;
+  char *newline;
+  while ((newline = memchr(line, '\n', (size_t)(reply_buf + reply_len - line)))) {
+    *newline = '\0';
+    handle_reply(line);
+    line = newline + 1;
+  }
+  reply_len = (size_t)(reply_buf + reply_len - line);
+  memmove(reply_buf, line, reply_len);
+  if (reply_len == sizeof(reply_buf) - 1) {
+    // No newline in a full buffer; drop the garbage
+    reply_len = 0;
+  }
+}
+
+// Apply the default to daemon requests past their deadline. Returns the
+// poll() timeout until the next deadline, or -1 if there is none.
+static int expire_sent(void) {
+  long now = now_ms();
+  long next = 0;
+  for (request_t **link = &sent; *link;) {
+    request_t *req = *link;
+    if (req->deadline && req->deadline <= now) {
+      *link = req->next;
+      char why[64];
+      snprintf(why, sizeof(why), "No answer from the policy daemon within %gs", config.timeout_ms / 1000.0);
+      finish_default(req, why);
+      continue;
+    }
+    if (req->deadline && (!next || req->deadline < next)) {
+      next = req->deadline;
+    }
+    link = &req->next;
+  }
+  return next ? (int)(next - now) : -1;
+}
+
+static request_t *take_queued(void) {
+  pthread_mutex_lock(&queue_lock);
+  request_t *batch = queue_head;
+  queue_head = queue_tail = NULL;
+  pthread_mutex_unlock(&queue_lock);
+  return batch;
+}
+
+static void *broker_main(void *arg) {
+  (void)arg;
+  for (;;) {
+    request_t *batch = take_queued();
+    while (batch) {
+      request_t *req = batch;
+      batch = req->next;
+      req->next = NULL;
+
+      if (settle_from_cache(req)) {
+        continue;
+      }
+      if (config.batch) {
+        event_log_record(&req->event, config.default_allow, EVENT_SOURCE_DEFAULT);
+        req->done(req->ctx, config.default_allow);
+        free(req);
+      } else if (config.daemon_socket) {
+        send_to_daemon(req);
+      } else {
+        ask_user(req);
+      }
+    }
+
+    // Wait for new requests, daemon replies or the next deadline
+    int timeout = expire_sent();
+    struct pollfd fds[2] = {
+      { wake_pipe[0], POLLIN, 0 },
+      { daemon_fd, POLLIN, 0 },
+    };
+    int nfds = daemon_fd == -1 ? 1 : 2;
+    if (poll(fds, nfds, timeout) == -1) {
+      if (errno != EINTR) {
+        perror("broker poll");
+      }
+      continue;
+    }
+    if (fds[0].revents & POLLIN) {
+      char drain[256];
+      while (read(wake_pipe[0], drain, sizeof(drain)) > 0);
+    }
+    if (nfds == 2 && fds[1].revents) {
+      read_daemon_replies();
+    }
+  }
+  return NULL;
+}
+
+static int connect_daemon(const char *path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Policy daemon socket path is too long: %s\n", path);
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    perror("socket");
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+    fprintf(stderr, "Cannot connect to the policy daemon at %s: %s\n", path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int broker_start(const broker_config_t *broker_config) {
+  config = *broker_config;
+
+  if (config.daemon_socket) {
+    daemon_fd = connect_daemon(config.daemon_socket);
+    if (daemon_fd == -1) {
+      return -1;
+    }
+  }
+
+  // Close-on-exec so the sandboxed program does not inherit them
+  if (pipe2(wake_pipe, O_CLOEXEC | O_NONBLOCK) == -1) {
+    perror("pipe");
+    return -1;
+  }
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, broker_main, NULL) != 0) {
+    perror("pthread_create");
+    return -1;
+  }
+  pthread_detach(thread);
+  return 0;
+}
+
+int broker_submit(const monitor_event_t *event, decision_done_t done, void *ctx) {
+  if (wake_pipe[1] == -1) {
+    fprintf(stderr, "Decision broker is not running\n");
+    return -1;
+  }
+
+  request_t *req = calloc(1, sizeof(request_t));
+  if (!req) {
+    perror("calloc");
+    return -1;
+  }
+  req->event = *event;
+  snprintf(req->path, sizeof(req->path), "%s", event->path);
+  req->event.path = req->path;
+  req->event.path_id = PATH_ID_NONE;   // Not ours to keep alive
+  if (event->path2) {
+    snprintf(req->path2, sizeof(req->path2), "%s", event->path2);
+    req->event.path2 = req->path2;
+  }
+  req->event.path2_id = PATH_ID_NONE;
+  describe_event(&req->event, req->details, sizeof(req->details));
+  req->done = done;
+  req->ctx = ctx;
+
+  pthread_mutex_lock(&queue_lock);
+  req->id = next_id++;
+  if (queue_tail) {
+    queue_tail->next = req;
+  } else {
+    queue_head = req;
+  }
+  queue_tail = req;
+  pthread_mutex_unlock(&queue_lock);
+
+  // A full pipe already guarantees a wakeup
+  char byte = 0;
+  if (write(wake_pipe[1], &byte, 1) == -1 && errno != EAGAIN) {
+    perror("broker wake");
+  }
+  return 0;
+}
@@ -0,0 +1,25 @@
+#ifndef DECISION_BROKER_H
+#define DECISION_BROKER_H
+
+#include "monitor.h"
+
+// The decision broker answers the events the policy leaves to the user.
+// It runs on its own thread so a pending prompt never stops the tracers:
+// they park the asking task and keep servicing everything else.
+typedef struct {
+  const char *daemon_socket;  // Unix socket of a policy daemon to ask instead of the terminal, or NULL
+  int timeout_ms;             // How long an event may wait for an answer; 0 waits forever
+  int default_allow;          // Answer used when the timeout expires or the daemon is gone
+  int batch;                  // Nobody to ask: settle every event with the default, silently
+} broker_config_t;
+
+// Start the broker thread (and connect to the daemon, if any).
+// Returns 0 on success, -1 on error.
+int broker_start(const broker_config_t *config);
+
+// Queue `event` for an answer. The event is copied; `done(ctx, allowed)`
+// is called later on the broker thread. Returns 0, or -1 if the event
+// could not be queued.
+int broker_submit(const monitor_event_t *event, decision_done_t done, void *ctx);
+
+#endif /* DECISION_BROKER_H */
@@ -0,0 +1,508 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "event_log.h"
+#include "sandbox_common.h"
+#include "trace_file.h"
+
+// Bounded MPSC ring (one sequence number per slot): producers claim a
+// position with a CAS on `head` and publish the slot by advancing its
+// sequence; the logger is the only consumer.
+#define RING_SLOTS 65536
+
+typedef struct {
+  _Atomic uint64_t seq;
+  event_record_t record;
+} ring_slot_t;
+
+static ring_slot_t *ring = NULL;
+static _Atomic uint64_t head;
+static uint64_t tail;            // Logger thread only
+static atomic_ulong dropped;
+
+// The logger sleeps on `wake` only after announcing it in `idle`, so
+// producers only pay for a signal when it is actually asleep
+static pthread_t logger;
+static pthread_mutex_t wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static atomic_int idle;
+static atomic_int stopping;
+// Producers waiting for room in a full ring, which only happens while
+// recording a trace; they sleep on `space` under `wake_lock`
+static pthread_cond_t space = PTHREAD_COND_INITIALIZER;
+static atomic_int full_waiters;
+static int running = 0;
+
+static FILE *log_file = NULL;
+static event_log_format_t log_format = EVENT_LOG_TEXT;
+static trace_writer_t *trace = NULL;
+static int quiet = 0;
+
+// Decided events, and the denials by path. Denials are counted when they
+// are decided, so one the ring has no room for still shows in the summary.
+static atomic_ulong allowed_count;
+static atomic_ulong denied_count;
+static pthread_mutex_t denials_lock = PTHREAD_MUTEX_INITIALIZER;
+static event_log_denial_t *denials = NULL;
+static size_t denials_cap = 0;
+static size_t num_denials = 0;
+
+static const char *source_names[] = { "policy", "remembered", "user", "daemon", "default" };
+
+static int ring_push(const event_record_t *record) {
+  uint64_t pos = atomic_load_explicit(&head, memory_order_relaxed);
+  ring_slot_t *slot;
+  for (;;) {
+    slot = &ring[pos & (RING_SLOTS - 1)];
+    uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    int64_t diff = (int64_t)(seq - pos);
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&head, &pos, pos + 1, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // Full: the logger has not caught up with a whole ring
+      return -1;
+    } else {
+      pos = atomic_load_explicit(&head, memory_order_relaxed);
+    }
+  }
+
+  slot->record = *record;
+  atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+  return 0;
+}
+
+static int ring_pop(event_record_t *record) {
+  ring_slot_t *slot = &ring[tail & (RING_SLOTS - 1)];
+  if (atomic_load_explicit(&slot->seq, memory_order_acquire) != tail + 1) {
+    return 0;
+  }
+  *record = slot->record;
+  atomic_store_explicit(&slot->seq, tail + RING_SLOTS, memory_order_release);
+  tail++;
+  return 1;
+}
+
+// Rebuild enough of the event to describe it the way the prompt does
+static void describe_record(const event_record_t *record, const char *path, const char *path2,
+                            char *details, size_t size) {
+  monitor_event_t event;
+  init_event(&event, record->pid, record->syscall_nr);
+  event.path = path;
+  event.path2 = path2;
+  event.flags = record->flags;
+  const syscall_desc_t *desc = syscall_desc(record->syscall_nr);
+  if (desc) {
+    if (desc->operand[0].fd >= 0) {
+      event.fd = record->fd;
+    } else if (desc->operand[0].dirfd >= 0) {
+      event.dirfd = record->fd;
+    }
+    if (desc->operand[1].fd >= 0) {
+      event.fd2 = record->fd2;
+    } else if (desc->operand[1].dirfd >= 0) {
+      event.dirfd2 = record->fd2;
+    }
+  }
+  describe_event(&event, details, size);
+}
+
+// Which of an operand's fd or dirfd a record keeps
+static int32_t record_fd(const syscall_desc_t *desc, int index, int fd, int dirfd) {
+  if (desc && desc->operand[index].path >= 0) {
+    return desc->operand[index].dirfd >= 0 ? dirfd : -1;
+  }
+  return fd;
+}
+
+// Interned id of an operand's path with a reference for the record
+static uint32_t record_path(path_id_t id, const char *path) {
+  if (id != PATH_ID_NONE) {
+    path_ref(id);
+    return id;
+  }
+  return path ? path_intern(path) : PATH_ID_NONE;
+}
+
+static void print_denial(const event_record_t *record, const char *path, const char *path2) {
+  char details[2 * MAX_PATH + 100];
+  describe_record(record, path, path2, details, sizeof(details));
+  printf("\n%s[-] BLOCKED: %s denies attempt to %s%s\n", BLOCKED_COLOR,
+         record->source == EVENT_SOURCE_POLICY ? "Policy" : "Remembered answer", details,
+         COLOR_RESET);
+}
+
+static void write_json_string(FILE *out, const char *s) {
+  fputc('"', out);
+  for (const unsigned char *p = (const unsigned char *)s; *p; p++) {
+    if (*p == '"' || *p == '\\') {
+      fprintf(out, "\\%c", *p);
+    } else if (*p < 0x20) {
+      fprintf(out, "\\u%04x", *p);
+    } else {
+      fputc(*p, out);
+    }
+  }
+  fputc('"', out);
+}
+
+static void write_record(const event_record_t *record, const char *path, const char *path2) {
+  if (log_format == EVENT_LOG_BINARY) {
+    event_record_t out = *record;
+    size_t len = strlen(path);
+    size_t len2 = strlen(path2);
+    out.path = (uint32_t)len;
+    out.path2 = (uint32_t)len2;
+    fwrite(&out, sizeof(out), 1, log_file);
+    fwrite(path, 1, len, log_file);
+    fwrite(path2, 1, len2, log_file);
+    return;
+  }
+
+  char stamp[32];
+  time_t secs = (time_t)(record->time_ns / 1000000000ULL);
+  struct tm tm;
+  gmtime_r(&secs, &tm);
+  strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+  unsigned long micros = (unsigned long)(record->time_ns % 1000000000ULL / 1000);
+
+  if (log_format == EVENT_LOG_JSON) {
+    fprintf(log_file, "{\"time\":\"%s.%06luZ\",\"pid\":%d,\"syscall\":%d,\"op\":\"%s\",\"fd\":%d,"
+            "\"flags\":%d,\"path\":", stamp, micros, record->pid, record->syscall_nr,
+            policy_op_name((policy_op_t)record->op), record->fd, record->flags);
+    write_json_string(log_file, path);
+    if (record->path2 != PATH_ID_NONE) {
+      fprintf(log_file, ",\"op2\":\"%s\",\"fd2\":%d,\"path2\":",
+              policy_op_name((policy_op_t)record->op2), record->fd2);
+      write_json_string(log_file, path2);
+    }
+    fprintf(log_file, ",\"verdict\":\"%s\",\"source\":\"%s\"}\n", record->allowed ? "allow" : "deny",
+            source_names[record->source]);
+    return;
+  }
+
+  char details[2 * MAX_PATH + 100];
+  describe_record(record, path, path2, details, sizeof(details));
+  fprintf(log_file, "%s.%06luZ [%d] %s by %s: %s\n", stamp, micros, record->pid,
+          record->allowed ? "ALLOWED" : "BLOCKED", source_names[record->source], details);
+}
+
+static uint64_t hash_denial(const char *path, uint8_t op) {
+  uint64_t h = 0xcbf29ce484222325ULL ^ op;
+  for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+    h = (h ^ *p) * 0x100000001b3ULL;
+  }
+  return h;
+}
+
+// Count a denial of `op` on `path` in an open-addressing table kept at
+// most half full. Called with `denials_lock` held.
+static void count_denial(const char *path, uint8_t op) {
+  if ((num_denials + 1) * 2 > denials_cap) {
+    size_t cap = denials_cap ? denials_cap * 2 : 256;
+    event_log_denial_t *grown = calloc(cap, sizeof(event_log_denial_t));
+    if (!grown) {
+      return;
+    }
+    for (size_t i = 0; i < denials_cap; i++) {
+      if (denials[i].path) {
+        size_t slot = hash_denial(denials[i].path, (uint8_t)denials[i].op) & (cap - 1);
+        while (grown[slot].path) {
+          slot = (slot + 1) & (cap - 1);
+        }
+        grown[slot] = denials[i];
+      }
+    }
+    free(denials);
+    denials = grown;
+    denials_cap = cap;
+  }
+
+  size_t slot = hash_denial(path, op) & (denials_cap - 1);
+  while (denials[slot].path) {
+    if (denials[slot].op == (policy_op_t)op && strcmp(denials[slot].path, path) == 0) {
+      denials[slot].count++;
+      return;
+    }
+    slot = (slot + 1) & (denials_cap - 1);
+  }
+  denials[slot].path = strdup(path);
+  if (denials[slot].path) {
+    denials[slot].op = (policy_op_t)op;
+    denials[slot].count = 1;
+    num_denials++;
+  }
+}
+
+// Count a denied event under each operand that has a path (sendfile's
+// output may not)
+static void count_denials(const monitor_event_t *event) {
+  int named = 0;
+  pthread_mutex_lock(&denials_lock);
+  if (event->path && *event->path) {
+    count_denial(event->path, (uint8_t)event->op);
+    named = 1;
+  }
+  if (event->path2 && *event->path2) {
+    count_denial(event->path2, (uint8_t)event->op2);
+    named = 1;
+  }
+  if (!named) {
+    count_denial("(unknown)", (uint8_t)event->op);
+  }
+  pthread_mutex_unlock(&denials_lock);
+}
+
+static void render(const event_record_t *record) {
+  const char *path = path_lookup(record->path);
+  if (!path) {
+    path = "";
+  }
+  const char *path2 = path_lookup(record->path2);
+
+  // Prompted events were already reported by whoever answered them
+  if (!record->allowed && record->source <= EVENT_SOURCE_REMEMBERED && !quiet) {
+    print_denial(record, path, path2);
+  }
+  if (log_file) {
+    write_record(record, path, path2 ? path2 : "");
+  }
+  if (trace) {
+    trace_writer_add(trace, record, path, path2);
+  }
+  path_unref(record->path);
+  path_unref(record->path2);
+}
+
+static void *logger_main(void *arg) {
+  (void)arg;
+  for (;;) {
+    event_record_t record;
+    int rendered = 0;
+    while (ring_pop(&record)) {
+      render(&record);
+      rendered = 1;
+    }
+    if (rendered) {
+      fflush(stdout);
+      if (log_file) {
+        fflush(log_file);
+      }
+      if (atomic_load(&full_waiters)) {
+        pthread_mutex_lock(&wake_lock);
+        pthread_cond_broadcast(&space);
+        pthread_mutex_unlock(&wake_lock);
+      }
+      continue;
+    }
+    if (atomic_load(&stopping)) {
+      break;
+    }
+
+    // Announce the sleep, then look once more so a record published in
+    // between is not missed
+    pthread_mutex_lock(&wake_lock);
+    atomic_store(&idle, 1);
+    ring_slot_t *next = &ring[tail & (RING_SLOTS - 1)];
+    if (atomic_load(&full_waiters)) {
+      // A producer found the ring full before the last batch was taken
+      pthread_cond_broadcast(&space);
+    } else if (atomic_load(&next->seq) != tail + 1 && !atomic_load(&stopping)) {
+      pthread_cond_wait(&wake, &wake_lock);
+    }
+    atomic_store(&idle, 0);
+    pthread_mutex_unlock(&wake_lock);
+  }
+  return NULL;
+}
+
+static void wake_logger(void) {
+  // Order the slot's publication before the check (pairs with the
+  // logger storing `idle` before its last look at the ring)
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load(&idle)) {
+    pthread_mutex_lock(&wake_lock);
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&wake_lock);
+  }
+}
+
+// Sleep until the logger has taken records out of the ring. The count
+// is raised under the lock the logger checks it with before sleeping, so
+// the wakeup cannot be missed.
+static void wait_for_space(void) {
+  pthread_mutex_lock(&wake_lock);
+  atomic_fetch_add(&full_waiters, 1);
+  pthread_cond_signal(&wake);
+  pthread_cond_wait(&space, &wake_lock);
+  atomic_fetch_sub(&full_waiters, 1);
+  pthread_mutex_unlock(&wake_lock);
+}
+
+int event_log_start(const char *filename, event_log_format_t format, const char *trace_filename) {
+  ring = calloc(RING_SLOTS, sizeof(ring_slot_t));
+  if (!ring) {
+    perror("calloc");
+    return -1;
+  }
+  for (uint64_t i = 0; i < RING_SLOTS; i++) {
+    atomic_init(&ring[i].seq, i);
+  }
+
+  if (filename) {
+    // Close-on-exec so the sandboxed program cannot write to it
+    log_file = fopen(filename, format == EVENT_LOG_BINARY ? "wbe" : "we");
+    if (!log_file) {
+      fprintf(stderr, "Cannot open log %s: %s\n", filename, strerror(errno));
+      return -1;
+    }
+    log_format = format;
+    if (format == EVENT_LOG_BINARY) {
+      fwrite(EVENT_LOG_MAGIC, 1, sizeof(EVENT_LOG_MAGIC), log_file);
+    }
+  }
+  if (trace_filename) {
+    trace = trace_writer_open(trace_filename);
+    if (!trace) {
+      return -1;
+    }
+  }
+
+  if (pthread_create(&logger, NULL, logger_main, NULL) != 0) {
+    perror("pthread_create");
+    return -1;
+  }
+  running = 1;
+  return 0;
+}
+
+void event_log_record(const monitor_event_t *event, int allowed, event_source_t source) {
+  if (!running) {
+    return;
+  }
+  atomic_fetch_add_explicit(allowed ? &allowed_count : &denied_count, 1, memory_order_relaxed);
+  // Without a log file or trace only denials are shown
+  if (allowed && !log_file && !trace) {
+    return;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  // Records keep the operands in syscall order
+  monitor_event_t in_order = *event;
+  if (in_order.swapped) {
+    swap_operands(&in_order);
+  }
+  if (!allowed) {
+    count_denials(&in_order);
+  }
+  const syscall_desc_t *desc = syscall_desc(in_order.syscall_nr);
+
+  event_record_t record;
+  record.time_ns = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+  record.pid = in_order.pid;
+  record.syscall_nr = (int32_t)in_order.syscall_nr;
+  record.fd = record_fd(desc, 0, in_order.fd, in_order.dirfd);
+  record.fd2 = record_fd(desc, 1, in_order.fd2, in_order.dirfd2);
+  record.flags = in_order.flags;
+  record.op = (uint8_t)in_order.op;
+  record.op2 = (uint8_t)in_order.op2;
+  record.allowed = (uint8_t)(allowed != 0);
+  record.source = (uint8_t)source;
+  record.path = record_path(in_order.path_id, in_order.path);
+  record.path2 = record_path(in_order.path2_id, in_order.path2);
+
+  while (ring_push(&record) == -1) {
+    // A trace has to hold every event for replay to be right, so the
+    // task waits; a log alone loses the event
+    if (!trace) {
+      path_unref(record.path);
+      path_unref(record.path2);
+      atomic_fetch_add(&dropped, 1);
+      return;
+    }
+    wait_for_space();
+  }
+  wake_logger();
+}
+
+long event_log_close(void) {
+  if (!running) {
+    return 0;
+  }
+  pthread_mutex_lock(&wake_lock);
+  atomic_store(&stopping, 1);
+  pthread_cond_signal(&wake);
+  pthread_mutex_unlock(&wake_lock);
+  pthread_join(logger, NULL);
+  running = 0;
+
+  if (log_file) {
+    fclose(log_file);
+    log_file = NULL;
+  }
+  long recorded = 0;
+  if (trace) {
+    recorded = trace_writer_close(trace);
+    trace = NULL;
+  }
+  unsigned long lost = atomic_load(&dropped);
+  if (lost) {
+    fprintf(stderr, "Event log dropped %lu events\n", lost);
+  }
+  return recorded;
+}
+
+int event_log_wants_allowed(void) {
+  return log_file || trace;
+}
+
+void event_log_count_allowed(void) {
+  atomic_fetch_add_explicit(&allowed_count, 1, memory_order_relaxed);
+}
+
+void event_log_quiet(void) {
+  quiet = 1;
+}
+
+void event_log_totals(event_log_totals_t *totals) {
+  totals->allowed = atomic_load(&allowed_count);
+  totals->denied = atomic_load(&denied_count);
+}
+
+static int by_count(const void *a, const void *b) {
+  const event_log_denial_t *x = a, *y = b;
+  if (x->count != y->count) {
+    return x->count < y->count ? 1 : -1;
+  }
+  int order = strcmp(x->path, y->path);
+  return order ? order : (int)x->op - (int)y->op;
+}
+
+int event_log_top_denied(event_log_denial_t *top, int max) {
+  pthread_mutex_lock(&denials_lock);
+  event_log_denial_t *sorted = malloc((num_denials + 1) * sizeof(event_log_denial_t));
+  if (!sorted) {
+    pthread_mutex_unlock(&denials_lock);
+    return 0;
+  }
+  size_t count = 0;
+  for (size_t i = 0; i < denials_cap; i++) {
+    if (denials[i].path) {
+      sorted[count++] = denials[i];
+    }
+  }
+  pthread_mutex_unlock(&denials_lock);
+  qsort(sorted, count, sizeof(event_log_denial_t), by_count);
+  int n = (int)count < max ? (int)count : max;
+  memcpy(top, sorted, (size_t)n * sizeof(event_log_denial_t));
+  free(sorted);
+  return n;
+}
@@ -0,0 +1,95 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <stdint.h>
+#include "monitor.h"
+#include "path_store.h"
+
+// Decided events are queued as fixed-size records in a lock-free ring and
+// rendered by a logger thread, so formatting and terminal I/O stay off the
+// path between stopping a tracee and resuming it.
+
+// Who decided an event
+typedef enum {
+  EVENT_SOURCE_POLICY,
+  EVENT_SOURCE_REMEMBERED,
+  EVENT_SOURCE_USER,
+  EVENT_SOURCE_DAEMON,
+  EVENT_SOURCE_DEFAULT
+} event_source_t;
+
+typedef enum {
+  EVENT_LOG_TEXT,
+  EVENT_LOG_JSON,
+  EVENT_LOG_BINARY
+} event_log_format_t;
+
+// One decided event (40 bytes). In the ring `path` and `path2` are interned
+// path ids holding one reference each; in a binary log they are the lengths
+// of the path bytes that follow the record (first `path`, then `path2`).
+typedef struct {
+  uint64_t time_ns;      // CLOCK_REALTIME
+  int32_t pid;
+  int32_t syscall_nr;
+  int32_t fd;            // fd operand, or the dirfd of a path operand; -1 if neither
+  int32_t fd2;           // Same for the second operand of rename, link, sendfile, ...
+  int32_t flags;         // flags of the open family
+  uint32_t path;
+  uint32_t path2;        // PATH_ID_NONE (length 0) without a second operand
+  uint8_t op;            // policy_op_t
+  uint8_t op2;
+  uint8_t allowed;
+  uint8_t source;        // event_source_t
+} event_record_t;
+
+// A binary log starts with these 8 bytes, followed by records
+#define EVENT_LOG_MAGIC "SBXEVT2"
+
+// Start the logger thread. Denials by the policy or a remembered answer
+// are printed to stdout; if `filename` is given, every decided event is
+// also written there in `format`, and if `trace_filename` is, recorded
+// there as a trace for sandbox-replay (see trace_file.h). Returns 0 on
+// success, -1 on error.
+int event_log_start(const char *filename, event_log_format_t format, const char *trace_filename);
+
+// Queue a decided event. If the ring is full the event is counted as
+// dropped, unless a trace is being recorded: then the caller waits for
+// the logger to make room, so the trace misses nothing. Denials are
+// counted for event_log_top_denied() here, before the ring, so a dropped
+// one is still among them.
+void event_log_record(const monitor_event_t *event, int allowed, event_source_t source);
+
+// Whether allowed events are written anywhere (a log file or a trace).
+// When they are not, a caller that already knows an event is allowed may
+// skip it and only count it with event_log_count_allowed().
+int event_log_wants_allowed(void);
+void event_log_count_allowed(void);
+
+// Don't print denials as they happen (--batch); they are still counted
+// and logged. Call before event_log_start().
+void event_log_quiet(void);
+
+// Render everything still queued and stop the logger. Returns the number
+// of events recorded in the trace (0 without one).
+long event_log_close(void);
+
+// Decided events since the log was started
+typedef struct {
+  uint64_t allowed;
+  uint64_t denied;
+} event_log_totals_t;
+
+void event_log_totals(event_log_totals_t *totals);
+
+// A path and operation that were denied, and how often
+typedef struct {
+  const char *path;
+  policy_op_t op;
+  uint64_t count;
+} event_log_denial_t;
+
+// The (at most) `max` most often denied paths, most first. Only valid
+// after event_log_close(). Returns how many were filled in.
+int event_log_top_denied(event_log_denial_t *denials, int max);
+
+#endif /* EVENT_LOG_H */
@@ -0,0 +1,195 @@
+#include <stdlib.h>
+#include <string.h>
+#include <linux/close_range.h>
+#include "fd_table.h"
+
+// Upper bound on the fds we track; far above any sane RLIMIT_NOFILE
+#define FD_TABLE_MAX 1048576
+
+fd_table_t *fd_table_new(void) {
+  fd_table_t *table = calloc(1, sizeof(fd_table_t));
+  if (table) {
+    table->refcount = 1;
+  }
+  return table;
+}
+
+fd_table_t *fd_table_clone(const fd_table_t *table) {
+  fd_table_t *copy = fd_table_new();
+  if (!copy || !table) {
+    return copy;
+  }
+  copy->cwd = table->cwd;
+  path_ref(copy->cwd);
+  if (table->capacity == 0) {
+    return copy;
+  }
+
+  copy->entries = malloc(table->capacity * sizeof(fd_entry_t));
+  if (!copy->entries) {
+    return copy;
+  }
+  memcpy(copy->entries, table->entries, table->capacity * sizeof(fd_entry_t));
+  copy->capacity = table->capacity;
+
+  for (int fd = 0; fd < copy->capacity; fd++) {
+    path_ref(copy->entries[fd].path);
+  }
+  return copy;
+}
+
+void fd_table_ref(fd_table_t *table) {
+  if (table) {
+    table->refcount++;
+  }
+}
+
+void fd_table_release(fd_table_t *table) {
+  if (!table || --table->refcount > 0) {
+    return;
+  }
+  for (int fd = 0; fd < table->capacity; fd++) {
+    path_unref(table->entries[fd].path);
+  }
+  path_unref(table->cwd);
+  free(table->entries);
+  free(table);
+}
+
+// Make sure `fd` is a valid index
+static int fd_table_reserve(fd_table_t *table, int fd) {
+  if (fd < table->capacity) {
+    return 0;
+  }
+  if (fd >= FD_TABLE_MAX) {
+    return -1;
+  }
+
+  int new_cap = table->capacity ? table->capacity : 64;
+  while (new_cap <= fd) {
+    new_cap *= 2;
+  }
+
+  fd_entry_t *grown = realloc(table->entries, new_cap * sizeof(fd_entry_t));
+  if (!grown) {
+    return -1;
+  }
+  memset(grown + table->capacity, 0, (new_cap - table->capacity) * sizeof(fd_entry_t));
+  table->entries = grown;
+  table->capacity = new_cap;
+  return 0;
+}
+
+void fd_table_set(fd_table_t *table, int fd, path_id_t path, unsigned int flags) {
+  if (!table || fd < 0 || fd_table_reserve(table, fd) == -1) {
+    return;
+  }
+
+  // Take the new reference first in case it is the same path
+  path_ref(path);
+  path_unref(table->entries[fd].path);
+  table->entries[fd].path = path;
+  table->entries[fd].flags = flags;
+  table->entries[fd].generation = 0;
+}
+
+void fd_table_allow(fd_table_t *table, int fd, unsigned int op_flags, unsigned int generation) {
+  if (!table || fd < 0 || fd >= table->capacity || table->entries[fd].path == PATH_ID_NONE) {
+    return;
+  }
+  fd_entry_t *entry = &table->entries[fd];
+  // Verdicts from an older generation no longer count
+  if (entry->generation != generation) {
+    entry->flags &= ~FD_ENTRY_VERDICTS;
+    entry->generation = generation;
+  }
+  entry->flags |= op_flags & FD_ENTRY_VERDICTS;
+}
+
+path_id_t fd_table_get(const fd_table_t *table, int fd) {
+  if (!table || fd < 0 || fd >= table->capacity) {
+    return PATH_ID_NONE;
+  }
+  return table->entries[fd].path;
+}
+
+const char *fd_table_path(const fd_table_t *table, int fd) {
+  return path_lookup(fd_table_get(table, fd));
+}
+
+void fd_table_close(fd_table_t *table, int fd) {
+  if (!table || fd < 0 || fd >= table->capacity) {
+    return;
+  }
+  path_unref(table->entries[fd].path);
+  table->entries[fd].path = PATH_ID_NONE;
+  table->entries[fd].flags = 0;
+  table->entries[fd].generation = 0;
+}
+
+void fd_table_dup(fd_table_t *table, int oldfd, int newfd, unsigned int flags) {
+  if (!table || oldfd == newfd) {
+    return;
+  }
+
+  path_id_t path = fd_table_get(table, oldfd);
+  if (path == PATH_ID_NONE) {
+    // Duplicating an untracked fd still replaces whatever newfd was
+    fd_table_close(table, newfd);
+    return;
+  }
+  fd_entry_t old = table->entries[oldfd];
+  fd_table_set(table, newfd, path, flags);
+  fd_table_allow(table, newfd, old.flags, old.generation);
+}
+
+void fd_table_set_cloexec(fd_table_t *table, int fd, int cloexec) {
+  if (!table || fd < 0 || fd >= table->capacity) {
+    return;
+  }
+  if (cloexec) {
+    table->entries[fd].flags |= FD_ENTRY_CLOEXEC;
+  } else {
+    table->entries[fd].flags &= ~FD_ENTRY_CLOEXEC;
+  }
+}
+
+void fd_table_close_range(fd_table_t *table, unsigned int first, unsigned int last,
+                          unsigned int flags) {
+  if (!table || first >= (unsigned int)table->capacity) {
+    return;
+  }
+  if (last >= (unsigned int)table->capacity) {
+    last = table->capacity - 1;
+  }
+
+  for (unsigned int fd = first; fd <= last; fd++) {
+    if (flags & CLOSE_RANGE_CLOEXEC) {
+      fd_table_set_cloexec(table, (int)fd, 1);
+    } else {
+      fd_table_close(table, (int)fd);
+    }
+  }
+}
+
+void fd_table_exec(fd_table_t *table) {
+  if (!table) {
+    return;
+  }
+  for (int fd = 0; fd < table->capacity; fd++) {
+    if (table->entries[fd].flags & FD_ENTRY_CLOEXEC) {
+      fd_table_close(table, fd);
+    } else {
+      table->entries[fd].flags &= ~FD_ENTRY_VERDICTS;
+    }
+  }
+}
+
+void fd_table_set_cwd(fd_table_t *table, path_id_t path) {
+  if (!table) {
+    return;
+  }
+  path_ref(path);
+  path_unref(table->cwd);
+  table->cwd = path;
+}
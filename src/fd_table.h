@@ -0,0 +1,84 @@
+#ifndef FD_TABLE_H
+#define FD_TABLE_H
+
+#include "path_store.h"
+
+// Flags kept per tracked fd
+#define FD_ENTRY_CLOEXEC 0x1
+#define FD_ENTRY_READ_OK 0x2    // Reads through it are allowed (see `generation`)
+#define FD_ENTRY_WRITE_OK 0x4   // Writes likewise
+#define FD_ENTRY_VERDICTS (FD_ENTRY_READ_OK | FD_ENTRY_WRITE_OK)
+
+typedef struct {
+  path_id_t path;   // PATH_ID_NONE for untracked fds
+  unsigned int flags;
+  // verdict_cache_generation() the _OK flags were worked out under; they
+  // only hold while it is unchanged. Replacing the entry (close, dup2,
+  // exec) drops them.
+  unsigned int generation;
+} fd_entry_t;
+
+// A process's view of its open files, indexed directly by fd number,
+// and of its working directory, which relative paths are resolved against.
+// Tables are reference counted so tasks sharing a file table (threads,
+// CLONE_FILES) can point at the same one.
+typedef struct {
+  fd_entry_t *entries;
+  int capacity;
+  int refcount;
+  path_id_t cwd;    // PATH_ID_NONE until it is first needed, or after an untracked fchdir
+} fd_table_t;
+
+// Create an empty table with one reference
+fd_table_t *fd_table_new(void);
+
+// Copy a table for a forked child (new table, one reference)
+fd_table_t *fd_table_clone(const fd_table_t *table);
+
+// Take / drop a reference; the table is freed with its last reference
+void fd_table_ref(fd_table_t *table);
+void fd_table_release(fd_table_t *table);
+
+// Record that `fd` now refers to `path` (the table takes its own reference)
+void fd_table_set(fd_table_t *table, int fd, path_id_t path, unsigned int flags);
+
+// Path tracked for `fd`, or NULL if untracked. O(1).
+const char *fd_table_path(const fd_table_t *table, int fd);
+path_id_t fd_table_get(const fd_table_t *table, int fd);
+
+// Note that `op_flags` (FD_ENTRY_READ_OK / FD_ENTRY_WRITE_OK) are allowed
+// on `fd` for as long as the verdict cache stays at `generation`
+void fd_table_allow(fd_table_t *table, int fd, unsigned int op_flags, unsigned int generation);
+
+// Whether `op_flag` is known to be allowed on `fd` at `generation`. O(1).
+static inline int fd_table_allowed(const fd_table_t *table, int fd, unsigned int op_flag,
+                                   unsigned int generation) {
+  if (fd < 0 || fd >= table->capacity) {
+    return 0;
+  }
+  const fd_entry_t *entry = &table->entries[fd];
+  return (entry->flags & op_flag) && entry->generation == generation;
+}
+
+// close(fd)
+void fd_table_close(fd_table_t *table, int fd);
+
+// dup/dup2/dup3/F_DUPFD: make `newfd` refer to whatever `oldfd` does,
+// with the same known verdicts (it is the same open file)
+void fd_table_dup(fd_table_t *table, int oldfd, int newfd, unsigned int flags);
+
+// F_SETFD: update the close-on-exec flag
+void fd_table_set_cloexec(fd_table_t *table, int fd, int cloexec);
+
+// close_range(first, last, flags); CLOSE_RANGE_CLOEXEC only marks the fds
+void fd_table_close_range(fd_table_t *table, unsigned int first, unsigned int last,
+                          unsigned int flags);
+
+// chdir/fchdir: the working directory is now `path` (PATH_ID_NONE if unknown)
+void fd_table_set_cwd(fd_table_t *table, path_id_t path);
+
+// A successful exec closes every close-on-exec fd and forgets the known
+// verdicts of the rest
+void fd_table_exec(fd_table_t *table);
+
+#endif /* FD_TABLE_H */
@@ -0,0 +1,404 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "io_stats.h"
+#include "sandbox_common.h"
+#include "tracer_stats.h"
+
+// What an entry sums up
+typedef enum {
+  IO_FD,        // One fd of one task, for as long as it refers to one path
+  IO_PATH,      // Every fd of every task on one path
+  IO_PROCESS,   // Every tracked fd of one task
+  NUM_IO_KINDS
+} io_kind_t;
+
+static const char *kind_names[NUM_IO_KINDS] = { "fd", "path", "process" };
+
+typedef struct {
+  uint8_t used;
+  uint8_t kind;
+  uint8_t write;
+  pid_t pid;              // -1 for IO_PATH
+  int fd;                 // -1 unless IO_FD
+  path_id_t path;         // PATH_ID_NONE for IO_PROCESS; a reference is held
+  uint64_t calls;
+  uint64_t errors;
+  uint64_t bytes;
+  uint64_t min;           // Smallest successful transfer, UINT64_MAX before one
+  uint64_t max;
+  uint64_t last_ns;       // Time of the latest call, 0 before one
+  uint64_t gap_sum_ns;
+  uint64_t gaps;
+} io_entry_t;
+
+struct io_stats {
+  io_entry_t *entries;   // Open addressing, at most half full
+  size_t capacity;
+  size_t count;
+};
+
+#define IO_INITIAL_CAPACITY 256
+
+static uint64_t hash_key(int kind, int write, pid_t pid, int fd, path_id_t path) {
+  uint64_t h = ((uint64_t)(uint32_t)pid << 32) ^ ((uint64_t)(uint32_t)fd << 16) ^ path;
+  h ^= (uint64_t)(kind * 2 + write) << 56;
+  h *= 0x9e3779b97f4a7c15ULL;
+  return h ^ (h >> 29);
+}
+
+io_stats_t *io_stats_new(void) {
+  io_stats_t *stats = calloc(1, sizeof(io_stats_t));
+  if (!stats) {
+    return NULL;
+  }
+  stats->capacity = IO_INITIAL_CAPACITY;
+  stats->entries = calloc(stats->capacity, sizeof(io_entry_t));
+  if (!stats->entries) {
+    free(stats);
+    return NULL;
+  }
+  return stats;
+}
+
+static int grow(io_stats_t *stats) {
+  size_t capacity = stats->capacity * 2;
+  io_entry_t *entries = calloc(capacity, sizeof(io_entry_t));
+  if (!entries) {
+    return -1;
+  }
+  for (size_t i = 0; i < stats->capacity; i++) {
+    io_entry_t *entry = &stats->entries[i];
+    if (!entry->used) {
+      continue;
+    }
+    size_t slot = hash_key(entry->kind, entry->write, entry->pid, entry->fd, entry->path) & (capacity - 1);
+    while (entries[slot].used) {
+      slot = (slot + 1) & (capacity - 1);
+    }
+    entries[slot] = *entry;
+  }
+  free(stats->entries);
+  stats->entries = entries;
+  stats->capacity = capacity;
+  return 0;
+}
+
+// The entry for a key, created empty the first time. NULL if out of memory.
+static io_entry_t *find_entry(io_stats_t *stats, int kind, int write, pid_t pid, int fd, path_id_t path) {
+  if ((stats->count + 1) * 2 > stats->capacity && grow(stats) == -1) {
+    return NULL;
+  }
+  size_t mask = stats->capacity - 1;
+  size_t slot = hash_key(kind, write, pid, fd, path) & mask;
+  for (;; slot = (slot + 1) & mask) {
+    io_entry_t *entry = &stats->entries[slot];
+    if (!entry->used) {
+      break;
+    }
+    if (entry->kind == kind && entry->write == write && entry->pid == pid && entry->fd == fd &&
+        entry->path == path) {
+      return entry;
+    }
+  }
+
+  io_entry_t *entry = &stats->entries[slot];
+  memset(entry, 0, sizeof(*entry));
+  entry->used = 1;
+  entry->kind = (uint8_t)kind;
+  entry->write = (uint8_t)write;
+  entry->pid = pid;
+  entry->fd = fd;
+  entry->path = path;
+  entry->min = UINT64_MAX;
+  if (path != PATH_ID_NONE) {
+    // Ids are reused once a path is released, and the report needs the name
+    path_ref(path);
+  }
+  stats->count++;
+  return entry;
+}
+
+static void account(io_entry_t *entry, long ret, uint64_t now_ns) {
+  if (!entry) {
+    return;
+  }
+  entry->calls++;
+  if (ret < 0) {
+    entry->errors++;
+  } else {
+    entry->bytes += (uint64_t)ret;
+    if ((uint64_t)ret < entry->min) {
+      entry->min = (uint64_t)ret;
+    }
+    if ((uint64_t)ret > entry->max) {
+      entry->max = (uint64_t)ret;
+    }
+  }
+  if (entry->last_ns && now_ns > entry->last_ns) {
+    entry->gap_sum_ns += now_ns - entry->last_ns;
+    entry->gaps++;
+  }
+  entry->last_ns = now_ns;
+}
+
+void io_stats_add(io_stats_t *stats, pid_t pid, int fd, path_id_t path, int write, long ret,
+                  uint64_t now_ns) {
+  write = write ? 1 : 0;
+  account(find_entry(stats, IO_FD, write, pid, fd, path), ret, now_ns);
+  account(find_entry(stats, IO_PATH, write, -1, -1, path), ret, now_ns);
+  account(find_entry(stats, IO_PROCESS, write, pid, -1, PATH_ID_NONE), ret, now_ns);
+}
+
+void io_stats_free(io_stats_t *stats) {
+  if (!stats) {
+    return;
+  }
+  for (size_t i = 0; i < stats->capacity; i++) {
+    if (stats->entries[i].used && stats->entries[i].path != PATH_ID_NONE) {
+      path_unref(stats->entries[i].path);
+    }
+  }
+  free(stats->entries);
+  free(stats);
+}
+
+// All tables summed into one. A task only ever runs on one tracer thread,
+// so only the per-path entries really add up.
+static io_stats_t *merge(io_stats_t **tables, int count) {
+  io_stats_t *total = io_stats_new();
+  for (int t = 0; total && t < count; t++) {
+    if (!tables[t]) {
+      continue;
+    }
+    for (size_t i = 0; i < tables[t]->capacity; i++) {
+      const io_entry_t *from = &tables[t]->entries[i];
+      if (!from->used) {
+        continue;
+      }
+      io_entry_t *to = find_entry(total, from->kind, from->write, from->pid, from->fd, from->path);
+      if (!to) {
+        io_stats_free(total);
+        return NULL;
+      }
+      to->calls += from->calls;
+      to->errors += from->errors;
+      to->bytes += from->bytes;
+      to->min = from->min < to->min ? from->min : to->min;
+      to->max = from->max > to->max ? from->max : to->max;
+      to->gap_sum_ns += from->gap_sum_ns;
+      to->gaps += from->gaps;
+    }
+  }
+  return total;
+}
+
+static int by_calls(const void *a, const void *b) {
+  const io_entry_t *x = *(const io_entry_t *const *)a;
+  const io_entry_t *y = *(const io_entry_t *const *)b;
+  if (x->calls != y->calls) {
+    return x->calls < y->calls ? 1 : -1;
+  }
+  return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+// The entries of one kind, busiest first. Returns the count, -1 on error.
+static long collect(const io_stats_t *stats, int kind, io_entry_t ***sorted) {
+  *sorted = malloc((stats->count + 1) * sizeof(io_entry_t *));
+  if (!*sorted) {
+    return -1;
+  }
+  long count = 0;
+  for (size_t i = 0; i < stats->capacity; i++) {
+    if (stats->entries[i].used && stats->entries[i].kind == kind) {
+      (*sorted)[count++] = &stats->entries[i];
+    }
+  }
+  qsort(*sorted, (size_t)count, sizeof(io_entry_t *), by_calls);
+  return count;
+}
+
+static uint64_t transfers(const io_entry_t *entry) {
+  return entry->calls - entry->errors;
+}
+
+static uint64_t avg_size(const io_entry_t *entry) {
+  return transfers(entry) ? entry->bytes / transfers(entry) : 0;
+}
+
+static uint64_t avg_gap_ns(const io_entry_t *entry) {
+  return entry->gaps ? entry->gap_sum_ns / entry->gaps : 0;
+}
+
+// e.g. "512B", "4.0K", "12.5M"
+static void format_bytes(uint64_t bytes, char *buf, size_t size) {
+  static const char units[] = "KMGTP";
+  if (bytes < 1024) {
+    snprintf(buf, size, "%luB", (unsigned long)bytes);
+    return;
+  }
+  double value = (double)bytes / 1024;
+  int unit = 0;
+  while (value >= 1024 && units[unit + 1]) {
+    value /= 1024;
+    unit++;
+  }
+  snprintf(buf, size, "%.1f%c", value, units[unit]);
+}
+
+static void print_entry(const io_entry_t *entry, FILE *out) {
+  char bytes[16], min[16], avg[16], max[16], gap[16];
+  format_bytes(entry->bytes, bytes, sizeof(bytes));
+  format_bytes(transfers(entry) ? entry->min : 0, min, sizeof(min));
+  format_bytes(avg_size(entry), avg, sizeof(avg));
+  format_bytes(entry->max, max, sizeof(max));
+  if (entry->gaps) {
+    stats_format_ns(avg_gap_ns(entry), gap, sizeof(gap));
+  } else {
+    snprintf(gap, sizeof(gap), "-");
+  }
+  fprintf(out, "%10lu %7lu %9s %7s %7s %7s %9s  %-5s ", (unsigned long)entry->calls,
+          (unsigned long)entry->errors, bytes, min, avg, max, gap, entry->write ? "write" : "read");
+  const char *path = entry->path != PATH_ID_NONE ? path_lookup(entry->path) : NULL;
+  if (entry->kind == IO_FD) {
+    fprintf(out, "[%d] fd %d  %s\n", entry->pid, entry->fd, path ? path : "?");
+  } else if (entry->kind == IO_PATH) {
+    fprintf(out, "%s\n", path ? path : "?");
+  } else {
+    fprintf(out, "[%d]\n", entry->pid);
+  }
+}
+
+void io_stats_report(io_stats_t **tables, int count, int top, FILE *out) {
+  io_stats_t *total = merge(tables, count);
+  if (!total) {
+    perror("io stats");
+    return;
+  }
+  if (!total->count) {
+    fprintf(out, "%sI/O accounting: no reads or writes through tracked fds%s\n", INFO_COLOR, COLOR_RESET);
+  }
+  // Paths first: they are what a program's I/O pattern is about
+  static const int order[] = { IO_PATH, IO_FD, IO_PROCESS };
+  for (int k = 0; k < NUM_IO_KINDS && total->count; k++) {
+    io_entry_t **sorted;
+    long entries = collect(total, order[k], &sorted);
+    if (entries < 0) {
+      perror("io stats");
+      break;
+    }
+    fprintf(out, "%sI/O by %s (%ld, busiest first):%s\n", INFO_COLOR, kind_names[order[k]], entries,
+            COLOR_RESET);
+    fprintf(out, "%10s %7s %9s %7s %7s %7s %9s  %-5s %s\n", "calls", "errors", "bytes", "min", "avg",
+            "max", "avg gap", "op", kind_names[order[k]]);
+    for (long i = 0; i < entries && i < top; i++) {
+      print_entry(sorted[i], out);
+    }
+    if (entries > top) {
+      fprintf(out, "%10s (%ld more)\n", "...", entries - top);
+    }
+    free(sorted);
+  }
+  io_stats_free(total);
+}
+
+static void write_csv_string(FILE *out, const char *s) {
+  fputc('"', out);
+  for (; *s; s++) {
+    if (*s == '"') {
+      fputc('"', out);
+    }
+    fputc(*s, out);
+  }
+  fputc('"', out);
+}
+
+static void write_json_string(FILE *out, const char *s) {
+  fputc('"', out);
+  for (const unsigned char *p = (const unsigned char *)s; *p; p++) {
+    if (*p == '"' || *p == '\\') {
+      fprintf(out, "\\%c", *p);
+    } else if (*p < 0x20) {
+      fprintf(out, "\\u%04x", *p);
+    } else {
+      fputc(*p, out);
+    }
+  }
+  fputc('"', out);
+}
+
+static void dump_entry(const io_entry_t *entry, int json, int first, FILE *out) {
+  const char *path = entry->path != PATH_ID_NONE ? path_lookup(entry->path) : NULL;
+  const char *op = entry->write ? "write" : "read";
+  uint64_t min = transfers(entry) ? entry->min : 0;
+  double gap_us = avg_gap_ns(entry) / 1e3;
+  if (!json) {
+    fprintf(out, "%s,%s,", kind_names[entry->kind], op);
+    if (entry->pid != -1) {
+      fprintf(out, "%d", entry->pid);
+    }
+    fputc(',', out);
+    if (entry->fd != -1) {
+      fprintf(out, "%d", entry->fd);
+    }
+    fputc(',', out);
+    if (path) {
+      write_csv_string(out, path);
+    }
+    fprintf(out, ",%lu,%lu,%lu,%lu,%lu,%lu,%.3f\n", (unsigned long)entry->calls,
+            (unsigned long)entry->errors, (unsigned long)entry->bytes, (unsigned long)min,
+            (unsigned long)avg_size(entry), (unsigned long)entry->max, gap_us);
+    return;
+  }
+  fprintf(out, "%s\n  {\"kind\":\"%s\",\"op\":\"%s\"", first ? "" : ",", kind_names[entry->kind], op);
+  if (entry->pid != -1) {
+    fprintf(out, ",\"pid\":%d", entry->pid);
+  }
+  if (entry->fd != -1) {
+    fprintf(out, ",\"fd\":%d", entry->fd);
+  }
+  if (path) {
+    fprintf(out, ",\"path\":");
+    write_json_string(out, path);
+  }
+  fprintf(out, ",\"calls\":%lu,\"errors\":%lu,\"bytes\":%lu,\"min\":%lu,\"avg\":%lu,\"max\":%lu,"
+          "\"avg_gap_us\":%.3f}", (unsigned long)entry->calls, (unsigned long)entry->errors,
+          (unsigned long)entry->bytes, (unsigned long)min, (unsigned long)avg_size(entry),
+          (unsigned long)entry->max, gap_us);
+}
+
+int io_stats_dump(io_stats_t **tables, int count, const char *filename) {
+  size_t len = strlen(filename);
+  int json = len >= 5 && strcmp(filename + len - 5, ".json") == 0;
+  FILE *out = fopen(filename, "we");
+  if (!out) {
+    fprintf(stderr, "Cannot write I/O stats to %s: %s\n", filename, strerror(errno));
+    return -1;
+  }
+  io_stats_t *total = merge(tables, count);
+  if (!total) {
+    perror("io stats");
+    fclose(out);
+    return -1;
+  }
+
+  fprintf(out, json ? "[" : "kind,op,pid,fd,path,calls,errors,bytes,min,avg,max,avg_gap_us\n");
+  int first = 1;
+  for (int kind = 0; kind < NUM_IO_KINDS; kind++) {
+    io_entry_t **sorted;
+    long entries = collect(total, kind, &sorted);
+    for (long i = 0; i < entries; i++, first = 0) {
+      dump_entry(sorted[i], json, first, out);
+    }
+    free(sorted);
+  }
+  if (json) {
+    fprintf(out, "\n]\n");
+  }
+  io_stats_free(total);
+  if (fclose(out) != 0) {
+    fprintf(stderr, "Cannot write I/O stats to %s: %s\n", filename, strerror(errno));
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef IO_STATS_H
+#define IO_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include "path_store.h"
+
+// I/O accounting for --io: calls, bytes, request sizes and the time
+// between calls of every read and write through a tracked fd, summed per
+// fd, per path and per process. Each tracer thread fills its own table
+// from the exit stops it already takes; the tables are merged for the
+// report once tracing is over, so the time between calls on a path is
+// only measured between calls seen by the same tracer thread.
+
+typedef struct io_stats io_stats_t;
+
+// An empty table, or NULL if out of memory
+io_stats_t *io_stats_new(void);
+
+// Account one read (`write` = 0) or write by task `pid` through `fd`,
+// which refers to `path`, that returned `ret` at monotonic time `now_ns`
+void io_stats_add(io_stats_t *stats, pid_t pid, int fd, path_id_t path, int write, long ret,
+                  uint64_t now_ns);
+
+// Print the busiest fds, paths and processes of all `count` tables to
+// `out`, `top` of each, sorted by calls
+void io_stats_report(io_stats_t **tables, int count, int top, FILE *out);
+
+// Write every entry of all `count` tables to `filename`: JSON if it ends
+// in ".json", CSV otherwise. Returns 0, or -1 after printing why.
+int io_stats_dump(io_stats_t **tables, int count, const char *filename);
+
+// Drop a table and the path references it holds
+void io_stats_free(io_stats_t *stats);
+
+#endif /* IO_STATS_H */
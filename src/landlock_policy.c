@@ -0,0 +1,283 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/landlock.h>
+#include "landlock_policy.h"
+#include "sandbox_common.h"
+
+// Rights newer than the installed headers
+#ifndef LANDLOCK_ACCESS_FS_REFER
+  #define LANDLOCK_ACCESS_FS_REFER (1ULL << 13)
+#endif
+#ifndef LANDLOCK_ACCESS_FS_TRUNCATE
+  #define LANDLOCK_ACCESS_FS_TRUNCATE (1ULL << 14)
+#endif
+
+#define MAKE_RIGHTS (LANDLOCK_ACCESS_FS_MAKE_CHAR | LANDLOCK_ACCESS_FS_MAKE_DIR | \
+                     LANDLOCK_ACCESS_FS_MAKE_REG | LANDLOCK_ACCESS_FS_MAKE_SOCK | \
+                     LANDLOCK_ACCESS_FS_MAKE_FIFO | LANDLOCK_ACCESS_FS_MAKE_BLOCK | \
+                     LANDLOCK_ACCESS_FS_MAKE_SYM)
+
+// The only rights a rule on a single file may carry
+#define FILE_RIGHTS (LANDLOCK_ACCESS_FS_EXECUTE | LANDLOCK_ACCESS_FS_WRITE_FILE | \
+                     LANDLOCK_ACCESS_FS_READ_FILE | LANDLOCK_ACCESS_FS_TRUNCATE)
+
+static long landlock_abi(void) {
+  long abi = syscall(SYS_landlock_create_ruleset, NULL, 0, LANDLOCK_CREATE_RULESET_VERSION);
+  return abi < 0 ? 0 : abi;
+}
+
+// Landlock rights standing for one policy operation
+static uint64_t op_rights(policy_op_t op, int abi) {
+  switch (op) {
+    case POLICY_OP_READ:
+      return LANDLOCK_ACCESS_FS_READ_FILE | LANDLOCK_ACCESS_FS_READ_DIR;
+    case POLICY_OP_WRITE:
+      return LANDLOCK_ACCESS_FS_WRITE_FILE | MAKE_RIGHTS | (abi >= 3 ? LANDLOCK_ACCESS_FS_TRUNCATE : 0);
+    case POLICY_OP_DELETE:
+      return LANDLOCK_ACCESS_FS_REMOVE_FILE | LANDLOCK_ACCESS_FS_REMOVE_DIR;
+    default:
+      return 0;
+  }
+}
+
+// Split a pattern into the literal path Landlock can take: "dir/**" gives
+// a directory tree, a pattern without wildcards one file. Returns 1 for a
+// tree, 0 for a file, -1 if the pattern is not literal.
+static int literal_path(const char *pattern, char *out, size_t size) {
+  size_t len = strlen(pattern);
+  int tree = len >= 2 && strcmp(pattern + len - 2, "**") == 0 &&
+             (len == 2 || pattern[len - 3] == '/');
+  if (tree) {
+    len -= len == 2 ? 2 : 3;
+  }
+  if (pattern[0] != '/' && !(tree && len == 0)) {
+    return -1;
+  }
+  if (memchr(pattern, '*', len) || memchr(pattern, '?', len) || len + 2 > size) {
+    return -1;
+  }
+  memcpy(out, pattern, len);
+  out[len] = '\0';
+  if (len == 0) {
+    snprintf(out, size, "/");
+  }
+  return tree;
+}
+
+// Characters of a pattern before its first wildcard
+static size_t fixed_prefix(const char *pattern) {
+  return strcspn(pattern, "*?");
+}
+
+// Whether a deny rule could cover something a later allow rule grants:
+// Landlock would grant it anyway, since it has no exceptions
+static int shadows_allow(const char *deny, const char *allow) {
+  size_t d = fixed_prefix(deny);
+  size_t a = fixed_prefix(allow);
+  size_t n = d < a ? d : a;
+  return strncmp(deny, allow, n) == 0;
+}
+
+// Why one allow rule cannot go to Landlock, or NULL if it can
+static const char *rule_problem(const policy_rule_t *rule) {
+  char path[MAX_PATH];
+  int tree = literal_path(rule->pattern, path, sizeof(path));
+  if (tree == -1) {
+    return "wildcards";
+  }
+  struct stat st;
+  if (stat(path, &st) == -1) {
+    return "path does not exist yet";
+  }
+  if (tree && !S_ISDIR(st.st_mode)) {
+    return "not a directory";
+  }
+  if (!tree && S_ISDIR(st.st_mode)) {
+    return "names a directory (use 'dir/' for its contents)";
+  }
+  return NULL;
+}
+
+int landlock_plan(const path_policy_t *policy, landlock_plan_t *plan, FILE *report) {
+  char reasons[POLICY_OP_COUNT][160];
+  int count = policy_rule_count(policy);
+
+  plan->abi = (int)landlock_abi();
+  plan->kernel_ops = 0;
+  plan->traced_ops = 0;
+
+  for (int op = 0; op < POLICY_OP_COUNT; op++) {
+    policy_action_t fallback = policy_default_action(policy, (policy_op_t)op);
+    int has_deny = 0, traced = 0;
+    reasons[op][0] = '\0';
+
+    for (int i = 0; i < count && !traced; i++) {
+      const policy_rule_t *rule = policy_rule(policy, i);
+      if (!(rule->ops & (1u << op))) {
+        continue;
+      }
+      if (rule->action == POLICY_ASK) {
+        snprintf(reasons[op], sizeof(reasons[op]), "line %d asks", rule->line);
+        traced = 1;
+      } else if (rule->action == POLICY_DENY) {
+        has_deny = 1;
+        for (int j = i + 1; j < count && fallback == POLICY_DENY; j++) {
+          const policy_rule_t *later = policy_rule(policy, j);
+          if (later->action == POLICY_ALLOW && (later->ops & (1u << op)) &&
+              shadows_allow(rule->pattern, later->pattern)) {
+            snprintf(reasons[op], sizeof(reasons[op]), "line %d denies inside line %d's allow",
+                     rule->line, later->line);
+            traced = 1;
+            break;
+          }
+        }
+      } else if (fallback == POLICY_DENY) {
+        const char *problem = rule_problem(rule);
+        if (problem) {
+          snprintf(reasons[op], sizeof(reasons[op]), "line %d: %s", rule->line, problem);
+          traced = 1;
+        }
+      }
+    }
+
+    if (!traced && fallback == POLICY_ASK) {
+      snprintf(reasons[op], sizeof(reasons[op]), "default ask");
+      traced = 1;
+    } else if (!traced && fallback == POLICY_ALLOW && has_deny) {
+      snprintf(reasons[op], sizeof(reasons[op]), "denies on top of default allow");
+      traced = 1;
+    } else if (!traced && fallback == POLICY_DENY && (op == POLICY_OP_OPEN || !plan->abi)) {
+      snprintf(reasons[op], sizeof(reasons[op]), op == POLICY_OP_OPEN ? "no Landlock right for open"
+                                                                      : "Landlock unavailable");
+      traced = 1;
+    }
+
+    if (traced) {
+      plan->traced_ops |= 1u << op;
+    } else if (fallback == POLICY_DENY) {
+      plan->kernel_ops |= 1u << op;
+    }
+  }
+
+  if (!report) {
+    return 0;
+  }
+  if (plan->abi) {
+    fprintf(report, "Landlock ABI %d enforces:", plan->abi);
+  } else {
+    fprintf(report, "Landlock is not available; enforced in the kernel:");
+  }
+  int any = 0;
+  for (int op = 0; op < POLICY_OP_COUNT; op++) {
+    if (plan->kernel_ops & (1u << op)) {
+      fprintf(report, "%s %s", any++ ? "," : "", policy_op_name((policy_op_t)op));
+    }
+  }
+  fprintf(report, "%s\nTraced:", any ? "" : " nothing");
+  any = 0;
+  for (int op = 0; op < POLICY_OP_COUNT; op++) {
+    if (plan->traced_ops & (1u << op)) {
+      fprintf(report, "%s %s (%s)", any++ ? "," : "", policy_op_name((policy_op_t)op), reasons[op]);
+    }
+  }
+  fprintf(report, "%s\n", any ? "" : " nothing");
+
+  for (int i = 0; i < count; i++) {
+    const policy_rule_t *rule = policy_rule(policy, i);
+    unsigned int kernel = rule->ops & plan->kernel_ops;
+    unsigned int traced = rule->ops & plan->traced_ops;
+    fprintf(report, "  line %d: %s", rule->line, policy_action_name(rule->action));
+    for (int op = 0, first = 1; op < POLICY_OP_COUNT; op++) {
+      if (rule->ops & (1u << op)) {
+        fprintf(report, "%s%s", first ? " " : ",", policy_op_name((policy_op_t)op));
+        first = 0;
+      }
+    }
+    fprintf(report, " %s -> %s\n", rule->pattern, kernel && traced ? "Landlock and tracer" : kernel ? "Landlock"
+                           : traced ? "tracer" : "default already applies");
+  }
+  return 0;
+}
+
+int landlock_apply(const path_policy_t *policy, const landlock_plan_t *plan) {
+  if (!plan->kernel_ops) {
+    return 0;
+  }
+
+  struct landlock_ruleset_attr attr = { 0 };
+  for (int op = 0; op < POLICY_OP_COUNT; op++) {
+    if (plan->kernel_ops & (1u << op)) {
+      attr.handled_access_fs |= op_rights((policy_op_t)op, plan->abi);
+    }
+  }
+  // Moving files between directories needs REFER on both sides; the
+  // MAKE/REMOVE rights still decide whether the move is allowed
+  int refer = plan->abi >= 2 && (plan->kernel_ops & ((1u << POLICY_OP_WRITE) | (1u << POLICY_OP_DELETE)));
+  if (refer) {
+    attr.handled_access_fs |= LANDLOCK_ACCESS_FS_REFER;
+  }
+
+  int ruleset = (int)syscall(SYS_landlock_create_ruleset, &attr, sizeof(attr), 0);
+  if (ruleset == -1) {
+    return -1;
+  }
+
+  int count = policy_rule_count(policy);
+  for (int i = 0; i < count; i++) {
+    const policy_rule_t *rule = policy_rule(policy, i);
+    if (rule->action != POLICY_ALLOW || !(rule->ops & plan->kernel_ops)) {
+      continue;
+    }
+    uint64_t rights = 0;
+    for (int op = 0; op < POLICY_OP_COUNT; op++) {
+      if (rule->ops & plan->kernel_ops & (1u << op)) {
+        rights |= op_rights((policy_op_t)op, plan->abi);
+      }
+    }
+
+    char path[MAX_PATH];
+    int tree = literal_path(rule->pattern, path, sizeof(path));
+    if (!tree) {
+      rights &= FILE_RIGHTS;
+    }
+    struct landlock_path_beneath_attr beneath = { rights, -1 };
+    beneath.parent_fd = open(path, O_PATH | O_CLOEXEC);
+    if (beneath.parent_fd == -1 ||
+        (rights && syscall(SYS_landlock_add_rule, ruleset, LANDLOCK_RULE_PATH_BENEATH, &beneath, 0) == -1)) {
+      int saved = errno;
+      if (beneath.parent_fd != -1) {
+        close(beneath.parent_fd);
+      }
+      close(ruleset);
+      errno = saved;
+      return -1;
+    }
+    close(beneath.parent_fd);
+  }
+
+  if (refer) {
+    struct landlock_path_beneath_attr everywhere = { LANDLOCK_ACCESS_FS_REFER, open("/", O_PATH | O_CLOEXEC) };
+    if (everywhere.parent_fd != -1) {
+      syscall(SYS_landlock_add_rule, ruleset, LANDLOCK_RULE_PATH_BENEATH, &everywhere, 0);
+      close(everywhere.parent_fd);
+    }
+  }
+
+  if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == -1 ||
+      syscall(SYS_landlock_restrict_self, ruleset, 0) == -1) {
+    int saved = errno;
+    close(ruleset);
+    errno = saved;
+    return -1;
+  }
+  close(ruleset);
+  return 0;
+}
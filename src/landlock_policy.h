@@ -0,0 +1,32 @@
+#ifndef LANDLOCK_POLICY_H
+#define LANDLOCK_POLICY_H
+
+#include <stdio.h>
+#include "path_policy.h"
+
+// Enforcing the static part of a path policy with Landlock, so the kernel
+// checks it and the tracer never stops for it. Landlock can only grant
+// access beneath given files and directories on top of "deny everything
+// else", so an operation moves to the kernel when its default is deny,
+// every allow rule for it names a literal path or "dir/" prefix that
+// exists, and no deny rule carves an exception out of a later allow.
+// Operations that ask, or need a rule Landlock cannot express, stay with
+// the tracer. "open" has no Landlock right of its own and is always traced
+// unless the policy leaves it at a plain default allow.
+
+typedef struct {
+  int abi;                  // Landlock ABI of the running kernel, 0 if unavailable
+  unsigned int kernel_ops;  // Bitmask of (1 << policy_op_t) Landlock enforces
+  unsigned int traced_ops;  // Operations the tracer still has to check
+} landlock_plan_t;
+
+// Decide which operations of `policy` Landlock can enforce and print which
+// rules went where to `report`. Returns 0, or -1 on error.
+int landlock_plan(const path_policy_t *policy, landlock_plan_t *plan, FILE *report);
+
+// In the child, before exec: restrict the calling process to the plan's
+// kernel operations. Sets no_new_privs. Returns 0 on success (or when the
+// plan has nothing for the kernel), -1 on error with errno set.
+int landlock_apply(const path_policy_t *policy, const landlock_plan_t *plan);
+
+#endif /* LANDLOCK_POLICY_H */
@@ -0,0 +1,378 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "decision_broker.h"
+#include "event_log.h"
+#include "monitor.h"
+#include "path_resolve.h"
+#include "sandbox_common.h"
+#include "verdict_cache.h"
+
+#define NO_OPERAND { -1, -1, -1, 0 }
+#define PATH(arg, op) { (arg), -1, -1, (op) }
+#define PATH_AT(dirfd, arg, op) { (arg), (dirfd), -1, (op) }
+#define FD(arg, op) { -1, -1, (arg), (op) }
+
+#define OPEN_FLAGS (SYSCALL_MONITORED | SYSCALL_NEW_FD | SYSCALL_EXIT_STOP)
+
+// Every syscall that reads, writes, creates or removes files by path or
+// through an fd, plus the ones the fd table follows. Names are filled in
+// by the DESC() wrapper.
+#define DESC(nr, ...) [__NR_##nr] = { #nr, __VA_ARGS__ }
+
+const syscall_desc_t syscall_table[SYSCALL_TABLE_SIZE] = {
+  DESC(read, "read from file", NULL, SYSCALL_MONITORED, -1, { FD(0, POLICY_OP_READ), NO_OPERAND }),
+  DESC(pread64, "read from file", NULL, SYSCALL_MONITORED, -1, { FD(0, POLICY_OP_READ), NO_OPERAND }),
+  DESC(readv, "read from file", NULL, SYSCALL_MONITORED, -1, { FD(0, POLICY_OP_READ), NO_OPERAND }),
+  DESC(preadv, "read from file", NULL, SYSCALL_MONITORED, -1, { FD(0, POLICY_OP_READ), NO_OPERAND }),
+  DESC(preadv2, "read from file", NULL, SYSCALL_MONITORED, -1, { FD(0, POLICY_OP_READ), NO_OPERAND }),
+  DESC(write, "write to file", NULL, SYSCALL_MONITORED, -1, { FD(0, POLICY_OP_WRITE), NO_OPERAND }),
+  DESC(pwrite64, "write to file", NULL, SYSCALL_MONITORED, -1, { FD(0, POLICY_OP_WRITE), NO_OPERAND }),
+  DESC(writev, "write to file", NULL, SYSCALL_MONITORED, -1, { FD(0, POLICY_OP_WRITE), NO_OPERAND }),
+  DESC(pwritev, "write to file", NULL, SYSCALL_MONITORED, -1, { FD(0, POLICY_OP_WRITE), NO_OPERAND }),
+  DESC(pwritev2, "write to file", NULL, SYSCALL_MONITORED, -1, { FD(0, POLICY_OP_WRITE), NO_OPERAND }),
+  DESC(ftruncate, "truncate file", NULL, SYSCALL_MONITORED, -1, { FD(0, POLICY_OP_WRITE), NO_OPERAND }),
+  DESC(fallocate, "allocate space in file", NULL, SYSCALL_MONITORED, -1,
+       { FD(0, POLICY_OP_WRITE), NO_OPERAND }),
+  DESC(sendfile, "write to file", " from ", SYSCALL_MONITORED, -1,
+       { FD(0, POLICY_OP_WRITE), FD(1, POLICY_OP_READ) }),
+  DESC(copy_file_range, "write to file", " from ", SYSCALL_MONITORED, -1,
+       { FD(2, POLICY_OP_WRITE), FD(0, POLICY_OP_READ) }),
+  DESC(splice, "write to file", " from ", SYSCALL_MONITORED, -1,
+       { FD(2, POLICY_OP_WRITE), FD(0, POLICY_OP_READ) }),
+
+  DESC(openat, "open file", NULL, OPEN_FLAGS, 2, { PATH_AT(0, 1, POLICY_OP_OPEN), NO_OPERAND }),
+  DESC(openat2, "open file", NULL, OPEN_FLAGS | SYSCALL_OPEN_HOW, 2,
+       { PATH_AT(0, 1, POLICY_OP_OPEN), NO_OPERAND }),
+  DESC(unlinkat, "delete file", NULL, SYSCALL_MONITORED, -1,
+       { PATH_AT(0, 1, POLICY_OP_DELETE), NO_OPERAND }),
+  DESC(truncate, "truncate file", NULL, SYSCALL_MONITORED, -1, { PATH(0, POLICY_OP_WRITE), NO_OPERAND }),
+  DESC(renameat, "rename file", " to ", SYSCALL_MONITORED, -1,
+       { PATH_AT(0, 1, POLICY_OP_DELETE), PATH_AT(2, 3, POLICY_OP_WRITE) }),
+  DESC(renameat2, "rename file", " to ", SYSCALL_MONITORED, -1,
+       { PATH_AT(0, 1, POLICY_OP_DELETE), PATH_AT(2, 3, POLICY_OP_WRITE) }),
+  DESC(linkat, "link file", " to ", SYSCALL_MONITORED, -1,
+       { PATH_AT(0, 1, POLICY_OP_READ), PATH_AT(2, 3, POLICY_OP_WRITE) }),
+  DESC(symlinkat, "create symlink", NULL, SYSCALL_MONITORED, -1,
+       { PATH_AT(1, 2, POLICY_OP_WRITE), NO_OPERAND }),
+#ifdef __NR_open
+  // Legacy calls that newer architectures only have in their *at form
+  DESC(open, "open file", NULL, OPEN_FLAGS, 1, { PATH(0, POLICY_OP_OPEN), NO_OPERAND }),
+  DESC(creat, "open file", NULL, OPEN_FLAGS, -1, { PATH(0, POLICY_OP_OPEN), NO_OPERAND }),
+  DESC(unlink, "delete file", NULL, SYSCALL_MONITORED, -1, { PATH(0, POLICY_OP_DELETE), NO_OPERAND }),
+  DESC(rmdir, "remove directory", NULL, SYSCALL_MONITORED, -1,
+       { PATH(0, POLICY_OP_DELETE), NO_OPERAND }),
+  DESC(rename, "rename file", " to ", SYSCALL_MONITORED, -1,
+       { PATH(0, POLICY_OP_DELETE), PATH(1, POLICY_OP_WRITE) }),
+  DESC(link, "link file", " to ", SYSCALL_MONITORED, -1,
+       { PATH(0, POLICY_OP_READ), PATH(1, POLICY_OP_WRITE) }),
+  DESC(symlink, "create symlink", NULL, SYSCALL_MONITORED, -1,
+       { PATH(1, POLICY_OP_WRITE), NO_OPERAND }),
+  DESC(dup2, NULL, NULL, SYSCALL_FD_TABLE | SYSCALL_EXIT_STOP, -1, { NO_OPERAND, NO_OPERAND }),
+#endif
+
+  // No decision, but they change which file an fd, or a relative path, refers to
+  DESC(close, NULL, NULL, SYSCALL_FD_TABLE, -1, { NO_OPERAND, NO_OPERAND }),
+  DESC(fcntl, NULL, NULL, SYSCALL_FD_TABLE, -1, { NO_OPERAND, NO_OPERAND }),
+  DESC(dup, NULL, NULL, SYSCALL_FD_TABLE | SYSCALL_EXIT_STOP, -1, { NO_OPERAND, NO_OPERAND }),
+  DESC(dup3, NULL, NULL, SYSCALL_FD_TABLE | SYSCALL_EXIT_STOP, -1, { NO_OPERAND, NO_OPERAND }),
+  DESC(close_range, NULL, NULL, SYSCALL_FD_TABLE | SYSCALL_EXIT_STOP, -1, { NO_OPERAND, NO_OPERAND }),
+  DESC(chdir, NULL, NULL, SYSCALL_FD_TABLE | SYSCALL_EXIT_STOP, -1, { NO_OPERAND, NO_OPERAND }),
+  DESC(fchdir, NULL, NULL, SYSCALL_FD_TABLE | SYSCALL_EXIT_STOP, -1, { NO_OPERAND, NO_OPERAND }),
+};
+
+const syscall_desc_t *syscall_desc(long syscall_nr) {
+  if (syscall_nr < 0 || syscall_nr >= SYSCALL_TABLE_SIZE || !syscall_table[syscall_nr].flags) {
+    return NULL;
+  }
+  return &syscall_table[syscall_nr];
+}
+
+int syscall_list(unsigned int flags, int *syscalls, int max) {
+  int count = 0;
+  for (int nr = 0; nr < SYSCALL_TABLE_SIZE && count < max; nr++) {
+    if (syscall_table[nr].flags & flags) {
+      syscalls[count++] = nr;
+    }
+  }
+  return count;
+}
+
+int is_monitored_syscall(long syscall_nr) {
+  const syscall_desc_t *desc = syscall_desc(syscall_nr);
+  return desc && (desc->flags & SYSCALL_MONITORED);
+}
+
+// Policy consulted for every monitored event
+static path_policy_t *active_policy = NULL;
+
+void monitor_set_policy(path_policy_t *policy) {
+  active_policy = policy;
+}
+
+void init_event(monitor_event_t *event, pid_t pid, long syscall_nr) {
+  memset(event, 0, sizeof(*event));
+  event->pid = pid;
+  event->syscall_nr = syscall_nr;
+  event->fd = -1;
+  event->dirfd = AT_FDCWD;
+  event->fd2 = -1;
+  event->dirfd2 = AT_FDCWD;
+
+  const syscall_desc_t *desc = syscall_desc(syscall_nr);
+  event->op = desc ? (policy_op_t)desc->operand[0].op : POLICY_OP_OPEN;
+  event->op2 = desc ? (policy_op_t)desc->operand[1].op : POLICY_OP_OPEN;
+  event->operation = policy_op_name(event->op);
+}
+
+void swap_operands(monitor_event_t *event) {
+  const char *path = event->path;
+  path_id_t path_id = event->path_id;
+  policy_op_t op = event->op;
+  int fd = event->fd;
+  int dirfd = event->dirfd;
+
+  event->path = event->path2;
+  event->path_id = event->path2_id;
+  event->op = event->op2;
+  event->fd = event->fd2;
+  event->dirfd = event->dirfd2;
+  event->path2 = path;
+  event->path2_id = path_id;
+  event->op2 = op;
+  event->fd2 = fd;
+  event->dirfd2 = dirfd;
+  event->operation = policy_op_name(event->op);
+  event->swapped = !event->swapped;
+}
+
+// Whether `desc` has a second operand
+static int has_second_operand(const syscall_desc_t *desc) {
+  return desc->operand[1].path >= 0 || desc->operand[1].fd >= 0;
+}
+
+void decode_event(monitor_event_t *event, const unsigned long *args, const operand_reader_t *reader,
+                  char paths[2][MAX_PATH]) {
+  const syscall_desc_t *desc = syscall_desc(event->syscall_nr);
+  if (!desc) {
+    return;
+  }
+
+  int count = has_second_operand(desc) ? 2 : 1;
+  for (int i = 0; i < count; i++) {
+    const operand_desc_t *operand = &desc->operand[i];
+    const char *path = NULL;
+    path_id_t id = PATH_ID_NONE;
+    int fd = -1;
+    int dirfd = AT_FDCWD;
+
+    if (operand->path >= 0) {
+      if (operand->dirfd >= 0) {
+        dirfd = (int)args[operand->dirfd];
+      }
+      char raw[MAX_PATH];
+      if (reader->read_path(reader->ctx, args[operand->path], raw, sizeof(raw)) < 0) {
+        // Too long, or not readable now: that is no reason to allow it
+        raw[0] = '\0';
+        event->unresolved = 1;
+      }
+      // The policy only ever sees absolute paths, so neither a relative
+      // one without a base nor one that cannot be resolved is allowed
+      char base_buf[MAX_PATH];
+      const char *base = raw[0] == '/' ? NULL
+                                       : reader->base_path(reader->ctx, dirfd, base_buf, sizeof(base_buf));
+      if (raw[0] != '/' && !base) {
+        event->unresolved = 1;
+      }
+      if (path_canonicalize(base, raw, paths[i], MAX_PATH) < 0) {
+        snprintf(paths[i], MAX_PATH, "%s", raw);
+        event->unresolved = 1;
+      }
+      path = paths[i];
+    } else if (operand->fd >= 0) {
+      fd = (int)args[operand->fd];
+      path = reader->fd_path(reader->ctx, fd, paths[i], MAX_PATH, &id);
+    }
+
+    if (i == 0) {
+      event->path = path;
+      event->path_id = id;
+      event->fd = fd;
+      event->dirfd = dirfd;
+    } else {
+      event->path2 = path;
+      event->path2_id = id;
+      event->fd2 = fd;
+      event->dirfd2 = dirfd;
+    }
+  }
+
+  if (desc->flags & SYSCALL_OPEN_HOW) {
+    // openat2 passes its flags as the first field of a struct open_how
+    uint64_t how_flags = 0;
+    if (reader->read_memory &&
+        reader->read_memory(reader->ctx, args[desc->open_flags], &how_flags, sizeof(how_flags)) ==
+            (ssize_t)sizeof(how_flags)) {
+      event->flags = (int)how_flags;
+    }
+  } else if (desc->open_flags >= 0) {
+    event->flags = (int)args[desc->open_flags];
+  } else if (desc->flags & SYSCALL_NEW_FD) {
+    event->flags = O_CREAT | O_WRONLY | O_TRUNC;   // creat()
+  }
+}
+
+// Format one operand as "<lead><path> (fd: N, ...)", or "<lead>descriptor: N"
+// for an fd the sandbox does not track
+static int describe_operand(const syscall_desc_t *desc, int index, const char *lead, const char *path,
+                            int fd, int dirfd, int flags, char *out, size_t size) {
+  const operand_desc_t *operand = &desc->operand[index];
+  if (operand->fd >= 0 && !path) {
+    return snprintf(out, size, "%sdescriptor: %d", lead, fd);
+  }
+
+  char extra[64] = "";
+  size_t used = 0;
+  if (operand->fd >= 0) {
+    used += (size_t)snprintf(extra + used, sizeof(extra) - used, "fd: %d", fd);
+  }
+  if (operand->dirfd >= 0) {
+    used += (size_t)snprintf(extra + used, sizeof(extra) - used, "%sdirfd: %d", used ? ", " : "", dirfd);
+  }
+  if (index == 0 && (desc->flags & SYSCALL_NEW_FD)) {
+    used += (size_t)snprintf(extra + used, sizeof(extra) - used, "%sflags: 0x%x", used ? ", " : "",
+                             flags);
+  }
+  if (used) {
+    return snprintf(out, size, "%s%s (%s)", lead, path ? path : "", extra);
+  }
+  return snprintf(out, size, "%s%s", lead, path ? path : "");
+}
+
+void describe_event(const monitor_event_t *event, char *details, size_t size) {
+  const syscall_desc_t *desc = syscall_desc(event->syscall_nr);
+  if (!desc || !desc->verb) {
+    snprintf(details, size, "syscall %ld", event->syscall_nr);
+    return;
+  }
+
+  monitor_event_t in_order = *event;
+  if (in_order.swapped) {
+    swap_operands(&in_order);
+  }
+
+  // "read from file: <path>" but "read from file descriptor: <fd>"
+  char lead[48];
+  snprintf(lead, sizeof(lead), "%s%s", desc->verb, desc->operand[0].fd >= 0 && !in_order.path ? " " : ": ");
+  int len = describe_operand(desc, 0, lead, in_order.path, in_order.fd, in_order.dirfd, in_order.flags,
+                             details, size);
+  if (has_second_operand(desc) && len >= 0 && (size_t)len < size) {
+    describe_operand(desc, 1, desc->joiner, in_order.path2, in_order.fd2, in_order.dirfd2, 0,
+                     details + len, size - (size_t)len);
+  }
+}
+
+// Settle one operand without asking: 1 allowed, 0 denied, -1 undecided.
+// Sets `*remembered` when an earlier answer decided it.
+static int settle_operand(const char *path, policy_op_t op, int *remembered) {
+  // Untracked file descriptors are not monitored
+  if (!path) {
+    return 1;
+  }
+  policy_action_t action = active_policy ? policy_evaluate(active_policy, path, op) : POLICY_ASK;
+  if (action == POLICY_ALLOW) {
+    return 1;
+  }
+  if (action == POLICY_DENY) {
+    return 0;
+  }
+
+  // An earlier "always" / "never" answer settles it without asking again
+  verdict_t verdict = verdict_cache_lookup(op, path);
+  if (verdict != VERDICT_NONE) {
+    *remembered = 1;
+    return verdict == VERDICT_ALLOW;
+  }
+  return -1;
+}
+
+int monitor_allows(const char *path, policy_op_t op) {
+  int remembered = 0;
+  return path && settle_operand(path, op, &remembered) == 1;
+}
+
+// Both operands of an event need asking about: the second is only asked
+// once the first is allowed
+typedef struct {
+  monitor_event_t second;
+  char path[MAX_PATH];
+  char path2[MAX_PATH];
+  decision_done_t done;
+  void *ctx;
+} chain_t;
+
+static void chain_done(void *arg, int allowed) {
+  chain_t *chain = arg;
+  if (!allowed || broker_submit(&chain->second, chain->done, chain->ctx) == -1) {
+    chain->done(chain->ctx, 0);
+  }
+  free(chain);
+}
+
+int decide_event(const monitor_event_t *event, decision_done_t done, void *ctx) {
+  if (event->unresolved) {
+    event_log_record(event, 0, EVENT_SOURCE_POLICY);
+    return 0;
+  }
+
+  int remembered = 0;
+  int first = settle_operand(event->path, event->op, &remembered);
+  int second = 1;
+  const syscall_desc_t *desc = syscall_desc(event->syscall_nr);
+  if (first != 0 && desc && has_second_operand(desc)) {
+    second = settle_operand(event->path2, event->op2, &remembered);
+  }
+
+  if (first == 0 || second == 0) {
+    event_log_record(event, 0, remembered ? EVENT_SOURCE_REMEMBERED : EVENT_SOURCE_POLICY);
+    return 0;
+  }
+  if (first == 1 && second == 1) {
+    // Nothing to log for syscalls on untracked fds
+    if (event->path || event->path2) {
+      event_log_record(event, 1, remembered ? EVENT_SOURCE_REMEMBERED : EVENT_SOURCE_POLICY);
+    }
+    return 1;
+  }
+
+  // Leave the open operands to the broker; if it cannot take them, fail closed
+  int queued;
+  if (first == 1) {
+    monitor_event_t swapped = *event;
+    swap_operands(&swapped);
+    queued = broker_submit(&swapped, done, ctx);
+  } else if (second == 1) {
+    queued = broker_submit(event, done, ctx);
+  } else {
+    chain_t *chain = malloc(sizeof(chain_t));
+    if (!chain) {
+      return 0;
+    }
+    chain->second = *event;
+    swap_operands(&chain->second);
+    snprintf(chain->path, sizeof(chain->path), "%s", event->path);
+    snprintf(chain->path2, sizeof(chain->path2), "%s", event->path2);
+    chain->second.path = chain->path2;
+    chain->second.path2 = chain->path;
+    chain->second.path_id = PATH_ID_NONE;
+    chain->second.path2_id = PATH_ID_NONE;
+    chain->done = done;
+    chain->ctx = ctx;
+    queued = broker_submit(event, chain_done, chain);
+    if (queued == -1) {
+      free(chain);
+    }
+  }
+  return queued == -1 ? 0 : DECISION_PENDING;
+}
@@ -0,0 +1,149 @@
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include "path_policy.h"
+#include "path_store.h"
+#include "sandbox_common.h"
+
+// Syscall numbers of the architecture being built for. open, unlink,
+// dup2 and the other legacy calls only exist on some (x86_64, not arm64).
+#define SYS_READ __NR_read
+#define SYS_WRITE __NR_write
+#define SYS_FTRUNCATE __NR_ftruncate
+#define SYS_FALLOCATE __NR_fallocate
+#define SYS_OPENAT __NR_openat
+#define SYS_UNLINKAT __NR_unlinkat
+#define SYS_CLOSE __NR_close
+#define SYS_DUP __NR_dup
+#define SYS_DUP3 __NR_dup3
+#define SYS_FCNTL __NR_fcntl
+#define SYS_CLOSE_RANGE __NR_close_range
+#define SYS_CHDIR __NR_chdir
+#define SYS_FCHDIR __NR_fchdir
+#define SYS_CLONE __NR_clone
+#define SYS_CLONE3 __NR_clone3
+#ifdef __NR_open
+#define SYS_OPEN __NR_open
+#define SYS_UNLINK __NR_unlink
+#define SYS_DUP2 __NR_dup2
+#endif
+
+// Syscall numbers below this can be described
+#define SYSCALL_TABLE_SIZE 512
+
+// SYSCALL_* flags of a syscall_desc_t
+#define SYSCALL_MONITORED 0x01  // Needs a decision
+#define SYSCALL_FD_TABLE  0x02  // Changes the fd table or cwd, needs no decision
+#define SYSCALL_EXIT_STOP 0x04  // Its result updates the fd table
+#define SYSCALL_NEW_FD    0x08  // Returns a new fd for the path of operand 0
+#define SYSCALL_OPEN_HOW  0x10  // `open_flags` points to a struct open_how
+
+// Where one operand of a syscall comes from: a path argument (relative to
+// a dirfd argument, or the cwd), or an fd argument whose file is checked.
+// Unused fields are -1.
+typedef struct {
+  int8_t path;
+  int8_t dirfd;
+  int8_t fd;
+  uint8_t op;             // policy_op_t
+} operand_desc_t;
+
+// How a syscall is decoded and described. Syscalls with two operands
+// (rename, link, sendfile, ...) are only allowed if both are.
+typedef struct {
+  const char *name;
+  const char *verb;       // Start of its description, e.g. "open file"
+  const char *joiner;     // Between the two operands, e.g. " to "
+  uint8_t flags;          // SYSCALL_* bits, 0 for syscalls the sandbox ignores
+  int8_t open_flags;      // Argument holding the open flags, or -1
+  operand_desc_t operand[2];
+} syscall_desc_t;
+
+extern const syscall_desc_t syscall_table[SYSCALL_TABLE_SIZE];
+
+// Descriptor of `syscall_nr`, or NULL if the sandbox ignores it
+const syscall_desc_t *syscall_desc(long syscall_nr);
+
+// Collect the numbers of the syscalls with any of `flags` into `syscalls`
+// (at most `max`), e.g. to build a seccomp filter. Returns the count.
+int syscall_list(unsigned int flags, int *syscalls, int max);
+
+// A decoded monitored syscall, filled in by whichever backend caught it.
+// The second operand is only set for syscalls that have one.
+typedef struct {
+  pid_t pid;
+  long syscall_nr;
+  const char *operation;  // "open", "read", "write" or "delete"
+  policy_op_t op;         // Same operation as a policy class
+  const char *path;       // Path argument, or the tracked path of `fd`; NULL if unknown
+  path_id_t path_id;      // `path` interned, if the backend has it (else PATH_ID_NONE)
+  int fd;                 // fd operand, -1 otherwise
+  int dirfd;              // dirfd `path` is relative to
+  int flags;              // open flags of the open family
+  policy_op_t op2;        // Second operand, as above
+  const char *path2;
+  path_id_t path2_id;
+  int fd2;
+  int dirfd2;
+  int swapped;            // The operands are exchanged so the second one gets asked about
+  int unresolved;         // A path operand could not be read or resolved; the event is denied
+} monitor_event_t;
+
+// Reads the operands of a syscall out of the task that made it
+typedef struct {
+  // Copy the string at `addr`; returns its length, or -1
+  ssize_t (*read_path)(void *ctx, unsigned long addr, char *buf, size_t size);
+  // The tracked file `fd` refers to, or NULL. May set `*id` to its interned path.
+  const char *(*fd_path)(void *ctx, int fd, char *buf, size_t size, path_id_t *id);
+  // Copy `size` bytes at `addr` (openat2's struct open_how), or NULL to skip
+  ssize_t (*read_memory)(void *ctx, unsigned long addr, void *buf, size_t size);
+  // Absolute path of the directory `dirfd` (or the cwd, for AT_FDCWD)
+  // refers to, or NULL if unknown. Only asked for relative paths.
+  const char *(*base_path)(void *ctx, int dirfd, char *buf, size_t size);
+  void *ctx;
+} operand_reader_t;
+
+// Check whether a syscall number is one the sandbox inspects
+int is_monitored_syscall(long syscall_nr);
+
+// Set the policy decide_event() consults (the sandbox keeps ownership)
+void monitor_set_policy(path_policy_t *policy);
+
+// Fill in `operation` for a monitored syscall number
+void init_event(monitor_event_t *event, pid_t pid, long syscall_nr);
+
+// Exchange the two operands of an event, so the second is the one the
+// decision broker asks about. `swapped` records it for describe_event().
+void swap_operands(monitor_event_t *event);
+
+// Fill in the operands of an event from its syscall's arguments. Path
+// arguments are resolved to absolute canonical paths in `paths`.
+void decode_event(monitor_event_t *event, const unsigned long *args, const operand_reader_t *reader,
+                  char paths[2][MAX_PATH]);
+
+// Format the human-readable description of an event
+void describe_event(const monitor_event_t *event, char *details, size_t size);
+
+// Whether `op` on `path` is allowed without asking anyone: by the policy,
+// or by a remembered answer
+int monitor_allows(const char *path, policy_op_t op);
+
+// Receives the answer to an event that had to be asked about
+typedef void (*decision_done_t)(void *ctx, int allowed);
+
+// Returned by decide_event() when the answer will come through `done`
+#define DECISION_PENDING -1
+
+// Decide whether a monitored event may proceed without blocking: the
+// policy allows or denies it outright, or an earlier "always" / "never"
+// answer applies (to both operands, if it has two). Returns 1 if allowed,
+// 0 if denied. Otherwise the operands left open are queued for the
+// decision broker, which calls `done(ctx, allowed)` from its own thread,
+// and DECISION_PENDING is returned.
+int decide_event(const monitor_event_t *event, decision_done_t done, void *ctx);
+
+#endif /* MONITOR_H */
@@ -0,0 +1,431 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <linux/audit.h>
+#include <linux/seccomp.h>
+#include "monitor.h"
+#include "notify_backend.h"
+#include "path_resolve.h"
+#include "sandbox_common.h"
+#include "seccomp_filter.h"
+#include "tracee_memory.h"
+
+// Paths the sandboxed program has been allowed to open. Without ptrace we
+// never see the fd an open returns, so read/write are only monitored when
+// /proc/<pid>/fd/<fd> resolves to one of these, which mirrors the ptrace
+// loop's "tracked fd" rule.
+typedef struct {
+  char **slots;
+  size_t capacity;
+  size_t count;
+} path_set_t;
+
+static path_set_t opened_paths = {0};
+
+// The broker thread adds paths while the main loop looks them up
+static pthread_mutex_t opened_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Size of a notification response, as reported by the kernel
+static size_t resp_size = 0;
+
+// Set once the listener is closed; answers arriving after that are dropped
+// rather than sent to whatever file reuses its fd number. The kernel has
+// already failed the syscalls they were for.
+static pthread_mutex_t listener_lock = PTHREAD_MUTEX_INITIALIZER;
+static int listener_closed = 0;
+
+// A notification waiting for the decision broker's answer
+typedef struct {
+  int notify_fd;
+  uint64_t id;
+  int is_open;
+  char abs_path[MAX_PATH];
+} pending_notif_t;
+
+// FNV-1a
+static uint64_t hash_path(const char *path) {
+  uint64_t h = 1469598103934665603ULL;
+  for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+    h ^= *p;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static int path_set_contains(const path_set_t *set, const char *path) {
+  if (set->capacity == 0) {
+    return 0;
+  }
+  size_t mask = set->capacity - 1;
+  for (size_t i = hash_path(path) & mask; set->slots[i]; i = (i + 1) & mask) {
+    if (strcmp(set->slots[i], path) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void path_set_insert(path_set_t *set, char *owned) {
+  size_t mask = set->capacity - 1;
+  size_t i = hash_path(owned) & mask;
+  while (set->slots[i]) {
+    i = (i + 1) & mask;
+  }
+  set->slots[i] = owned;
+  set->count++;
+}
+
+static void path_set_add(path_set_t *set, const char *path) {
+  if (path_set_contains(set, path)) {
+    return;
+  }
+
+  // Keep the load factor under one half
+  if ((set->count + 1) * 2 > set->capacity) {
+    path_set_t grown = {0};
+    grown.capacity = set->capacity ? set->capacity * 2 : 64;
+    grown.slots = calloc(grown.capacity, sizeof(char *));
+    if (!grown.slots) {
+      return;
+    }
+    for (size_t i = 0; i < set->capacity; i++) {
+      if (set->slots[i]) {
+        path_set_insert(&grown, set->slots[i]);
+      }
+    }
+    free(set->slots);
+    *set = grown;
+  }
+
+  char *copy = strdup(path);
+  if (copy) {
+    path_set_insert(set, copy);
+  }
+}
+
+// Pass the listener fd from the child to the supervisor
+static int send_fd(int sock, int fd) {
+  char dummy = 0;
+  struct iovec iov = { &dummy, 1 };
+  char control[CMSG_SPACE(sizeof(int))];
+  memset(control, 0, sizeof(control));
+
+  struct msghdr msg = {0};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+  return sendmsg(sock, &msg, 0) == -1 ? -1 : 0;
+}
+
+static int recv_fd(int sock) {
+  char dummy;
+  struct iovec iov = { &dummy, 1 };
+  char control[CMSG_SPACE(sizeof(int))];
+
+  struct msghdr msg = {0};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  if (recvmsg(sock, &msg, 0) <= 0) {
+    return -1;
+  }
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS) {
+    return -1;
+  }
+
+  int fd;
+  memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+  return fd;
+}
+
+// Let the kernel run the syscall, or fail it with EPERM
+static void send_response(int notify_fd, struct seccomp_notif_resp *resp, uint64_t id, int allowed) {
+  resp->id = id;
+  resp->val = 0;
+  if (allowed) {
+    // Let the kernel run the original syscall
+    resp->error = 0;
+    resp->flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+  } else {
+    resp->error = -EPERM;
+    resp->flags = 0;
+  }
+
+  if (ioctl(notify_fd, SECCOMP_IOCTL_NOTIF_SEND, resp) == -1 && errno != ENOENT) {
+    perror("seccomp notif send");
+  }
+}
+
+// Called on the broker thread once a prompted notification is answered
+static void answer_notification(void *ctx, int allowed) {
+  pending_notif_t *pending = ctx;
+  if (allowed && pending->is_open) {
+    pthread_mutex_lock(&opened_lock);
+    path_set_add(&opened_paths, pending->abs_path);
+    pthread_mutex_unlock(&opened_lock);
+  }
+
+  struct seccomp_notif_resp *resp = calloc(1, resp_size);
+  if (resp) {
+    pthread_mutex_lock(&listener_lock);
+    if (!listener_closed) {
+      send_response(pending->notify_fd, resp, pending->id, allowed);
+    }
+    pthread_mutex_unlock(&listener_lock);
+    free(resp);
+  } else {
+    perror("calloc");
+  }
+  free(pending);
+}
+
+// What decode_event() reads a notifying task's operands through; `ctx`
+// points at its pid
+static ssize_t read_path(void *ctx, unsigned long addr, char *buf, size_t size) {
+  return read_string_proc(*(pid_t *)ctx, addr, buf, size);
+}
+
+// The file behind `fd`, if the program was allowed to open it
+static const char *fd_path(void *ctx, int fd, char *buf, size_t size, path_id_t *id) {
+  char link[64];
+  snprintf(link, sizeof(link), "/proc/%d/fd/%d", (int)*(pid_t *)ctx, fd);
+  ssize_t len = readlink(link, buf, size - 1);
+  if (len <= 0) {
+    return NULL;
+  }
+  buf[len] = '\0';
+  *id = PATH_ID_NONE;
+
+  pthread_mutex_lock(&opened_lock);
+  int opened = path_set_contains(&opened_paths, buf);
+  pthread_mutex_unlock(&opened_lock);
+  return opened ? buf : NULL;
+}
+
+static ssize_t read_path_memory(void *ctx, unsigned long addr, void *buf, size_t size) {
+  return read_memory(*(pid_t *)ctx, addr, buf, size);
+}
+
+// Nothing is cached here: without ptrace stops a chdir is not seen in
+// time, so the base comes from /proc for every relative path
+static const char *base_path(void *ctx, int dirfd, char *buf, size_t size) {
+  return proc_fd_path(*(pid_t *)ctx, dirfd == AT_FDCWD ? -1 : dirfd, buf, size) == -1 ? NULL : buf;
+}
+
+// Decode one notification and answer it, or leave the answer to the
+// decision broker so other notifications are not held up
+static void handle_notification(int notify_fd, struct seccomp_notif *req,
+                                struct seccomp_notif_resp *resp) {
+  pid_t pid = (pid_t)req->pid;
+  long nr = (long)req->data.nr;
+  int allowed = 1;
+
+  // The filter only routes native monitored syscalls here. Anything else
+  // (another ABI, x32) cannot be decoded, so it is refused, not let through.
+  if (req->data.arch != FILTER_AUDIT_ARCH || !is_monitored_syscall(nr)) {
+    allowed = 0;
+  } else {
+    char paths[2][MAX_PATH];
+    monitor_event_t event;
+    init_event(&event, pid, nr);
+    unsigned long args[6];
+    for (int i = 0; i < 6; i++) {
+      args[i] = (unsigned long)req->data.args[i];
+    }
+    operand_reader_t reader = { read_path, fd_path, read_path_memory, base_path, &pid };
+    decode_event(&event, args, &reader, paths);
+
+    // The task may have died (and its pid been reused) while we read its
+    // memory; only act on what we read if the request is still live
+    if (ioctl(notify_fd, SECCOMP_IOCTL_NOTIF_ID_VALID, &req->id) == -1) {
+      return;
+    }
+
+    pending_notif_t *pending = malloc(sizeof(pending_notif_t));
+    if (!pending) {
+      perror("malloc");
+      send_response(notify_fd, resp, req->id, 0);
+      return;
+    }
+    pending->notify_fd = notify_fd;
+    pending->id = req->id;
+    pending->is_open = (syscall_desc(nr)->flags & SYSCALL_NEW_FD) != 0;
+    if (pending->is_open) {
+      // Already absolute: the cwd may change before an answer arrives
+      snprintf(pending->abs_path, sizeof(pending->abs_path), "%s", paths[0]);
+    }
+
+    allowed = decide_event(&event, answer_notification, pending);
+    if (allowed == DECISION_PENDING) {
+      return;
+    }
+    if (allowed && pending->is_open) {
+      pthread_mutex_lock(&opened_lock);
+      path_set_add(&opened_paths, pending->abs_path);
+      pthread_mutex_unlock(&opened_lock);
+    }
+    free(pending);
+  }
+
+  send_response(notify_fd, resp, req->id, allowed);
+}
+
+int run_notify_sandbox(char **argv, int *wait_status) {
+  struct seccomp_notif_sizes sizes;
+  if (syscall(SYS_seccomp, SECCOMP_GET_NOTIF_SIZES, 0, &sizes) == -1) {
+    perror("seccomp get notif sizes");
+    return 1;
+  }
+  resp_size = sizes.seccomp_notif_resp;
+
+  int sock[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sock) == -1) {
+    perror("socketpair");
+    return 1;
+  }
+
+  pid_t child_pid = fork();
+  if (child_pid == -1) {
+    perror("fork failed");
+    return 1;
+  }
+
+  if (child_pid == 0) {
+    // Child process
+    close(sock[0]);
+
+    int monitored[SYSCALL_TABLE_SIZE];
+    int count = syscall_list(SYSCALL_MONITORED, monitored, SYSCALL_TABLE_SIZE);
+    int listener = install_notify_filter(monitored, count);
+    if (listener == -1) {
+      perror("seccomp notify filter");
+      exit(1);
+    }
+    if (send_fd(sock[1], listener) == -1) {
+      perror("send listener fd");
+      exit(1);
+    }
+    close(listener);
+    close(sock[1]);
+
+    // Execute the program
+    execvp(argv[0], argv);
+
+    // If we get here, execvp failed
+    perror("execvp failed");
+    exit(1);
+  }
+
+  // Parent process (supervisor)
+  close(sock[1]);
+  int notify_fd = recv_fd(sock[0]);
+  close(sock[0]);
+  if (notify_fd == -1) {
+    fprintf(stderr, "Failed to receive the seccomp listener from the child\n");
+    waitpid(child_pid, NULL, 0);
+    return 1;
+  }
+
+  // A pidfd tells us when the child exits; without one, poll periodically
+  int pidfd = (int)syscall(SYS_pidfd_open, child_pid, 0);
+
+  printf("%sStarting to supervise process with PID %d (seccomp notify)%s\n", INFO_COLOR, child_pid, COLOR_RESET);
+
+  struct seccomp_notif *req = malloc(sizes.seccomp_notif);
+  struct seccomp_notif_resp *resp = malloc(sizes.seccomp_notif_resp);
+  if (!req || !resp) {
+    perror("malloc");
+    return 1;
+  }
+
+  struct pollfd fds[2] = {
+    { notify_fd, POLLIN, 0 },
+    { pidfd, POLLIN, 0 },
+  };
+  int nfds = pidfd == -1 ? 1 : 2;
+  int status = 0;
+
+  while (1) {
+    int ready = poll(fds, nfds, pidfd == -1 ? 100 : -1);
+    if (ready == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("poll");
+      break;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      memset(req, 0, sizes.seccomp_notif);
+      memset(resp, 0, sizes.seccomp_notif_resp);
+      if (ioctl(notify_fd, SECCOMP_IOCTL_NOTIF_RECV, req) == -1) {
+        // ENOENT: the task was killed before we picked the request up
+        if (errno != EINTR && errno != ENOENT) {
+          perror("seccomp notif recv");
+          break;
+        }
+      } else {
+        handle_notification(notify_fd, req, resp);
+      }
+      continue;
+    }
+
+    int child_done;
+    if (nfds == 2) {
+      child_done = (fds[1].revents & POLLIN) || (fds[0].revents & (POLLHUP | POLLERR));
+      if (child_done && waitpid(child_pid, &status, 0) == -1) {
+        perror("waitpid");
+        break;
+      }
+    } else {
+      child_done = waitpid(child_pid, &status, WNOHANG) == child_pid;
+    }
+
+    if (child_done) {
+      *wait_status = status;
+      // Check if the child has exited
+      if (WIFEXITED(status)) {
+        printf("Child process exited with status %d\n", WEXITSTATUS(status));
+      } else if (WIFSIGNALED(status)) {
+        printf("Child process terminated by signal %d\n", WTERMSIG(status));
+      }
+      break;
+    }
+  }
+
+  free(req);
+  free(resp);
+  // Cancel the decisions still with the broker before the fd can be reused
+  pthread_mutex_lock(&listener_lock);
+  listener_closed = 1;
+  close(notify_fd);
+  pthread_mutex_unlock(&listener_lock);
+  if (pidfd != -1) {
+    close(pidfd);
+  }
+  return 0;
+}
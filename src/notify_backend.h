@@ -0,0 +1,10 @@
+#ifndef NOTIFY_BACKEND_H
+#define NOTIFY_BACKEND_H
+
+// Run `argv[0]` under the seccomp user-notification backend: monitored
+// syscalls are routed to a listener fd and answered by this process
+// without ptrace, everything else runs at native speed. Returns the
+// sandbox's exit status; the program's wait status goes in `*wait_status`.
+int run_notify_sandbox(char **argv, int *wait_status);
+
+#endif /* NOTIFY_BACKEND_H */
@@ -0,0 +1,697 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "path_policy.h"
+
+// Each rule's pattern is compiled into a run of elements ending in
+// ELEM_END. A position in the flat element array is an NFA state, and a
+// DFA state is the (sorted) set of positions still alive after reading a
+// prefix of the path.
+enum {
+  ELEM_CHAR,      // Literal byte
+  ELEM_ANY,       // '?': one byte other than '/'
+  ELEM_STAR,      // '*': any run of bytes other than '/'
+  ELEM_GLOBSTAR,  // '**': any run of bytes
+  ELEM_END        // Rule matched
+};
+
+typedef struct {
+  uint8_t kind;
+  uint8_t ch;
+  uint16_t unused;
+  uint32_t rule;
+} policy_elem_t;
+
+typedef struct dfa_state {
+  uint32_t *pos;       // Sorted NFA positions
+  uint32_t npos;
+  uint64_t hash;
+  uint8_t actions[POLICY_OP_COUNT];
+  // One slot per byte class, NULL until computed. Kept in the state so
+  // matching costs one dependent load per byte, and never moved, so it
+  // can be walked without the lock.
+  _Atomic(struct dfa_state *) next[];
+} dfa_state_t;
+
+// Bound on cached DFA states; past it, matching continues uncached
+#define MAX_DFA_STATES 65536
+#define DEAD_STATE 0
+
+struct path_policy {
+  policy_rule_t *rules;
+  int num_rules;
+  policy_action_t defaults[POLICY_OP_COUNT];
+
+  policy_elem_t *elems;
+  uint32_t num_elems;
+
+  // Bytes that behave identically in every pattern share a class
+  uint8_t byte_class[256];
+  uint8_t class_rep[256];
+  int num_classes;
+
+  dfa_state_t **states;
+  int num_states;
+  int states_cap;
+  dfa_state_t *start;
+  dfa_state_t *dead;
+
+  // Position set -> state id
+  int32_t *state_index;
+  uint32_t state_index_cap;
+
+  // Scratch space for building position sets
+  uint32_t *scratch;
+  uint8_t *seen;
+
+  // States are built lazily during lookups, which may come from several
+  // tracer threads at once. Only building takes the lock; it covers
+  // everything above from `states` on.
+  pthread_mutex_t lock;
+};
+
+static const char *op_names[POLICY_OP_COUNT] = { "open", "read", "write", "delete" };
+
+const char *policy_op_name(policy_op_t op) {
+  return op < POLICY_OP_COUNT ? op_names[op] : "unknown";
+}
+
+const char *policy_action_name(policy_action_t action) {
+  switch (action) {
+    case POLICY_ALLOW: return "allow";
+    case POLICY_DENY: return "deny";
+    case POLICY_ASK: return "ask";
+    default: return "none";
+  }
+}
+
+int policy_op_from_name(const char *name) {
+  for (int op = 0; op < POLICY_OP_COUNT; op++) {
+    if (strcmp(name, op_names[op]) == 0) {
+      return op;
+    }
+  }
+  return -1;
+}
+
+static int parse_action(const char *word, policy_action_t *action) {
+  if (strcmp(word, "allow") == 0) {
+    *action = POLICY_ALLOW;
+  } else if (strcmp(word, "deny") == 0) {
+    *action = POLICY_DENY;
+  } else if (strcmp(word, "ask") == 0) {
+    *action = POLICY_ASK;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+static int parse_ops(const char *word, unsigned int *ops) {
+  if (strcmp(word, "*") == 0) {
+    *ops = (1u << POLICY_OP_COUNT) - 1;
+    return 0;
+  }
+
+  char copy[128];
+  snprintf(copy, sizeof(copy), "%s", word);
+  *ops = 0;
+  char *save = NULL;
+  for (char *tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+    int op = policy_op_from_name(tok);
+    if (op < 0) {
+      return -1;
+    }
+    *ops |= 1u << op;
+  }
+  return *ops ? 0 : -1;
+}
+
+static uint64_t hash_positions(const uint32_t *pos, uint32_t n) {
+  uint64_t h = 1469598103934665603ULL;
+  for (uint32_t i = 0; i < n; i++) {
+    h ^= pos[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+// Add position `p` and everything reachable from it without reading a byte
+static void add_closure(path_policy_t *policy, uint32_t p, uint32_t *set, uint32_t *n) {
+  while (!policy->seen[p]) {
+    policy->seen[p] = 1;
+    set[(*n)++] = p;
+    uint8_t kind = policy->elems[p].kind;
+    if (kind != ELEM_STAR && kind != ELEM_GLOBSTAR) {
+      break;
+    }
+    p++;
+  }
+}
+
+static int compare_u32(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Compute the position set reached from `pos` on byte `c` into scratch
+static uint32_t step_positions(path_policy_t *policy, const uint32_t *pos, uint32_t npos,
+                               unsigned char c) {
+  uint32_t n = 0;
+  uint32_t *out = policy->scratch;
+
+  for (uint32_t i = 0; i < npos; i++) {
+    uint32_t p = pos[i];
+    const policy_elem_t *e = &policy->elems[p];
+    switch (e->kind) {
+      case ELEM_CHAR:
+        if (e->ch == c) {
+          add_closure(policy, p + 1, out, &n);
+        }
+        break;
+      case ELEM_ANY:
+        if (c != '/') {
+          add_closure(policy, p + 1, out, &n);
+        }
+        break;
+      case ELEM_STAR:
+        if (c != '/') {
+          add_closure(policy, p, out, &n);
+        }
+        break;
+      case ELEM_GLOBSTAR:
+        add_closure(policy, p, out, &n);
+        break;
+      default:
+        break;
+    }
+  }
+
+  for (uint32_t i = 0; i < n; i++) {
+    policy->seen[out[i]] = 0;
+  }
+  qsort(out, n, sizeof(uint32_t), compare_u32);
+  return n;
+}
+
+// Per-operation action of the earliest rule accepting in this set
+static void accept_actions(const path_policy_t *policy, const uint32_t *pos, uint32_t npos,
+                           uint8_t actions[POLICY_OP_COUNT]) {
+  unsigned int pending = (1u << POLICY_OP_COUNT) - 1;
+  memset(actions, POLICY_NONE, POLICY_OP_COUNT);
+
+  // Positions are sorted, and rules are laid out in order, so the first
+  // accepting position for an operation belongs to the first matching rule
+  for (uint32_t i = 0; i < npos && pending; i++) {
+    const policy_elem_t *e = &policy->elems[pos[i]];
+    if (e->kind != ELEM_END) {
+      continue;
+    }
+    const policy_rule_t *rule = &policy->rules[e->rule];
+    unsigned int hit = rule->ops & pending;
+    for (int op = 0; op < POLICY_OP_COUNT; op++) {
+      if (hit & (1u << op)) {
+        actions[op] = (uint8_t)rule->action;
+      }
+    }
+    pending &= ~hit;
+  }
+}
+
+static int state_index_grow(path_policy_t *policy) {
+  uint32_t cap = policy->state_index_cap ? policy->state_index_cap * 2 : 1024;
+  int32_t *index = malloc(cap * sizeof(int32_t));
+  if (!index) {
+    return -1;
+  }
+  memset(index, 0xff, cap * sizeof(int32_t));
+
+  for (int id = 0; id < policy->num_states; id++) {
+    uint32_t slot = (uint32_t)policy->states[id]->hash & (cap - 1);
+    while (index[slot] != -1) {
+      slot = (slot + 1) & (cap - 1);
+    }
+    index[slot] = id;
+  }
+
+  free(policy->state_index);
+  policy->state_index = index;
+  policy->state_index_cap = cap;
+  return 0;
+}
+
+// Find or create the DFA state for a position set. Returns -1 when the
+// state cache is full.
+static int intern_state(path_policy_t *policy, const uint32_t *pos, uint32_t npos) {
+  uint64_t hash = hash_positions(pos, npos);
+
+  if (policy->state_index_cap) {
+    uint32_t mask = policy->state_index_cap - 1;
+    for (uint32_t slot = (uint32_t)hash & mask; policy->state_index[slot] != -1;
+         slot = (slot + 1) & mask) {
+      dfa_state_t *s = policy->states[policy->state_index[slot]];
+      if (s->hash == hash && s->npos == npos &&
+          memcmp(s->pos, pos, npos * sizeof(uint32_t)) == 0) {
+        return policy->state_index[slot];
+      }
+    }
+  }
+
+  if (policy->num_states >= MAX_DFA_STATES) {
+    return -1;
+  }
+  if ((uint32_t)(policy->num_states + 1) * 2 > policy->state_index_cap &&
+      state_index_grow(policy) == -1) {
+    return -1;
+  }
+  if (policy->num_states == policy->states_cap) {
+    int cap = policy->states_cap ? policy->states_cap * 2 : 64;
+    dfa_state_t **grown = realloc(policy->states, cap * sizeof(dfa_state_t *));
+    if (!grown) {
+      return -1;
+    }
+    policy->states = grown;
+    policy->states_cap = cap;
+  }
+
+  dfa_state_t *s = malloc(sizeof(dfa_state_t) + (size_t)policy->num_classes * sizeof(s->next[0]));
+  if (!s) {
+    return -1;
+  }
+  for (int cls = 0; cls < policy->num_classes; cls++) {
+    atomic_init(&s->next[cls], NULL);
+  }
+  s->pos = malloc((npos ? npos : 1) * sizeof(uint32_t));
+  if (!s->pos) {
+    free(s);
+    return -1;
+  }
+  if (npos) {
+    memcpy(s->pos, pos, npos * sizeof(uint32_t));
+  }
+  s->npos = npos;
+  s->hash = hash;
+  accept_actions(policy, pos, npos, s->actions);
+
+  int id = policy->num_states++;
+  policy->states[id] = s;
+
+  uint32_t mask = policy->state_index_cap - 1;
+  uint32_t slot = (uint32_t)hash & mask;
+  while (policy->state_index[slot] != -1) {
+    slot = (slot + 1) & mask;
+  }
+  policy->state_index[slot] = id;
+  return id;
+}
+
+// Split the byte alphabet into classes: '/' and every literal byte in a
+// pattern get their own class, all other bytes behave identically
+static void compute_byte_classes(path_policy_t *policy) {
+  uint8_t used[256] = {0};
+  used['/'] = 1;
+  for (uint32_t i = 0; i < policy->num_elems; i++) {
+    if (policy->elems[i].kind == ELEM_CHAR) {
+      used[policy->elems[i].ch] = 1;
+    }
+  }
+
+  int classes = 1;   // Class 0: bytes no pattern mentions
+  int other_rep = -1;
+  for (int c = 0; c < 256; c++) {
+    if (used[c]) {
+      policy->byte_class[c] = (uint8_t)classes;
+      policy->class_rep[classes] = (uint8_t)c;
+      classes++;
+    } else {
+      policy->byte_class[c] = 0;
+      if (other_rep < 0 && c != 0) {
+        other_rep = c;
+      }
+    }
+  }
+  policy->class_rep[0] = (uint8_t)(other_rep < 0 ? 1 : other_rep);
+  policy->num_classes = classes;
+}
+
+// Append one rule's pattern to the element array
+static int compile_pattern(path_policy_t *policy, const char *pattern, uint32_t rule,
+                           uint32_t *cap) {
+  size_t len = strlen(pattern);
+
+  // Worst case one element per byte plus the end marker
+  while (policy->num_elems + len + 1 > *cap) {
+    uint32_t new_cap = *cap ? *cap * 2 : 1024;
+    policy_elem_t *grown = realloc(policy->elems, new_cap * sizeof(policy_elem_t));
+    if (!grown) {
+      return -1;
+    }
+    policy->elems = grown;
+    *cap = new_cap;
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    policy_elem_t e = { ELEM_CHAR, (uint8_t)pattern[i], 0, rule };
+    if (pattern[i] == '*') {
+      if (pattern[i + 1] == '*') {
+        e.kind = ELEM_GLOBSTAR;
+        while (pattern[i + 1] == '*') {
+          i++;
+        }
+      } else {
+        e.kind = ELEM_STAR;
+      }
+    } else if (pattern[i] == '?') {
+      e.kind = ELEM_ANY;
+    }
+    policy->elems[policy->num_elems++] = e;
+  }
+
+  policy_elem_t end = { ELEM_END, 0, 0, rule };
+  policy->elems[policy->num_elems++] = end;
+  return 0;
+}
+
+static int add_rule(path_policy_t *policy, policy_action_t action, unsigned int ops,
+                    const char *pattern, int line, int *cap) {
+  if (policy->num_rules == *cap) {
+    int new_cap = *cap ? *cap * 2 : 64;
+    policy_rule_t *grown = realloc(policy->rules, new_cap * sizeof(policy_rule_t));
+    if (!grown) {
+      return -1;
+    }
+    policy->rules = grown;
+    *cap = new_cap;
+  }
+
+  // "dir/" is shorthand for everything below dir
+  size_t len = strlen(pattern);
+  char *text = malloc(len + 3);
+  if (!text) {
+    return -1;
+  }
+  memcpy(text, pattern, len + 1);
+  if (len > 0 && pattern[len - 1] == '/') {
+    memcpy(text + len, "**", 3);
+  }
+
+  policy_rule_t *rule = &policy->rules[policy->num_rules++];
+  rule->action = action;
+  rule->ops = ops;
+  rule->line = line;
+  rule->pattern = text;
+  return 0;
+}
+
+static int compile_policy(path_policy_t *policy) {
+  uint32_t cap = 0;
+  for (int r = 0; r < policy->num_rules; r++) {
+    if (compile_pattern(policy, policy->rules[r].pattern, (uint32_t)r, &cap) == -1) {
+      return -1;
+    }
+  }
+  compute_byte_classes(policy);
+
+  // +1 so an empty policy still gets valid (unused) buffers
+  policy->scratch = malloc((policy->num_elems + 1) * sizeof(uint32_t));
+  policy->seen = calloc(policy->num_elems + 1, 1);
+  if (!policy->scratch || !policy->seen) {
+    return -1;
+  }
+
+  // State 0 is the dead state: no rule can match any more
+  if (intern_state(policy, policy->scratch, 0) != DEAD_STATE) {
+    return -1;
+  }
+  policy->dead = policy->states[DEAD_STATE];
+
+  // The start state has the first position of every rule
+  uint32_t n = 0;
+  for (int r = 0, p = 0; r < policy->num_rules; r++) {
+    add_closure(policy, (uint32_t)p, policy->scratch, &n);
+    while (policy->elems[p].kind != ELEM_END) {
+      p++;
+    }
+    p++;
+  }
+  for (uint32_t i = 0; i < n; i++) {
+    policy->seen[policy->scratch[i]] = 0;
+  }
+  qsort(policy->scratch, n, sizeof(uint32_t), compare_u32);
+  int start = intern_state(policy, policy->scratch, n);
+  if (start < 0) {
+    return -1;
+  }
+  policy->start = policy->states[start];
+  return 0;
+}
+
+path_policy_t *policy_from_string(const char *text, const char *source) {
+  path_policy_t *policy = calloc(1, sizeof(path_policy_t));
+  char *copy = strdup(text);
+  if (!policy || !copy) {
+    free(policy);
+    free(copy);
+    return NULL;
+  }
+  pthread_mutex_init(&policy->lock, NULL);
+  for (int op = 0; op < POLICY_OP_COUNT; op++) {
+    policy->defaults[op] = POLICY_ASK;
+  }
+
+  int rules_cap = 0;
+  int line_no = 0;
+  int ok = 1;
+  char *save_line = NULL;
+
+  // strtok_r would skip empty lines and lose the numbering, so split by hand
+  for (char *line = copy; line && ok; line = save_line) {
+    save_line = strchr(line, '\n');
+    if (save_line) {
+      *save_line++ = '\0';
+    }
+    line_no++;
+
+    char *hash = strchr(line, '#');
+    if (hash) {
+      *hash = '\0';
+    }
+
+    char *words[4];
+    int nwords = 0;
+    char *save = NULL;
+    for (char *w = strtok_r(line, " \t\r", &save); w && nwords < 4; w = strtok_r(NULL, " \t\r", &save)) {
+      words[nwords++] = w;
+    }
+    if (nwords == 0) {
+      continue;
+    }
+
+    policy_action_t action;
+    unsigned int ops;
+    if (strcmp(words[0], "default") == 0) {
+      if (nwords < 2 || nwords > 3 || parse_action(words[1], &action) == -1 ||
+          (nwords == 3 && parse_ops(words[2], &ops) == -1)) {
+        fprintf(stderr, "%s:%d: expected 'default <allow|deny|ask> [operations]'\n", source, line_no);
+        ok = 0;
+        break;
+      }
+      if (nwords == 2) {
+        ops = (1u << POLICY_OP_COUNT) - 1;
+      }
+      for (int op = 0; op < POLICY_OP_COUNT; op++) {
+        if (ops & (1u << op)) {
+          policy->defaults[op] = action;
+        }
+      }
+      continue;
+    }
+
+    if (nwords != 3 || parse_action(words[0], &action) == -1) {
+      fprintf(stderr, "%s:%d: expected '<allow|deny|ask> <operations> <pattern>'\n", source, line_no);
+      ok = 0;
+    } else if (parse_ops(words[1], &ops) == -1) {
+      fprintf(stderr, "%s:%d: unknown operation in '%s'\n", source, line_no, words[1]);
+      ok = 0;
+    } else if (add_rule(policy, action, ops, words[2], line_no, &rules_cap) == -1) {
+      perror("policy");
+      ok = 0;
+    }
+  }
+  free(copy);
+
+  if (!ok || compile_policy(policy) == -1) {
+    if (ok) {
+      fprintf(stderr, "%s: failed to compile policy\n", source);
+    }
+    policy_free(policy);
+    return NULL;
+  }
+  return policy;
+}
+
+path_policy_t *policy_load_file(const char *filename) {
+  FILE *file = fopen(filename, "r");
+  if (!file) {
+    perror(filename);
+    return NULL;
+  }
+
+  size_t cap = 4096, len = 0;
+  char *text = malloc(cap);
+  while (text) {
+    size_t n = fread(text + len, 1, cap - len - 1, file);
+    if (n == 0) {
+      break;
+    }
+    len += n;
+    if (len + 1 == cap) {
+      cap *= 2;
+      char *grown = realloc(text, cap);
+      if (!grown) {
+        free(text);
+      }
+      text = grown;
+    }
+  }
+  fclose(file);
+  if (!text) {
+    perror("policy");
+    return NULL;
+  }
+  text[len] = '\0';
+
+  path_policy_t *policy = policy_from_string(text, filename);
+  free(text);
+  return policy;
+}
+
+path_policy_t *policy_default(void) {
+  static const char *builtin =
+    "# System libraries and pseudo-filesystems pass through unprompted\n"
+    "allow * /etc/\n"
+    "allow * /usr/lib/\n"
+    "allow * /lib/\n"
+    "allow * /dev/\n"
+    "allow * /proc/\n"
+    "allow * /sys/\n"
+    "default ask\n";
+  return policy_from_string(builtin, "<built-in policy>");
+}
+
+void policy_free(path_policy_t *policy) {
+  if (!policy) {
+    return;
+  }
+  for (int r = 0; r < policy->num_rules; r++) {
+    free(policy->rules[r].pattern);
+  }
+  for (int s = 0; s < policy->num_states; s++) {
+    free(policy->states[s]->pos);
+    free(policy->states[s]);
+  }
+  free(policy->rules);
+  free(policy->elems);
+  free(policy->states);
+  free(policy->state_index);
+  free(policy->scratch);
+  free(policy->seen);
+  pthread_mutex_destroy(&policy->lock);
+  free(policy);
+}
+
+// Finish a match without the state cache once it is full
+static void match_uncached(path_policy_t *policy, const dfa_state_t *from, const unsigned char *p,
+                           uint8_t actions[POLICY_OP_COUNT]) {
+  uint32_t *cur = malloc((policy->num_elems + 1) * sizeof(uint32_t));
+  if (!cur) {
+    memset(actions, POLICY_NONE, POLICY_OP_COUNT);
+    return;
+  }
+  uint32_t n = from->npos;
+  memcpy(cur, from->pos, n * sizeof(uint32_t));
+
+  for (; *p && n; p++) {
+    n = step_positions(policy, cur, n, *p);
+    memcpy(cur, policy->scratch, n * sizeof(uint32_t));
+  }
+  accept_actions(policy, cur, n, actions);
+  free(cur);
+}
+
+// Build the missing transition of `from` on byte class `cls`. Returns
+// the next state, or NULL once the state cache is full, after finishing
+// the match from `p` without it into `actions`.
+static dfa_state_t *add_transition(path_policy_t *policy, dfa_state_t *from, int cls,
+                                   const unsigned char *p, uint8_t actions[POLICY_OP_COUNT]) {
+  pthread_mutex_lock(&policy->lock);
+  // Another thread may have built it meanwhile
+  dfa_state_t *next = atomic_load_explicit(&from->next[cls], memory_order_relaxed);
+  if (!next) {
+    uint32_t n = step_positions(policy, from->pos, from->npos, policy->class_rep[cls]);
+    int id = n ? intern_state(policy, policy->scratch, n) : DEAD_STATE;
+    if (id < 0) {
+      match_uncached(policy, from, p, actions);
+      pthread_mutex_unlock(&policy->lock);
+      return NULL;
+    }
+    next = policy->states[id];
+    // Release, so a thread that loads the pointer sees the whole state
+    atomic_store_explicit(&from->next[cls], next, memory_order_release);
+  }
+  pthread_mutex_unlock(&policy->lock);
+  return next;
+}
+
+// Run the DFA over `path`, building states on first use. Transitions
+// that already exist are followed without taking the lock.
+static void match(path_policy_t *policy, const char *path, uint8_t actions[POLICY_OP_COUNT]) {
+  const unsigned char *p = (const unsigned char *)path;
+  dfa_state_t *state = policy->start;
+
+  for (; *p && state != policy->dead; p++) {
+    int cls = policy->byte_class[*p];
+    dfa_state_t *next = atomic_load_explicit(&state->next[cls], memory_order_acquire);
+    if (!next && !(next = add_transition(policy, state, cls, p, actions))) {
+      return;
+    }
+    state = next;
+  }
+
+  memcpy(actions, state->actions, POLICY_OP_COUNT);
+}
+
+void policy_evaluate_all(path_policy_t *policy, const char *path,
+                         policy_action_t actions[POLICY_OP_COUNT]) {
+  uint8_t matched[POLICY_OP_COUNT];
+  match(policy, path, matched);
+  for (int op = 0; op < POLICY_OP_COUNT; op++) {
+    actions[op] = matched[op] != POLICY_NONE ? (policy_action_t)matched[op] : policy->defaults[op];
+  }
+}
+
+policy_action_t policy_evaluate(path_policy_t *policy, const char *path, policy_op_t op) {
+  uint8_t matched[POLICY_OP_COUNT];
+  match(policy, path, matched);
+  return matched[op] != POLICY_NONE ? (policy_action_t)matched[op] : policy->defaults[op];
+}
+
+int policy_rule_count(const path_policy_t *policy) {
+  return policy->num_rules;
+}
+
+const policy_rule_t *policy_rule(const path_policy_t *policy, int index) {
+  return index >= 0 && index < policy->num_rules ? &policy->rules[index] : NULL;
+}
+
+policy_action_t policy_default_action(const path_policy_t *policy, policy_op_t op) {
+  return policy->defaults[op];
+}
+
+int policy_dfa_states(const path_policy_t *policy) {
+  return policy->num_states;
+}
@@ -0,0 +1,77 @@
+#ifndef PATH_POLICY_H
+#define PATH_POLICY_H
+
+// Path policy: an ordered list of rules, loaded from a file and compiled
+// into a lazily built DFA so every path is matched in one left-to-right
+// pass, however many rules there are.
+//
+// File format, one rule per line ('#' starts a comment):
+//
+//   <action> <operations> <pattern>
+//   default  <action> [<operations>]
+//
+// action:     allow | deny | ask
+// operations: '*' or a comma-separated list of open, read, write, delete
+// pattern:    a glob: '*' matches within one path component, '**' matches
+//             across components, '?' matches one character other than '/'.
+//             A pattern ending in '/' is a directory prefix ("dir/**").
+//
+// The first rule that matches a path for an operation decides; paths no
+// rule matches get the default action for that operation (ask if unset).
+
+typedef enum {
+  POLICY_OP_OPEN,
+  POLICY_OP_READ,
+  POLICY_OP_WRITE,
+  POLICY_OP_DELETE,
+  POLICY_OP_COUNT
+} policy_op_t;
+
+typedef enum {
+  POLICY_NONE,    // No rule matched (internal)
+  POLICY_ALLOW,
+  POLICY_DENY,
+  POLICY_ASK
+} policy_action_t;
+
+typedef struct {
+  policy_action_t action;
+  unsigned int ops;     // Bitmask of (1 << policy_op_t)
+  int line;             // Line in the policy file, for reporting
+  char *pattern;        // Pattern as written (after prefix expansion)
+} policy_rule_t;
+
+typedef struct path_policy path_policy_t;
+
+// Compile a policy from a file / from text. On error, prints a message
+// naming `source` and the line, and returns NULL.
+path_policy_t *policy_load_file(const char *filename);
+path_policy_t *policy_from_string(const char *text, const char *source);
+
+// The built-in policy: system paths are allowed, everything else is asked
+path_policy_t *policy_default(void);
+
+void policy_free(path_policy_t *policy);
+
+// Action for `path` under operation `op`. Safe to call from several threads.
+policy_action_t policy_evaluate(path_policy_t *policy, const char *path, policy_op_t op);
+
+// Action for `path` under every operation at once (one DFA pass)
+void policy_evaluate_all(path_policy_t *policy, const char *path,
+                         policy_action_t actions[POLICY_OP_COUNT]);
+
+// Rule access for reporting and other compilers of the same policy
+int policy_rule_count(const path_policy_t *policy);
+const policy_rule_t *policy_rule(const path_policy_t *policy, int index);
+policy_action_t policy_default_action(const path_policy_t *policy, policy_op_t op);
+
+// Number of DFA states built so far
+int policy_dfa_states(const path_policy_t *policy);
+
+const char *policy_op_name(policy_op_t op);
+const char *policy_action_name(policy_action_t action);
+
+// Map an operation name ("open", "read", ...) to its policy_op_t, or -1
+int policy_op_from_name(const char *name);
+
+#endif /* PATH_POLICY_H */
@@ -0,0 +1,144 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "path_resolve.h"
+
+// Append one component, folding "." and ".."; `*len` is the length of the
+// canonical prefix in `out`, which always starts with "/"
+static int push_component(char *out, size_t size, size_t *len, const char *name, size_t name_len) {
+  if (name_len == 0 || (name_len == 1 && name[0] == '.')) {
+    return 0;
+  }
+  if (name_len == 2 && name[0] == '.' && name[1] == '.') {
+    // Any component of the prefix may be a symlink, and the kernel climbs
+    // from where it points, so ".." is folded against the real directory.
+    // A prefix that does not exist (or is not a directory) fails the
+    // lookup in the kernel as well; any other error leaves it unresolved.
+    if (*len > 1) {
+      char real[PATH_MAX];
+      if (realpath(out, real)) {
+        size_t real_len = strlen(real);
+        if (real_len + 1 > size) {
+          return -1;
+        }
+        memcpy(out, real, real_len + 1);
+        *len = real_len;
+      } else if (errno != ENOENT && errno != ENOTDIR) {
+        return -1;
+      }
+    }
+    while (*len > 1 && out[*len - 1] != '/') {
+      (*len)--;
+    }
+    if (*len > 1) {
+      (*len)--;   // The slash before the dropped component
+    }
+    out[*len] = '\0';
+    return 0;
+  }
+
+  size_t need = (*len > 1 ? 1 : 0) + name_len;
+  if (*len + need + 1 > size) {
+    return -1;
+  }
+  if (*len > 1) {
+    out[(*len)++] = '/';
+  }
+  memcpy(out + *len, name, name_len);
+  *len += name_len;
+  out[*len] = '\0';
+  return 0;
+}
+
+static int push_path(char *out, size_t size, size_t *len, const char *path) {
+  while (*path) {
+    const char *end = strchr(path, '/');
+    size_t name_len = end ? (size_t)(end - path) : strlen(path);
+    if (push_component(out, size, len, path, name_len) == -1) {
+      return -1;
+    }
+    path += name_len;
+    while (*path == '/') {
+      path++;
+    }
+  }
+  return 0;
+}
+
+ssize_t path_canonicalize(const char *base, const char *path, char *out, size_t size) {
+  if (size < 2) {
+    return -1;
+  }
+  if (path[0] != '/' && !base) {
+    // Nothing to anchor it to: keep it as it is
+    size_t len = strlen(path);
+    if (len + 1 > size) {
+      return -1;
+    }
+    memcpy(out, path, len + 1);
+    return (ssize_t)len;
+  }
+
+  size_t len = 1;
+  out[0] = '/';
+  out[1] = '\0';
+  if (path[0] != '/' && push_path(out, size, &len, base) == -1) {
+    return -1;
+  }
+  if (push_path(out, size, &len, path) == -1) {
+    return -1;
+  }
+  return (ssize_t)len;
+}
+
+ssize_t proc_fd_path(pid_t pid, int fd, char *buf, size_t size) {
+  char link[64];
+  if (fd < 0) {
+    snprintf(link, sizeof(link), "/proc/%d/cwd", (int)pid);
+  } else {
+    snprintf(link, sizeof(link), "/proc/%d/fd/%d", (int)pid, fd);
+  }
+
+  ssize_t len = readlink(link, buf, size - 1);
+  // Non-file fds ("pipe:[...]") and cut-off links are no base
+  if (len <= 0 || (size_t)len == size - 1 || buf[0] != '/') {
+    return -1;
+  }
+  buf[len] = '\0';
+
+  // Nor are deleted files and directories, which the kernel marks with a
+  // suffix; the name is gone, and the path would belong to whatever takes
+  // its place
+  static const char deleted[] = " (deleted)";
+  size_t suffix = sizeof(deleted) - 1;
+  if ((size_t)len >= suffix && strcmp(buf + len - suffix, deleted) == 0) {
+    return -1;
+  }
+  return len;
+}
+
+int proc_fd_cloexec(pid_t pid, int fd) {
+  char name[64];
+  snprintf(name, sizeof(name), "/proc/%d/fdinfo/%d", (int)pid, fd);
+  FILE *file = fopen(name, "re");
+  if (!file) {
+    return -1;
+  }
+
+  // "pos:\t0\nflags:\t02100000\n...", flags in octal
+  char line[128];
+  int cloexec = -1;
+  unsigned int flags;
+  while (fgets(line, sizeof(line), file)) {
+    if (sscanf(line, "flags: %o", &flags) == 1) {
+      cloexec = (flags & O_CLOEXEC) != 0;
+      break;
+    }
+  }
+  fclose(file);
+  return cloexec;
+}
@@ -0,0 +1,31 @@
+#ifndef PATH_RESOLVE_H
+#define PATH_RESOLVE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Turning the path arguments of a syscall into the absolute, canonical
+// paths the policy is written against. "." components and repeated slashes
+// are folded as text, and symlinks are left alone (the kernel follows them
+// after the check, as it would for any path). A ".." is the exception: it
+// is folded against the directory it leaves with symlinks resolved, since
+// "link/.." is the parent of the link's target, not the link's own.
+
+// Write `path` as an absolute canonical path into `out`. A relative `path`
+// is taken relative to `base`, which must itself be absolute; with a NULL
+// `base` it is copied unchanged. ".." never climbs above "/"; each one
+// costs a realpath() of the prefix before it, in the caller's view of the
+// filesystem. Returns the length, or -1 if the result does not fit or a
+// prefix before a ".." cannot be resolved.
+ssize_t path_canonicalize(const char *base, const char *path, char *out, size_t size);
+
+// The kernel's view of a process's cwd (`fd` < 0) or of its open `fd`,
+// read from /proc/<pid>/cwd or /proc/<pid>/fd/<fd>. For cache misses only:
+// each call is a readlink. Returns the length, or -1.
+ssize_t proc_fd_path(pid_t pid, int fd, char *buf, size_t size);
+
+// Whether `fd` of `pid` is close-on-exec, from the flags line of
+// /proc/<pid>/fdinfo/<fd>: 1 or 0, or -1 if it cannot be read
+int proc_fd_cloexec(pid_t pid, int fd);
+
+#endif /* PATH_RESOLVE_H */
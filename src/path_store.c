@@ -0,0 +1,272 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "path_store.h"
+
+// Every tracer thread interns and releases paths, so all access is locked
+static pthread_mutex_t store_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Strings are bump-allocated out of chunks. A chunk is freed as soon as
+// the last string in it is released, so there is no per-string free list.
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+typedef struct arena_chunk {
+  uint32_t size;
+  uint32_t used;
+  uint32_t live;   // Strings in this chunk that are still referenced
+  char data[];
+} arena_chunk_t;
+
+typedef struct {
+  const char *str;
+  arena_chunk_t *chunk;
+  uint64_t hash;
+  uint32_t len;
+  uint32_t refcount;   // 0 means the slot is on the free list
+  uint32_t next_free;
+} path_entry_t;
+
+// Entry 0 is reserved for PATH_ID_NONE
+static path_entry_t *entries = NULL;
+static uint32_t entries_cap = 0;
+static uint32_t entries_used = 1;
+static uint32_t free_head = 0;
+static uint32_t live_count = 0;
+
+// Open-addressing index from hash to entry id (0 = empty slot)
+static uint32_t *index_slots = NULL;
+static uint32_t index_cap = 0;
+
+static arena_chunk_t *current_chunk = NULL;
+
+// FNV-1a
+static uint64_t hash_bytes(const char *s, size_t len) {
+  uint64_t h = 1469598103934665603ULL;
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char)s[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static int index_grow(void) {
+  uint32_t new_cap = index_cap ? index_cap * 2 : 1024;
+  uint32_t *slots = calloc(new_cap, sizeof(uint32_t));
+  if (!slots) {
+    return -1;
+  }
+
+  uint32_t mask = new_cap - 1;
+  for (uint32_t i = 0; i < index_cap; i++) {
+    uint32_t id = index_slots[i];
+    if (id) {
+      uint32_t pos = (uint32_t)entries[id].hash & mask;
+      while (slots[pos]) {
+        pos = (pos + 1) & mask;
+      }
+      slots[pos] = id;
+    }
+  }
+
+  free(index_slots);
+  index_slots = slots;
+  index_cap = new_cap;
+  return 0;
+}
+
+// Linear-probing delete with backward shift, so lookups never need tombstones
+static void index_remove(uint32_t id) {
+  uint32_t mask = index_cap - 1;
+  uint32_t pos = (uint32_t)entries[id].hash & mask;
+  while (index_slots[pos] != id) {
+    pos = (pos + 1) & mask;
+  }
+
+  uint32_t hole = pos;
+  for (uint32_t next = (hole + 1) & mask; index_slots[next]; next = (next + 1) & mask) {
+    uint32_t home = (uint32_t)entries[index_slots[next]].hash & mask;
+    // Move the entry back if its home slot is not between hole and next
+    if (((next - home) & mask) >= ((next - hole) & mask)) {
+      index_slots[hole] = index_slots[next];
+      hole = next;
+    }
+  }
+  index_slots[hole] = 0;
+}
+
+static char *arena_alloc(uint32_t len, arena_chunk_t **chunk_out) {
+  uint32_t need = len + 1;
+
+  if (!current_chunk || current_chunk->size - current_chunk->used < need) {
+    uint32_t size = need > ARENA_CHUNK_SIZE ? need : ARENA_CHUNK_SIZE;
+    arena_chunk_t *chunk = malloc(sizeof(arena_chunk_t) + size);
+    if (!chunk) {
+      return NULL;
+    }
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->live = 0;
+
+    // Retire the old chunk; it is freed once its last string is released
+    if (current_chunk && current_chunk->live == 0) {
+      free(current_chunk);
+    }
+    current_chunk = chunk;
+  }
+
+  char *p = current_chunk->data + current_chunk->used;
+  current_chunk->used += need;
+  current_chunk->live++;
+  *chunk_out = current_chunk;
+  return p;
+}
+
+static uint32_t entry_alloc(void) {
+  if (free_head) {
+    uint32_t id = free_head;
+    free_head = entries[id].next_free;
+    return id;
+  }
+
+  if (entries_used >= entries_cap) {
+    uint32_t new_cap = entries_cap ? entries_cap * 2 : 1024;
+    path_entry_t *grown = realloc(entries, new_cap * sizeof(path_entry_t));
+    if (!grown) {
+      return 0;
+    }
+    entries = grown;
+    entries_cap = new_cap;
+  }
+  return entries_used++;
+}
+
+static path_id_t path_intern_locked(const char *path, size_t len, uint64_t hash) {
+  if (index_cap) {
+    uint32_t mask = index_cap - 1;
+    for (uint32_t pos = (uint32_t)hash & mask; index_slots[pos]; pos = (pos + 1) & mask) {
+      path_entry_t *e = &entries[index_slots[pos]];
+      if (e->hash == hash && e->len == len && memcmp(e->str, path, len) == 0) {
+        e->refcount++;
+        return index_slots[pos];
+      }
+    }
+  }
+
+  // Keep the index at most half full
+  if ((live_count + 1) * 2 > index_cap && index_grow() == -1) {
+    return PATH_ID_NONE;
+  }
+
+  uint32_t id = entry_alloc();
+  if (!id) {
+    return PATH_ID_NONE;
+  }
+
+  arena_chunk_t *chunk;
+  char *str = arena_alloc((uint32_t)len, &chunk);
+  if (!str) {
+    entries[id].next_free = free_head;
+    free_head = id;
+    return PATH_ID_NONE;
+  }
+  memcpy(str, path, len + 1);
+
+  path_entry_t *e = &entries[id];
+  e->str = str;
+  e->chunk = chunk;
+  e->hash = hash;
+  e->len = (uint32_t)len;
+  e->refcount = 1;
+  e->next_free = 0;
+
+  uint32_t mask = index_cap - 1;
+  uint32_t pos = (uint32_t)hash & mask;
+  while (index_slots[pos]) {
+    pos = (pos + 1) & mask;
+  }
+  index_slots[pos] = id;
+  live_count++;
+  return id;
+}
+
+path_id_t path_intern(const char *path) {
+  if (!path) {
+    return PATH_ID_NONE;
+  }
+
+  // Hash outside the lock; only the table update is serialised
+  size_t len = strlen(path);
+  uint64_t hash = hash_bytes(path, len);
+
+  pthread_mutex_lock(&store_lock);
+  path_id_t id = path_intern_locked(path, len, hash);
+  pthread_mutex_unlock(&store_lock);
+  return id;
+}
+
+void path_ref(path_id_t id) {
+  if (id == PATH_ID_NONE) {
+    return;
+  }
+  pthread_mutex_lock(&store_lock);
+  if (id < entries_used && entries[id].refcount) {
+    entries[id].refcount++;
+  }
+  pthread_mutex_unlock(&store_lock);
+}
+
+static void path_unref_locked(path_id_t id) {
+  if (id >= entries_used || entries[id].refcount == 0) {
+    return;
+  }
+
+  path_entry_t *e = &entries[id];
+  if (--e->refcount) {
+    return;
+  }
+
+  index_remove(id);
+  live_count--;
+
+  arena_chunk_t *chunk = e->chunk;
+  if (--chunk->live == 0) {
+    if (chunk == current_chunk) {
+      chunk->used = 0;
+    } else {
+      free(chunk);
+    }
+  }
+
+  e->str = NULL;
+  e->chunk = NULL;
+  e->next_free = free_head;
+  free_head = id;
+}
+
+void path_unref(path_id_t id) {
+  if (id == PATH_ID_NONE) {
+    return;
+  }
+  pthread_mutex_lock(&store_lock);
+  path_unref_locked(id);
+  pthread_mutex_unlock(&store_lock);
+}
+
+const char *path_lookup(path_id_t id) {
+  if (id == PATH_ID_NONE) {
+    return NULL;
+  }
+
+  // The string itself never moves, so it can be used after unlocking
+  pthread_mutex_lock(&store_lock);
+  const char *str = id < entries_used && entries[id].refcount ? entries[id].str : NULL;
+  pthread_mutex_unlock(&store_lock);
+  return str;
+}
+
+uint32_t path_store_count(void) {
+  pthread_mutex_lock(&store_lock);
+  uint32_t count = live_count;
+  pthread_mutex_unlock(&store_lock);
+  return count;
+}
@@ -0,0 +1,29 @@
+#ifndef PATH_STORE_H
+#define PATH_STORE_H
+
+#include <stdint.h>
+
+// Interned, reference-counted path strings. Every distinct path is stored
+// once in an arena chunk and named by a small integer id; 0 means "no path".
+// All functions are safe to call from several threads.
+typedef uint32_t path_id_t;
+
+#define PATH_ID_NONE 0
+
+// Intern `path` and return its id with one reference taken for the caller
+path_id_t path_intern(const char *path);
+
+// Take another reference on an interned path
+void path_ref(path_id_t id);
+
+// Drop a reference; the string is released once the last one is gone
+void path_unref(path_id_t id);
+
+// Look up the string for an id. The pointer stays valid for as long as the
+// caller holds a reference. Returns NULL for PATH_ID_NONE.
+const char *path_lookup(path_id_t id);
+
+// Number of distinct paths currently interned
+uint32_t path_store_count(void);
+
+#endif /* PATH_STORE_H */
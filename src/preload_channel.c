@@ -0,0 +1,98 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "preload_channel.h"
+
+void preload_verdict_key(const char *path, int op, uint64_t *tag, uint64_t *check) {
+  // FNV-1a and a multiply-xorshift hash, both seeded with the operation
+  uint64_t a = 0xcbf29ce484222325ULL ^ (uint64_t)op;
+  uint64_t b = 0x9e3779b97f4a7c15ULL * (uint64_t)(op + 1);
+  for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+    a = (a ^ *p) * 0x100000001b3ULL;
+    b = (b ^ *p) * 0xff51afd7ed558ccdULL;
+    b ^= b >> 29;
+  }
+  *tag = a ? a : 1;
+  *check = b;
+}
+
+int preload_verdict_lookup(const preload_segment_t *segment, uint64_t tag, uint64_t check) {
+  for (uint64_t i = 0; i < PRELOAD_VERDICT_PROBES; i++) {
+    const preload_verdict_t *slot = &segment->verdicts[(tag + i) & (PRELOAD_VERDICT_SLOTS - 1)];
+    uint64_t seen = atomic_load_explicit(&slot->tag, memory_order_acquire);
+    if (seen == 0) {
+      return -1;
+    }
+    if (seen == tag && slot->check == check) {
+      return (int)slot->allowed;
+    }
+  }
+  return -1;
+}
+
+void preload_verdict_store(preload_segment_t *segment, uint64_t tag, uint64_t check, int allowed) {
+  for (uint64_t i = 0; i < PRELOAD_VERDICT_PROBES; i++) {
+    preload_verdict_t *slot = &segment->verdicts[(tag + i) & (PRELOAD_VERDICT_SLOTS - 1)];
+    uint64_t seen = atomic_load_explicit(&slot->tag, memory_order_relaxed);
+    if (seen == tag && slot->check == check) {
+      return;
+    }
+    if (seen == 0) {
+      slot->check = check;
+      slot->allowed = (uint32_t)allowed;
+      atomic_store_explicit(&slot->tag, tag, memory_order_release);
+      return;
+    }
+  }
+}
+
+preload_segment_t *preload_segment_create(int *fd) {
+  int rw = memfd_create("sandbox-preload", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (rw == -1) {
+    return NULL;
+  }
+  preload_segment_t *segment = MAP_FAILED;
+  if (ftruncate(rw, sizeof(preload_segment_t)) == 0) {
+    segment = mmap(NULL, sizeof(preload_segment_t), PROT_READ | PROT_WRITE, MAP_SHARED, rw, 0);
+  }
+  if (segment == MAP_FAILED) {
+    close(rw);
+    return NULL;
+  }
+  memcpy(segment->magic, PRELOAD_MAGIC, sizeof(PRELOAD_MAGIC));
+
+  // The mapping above stays writable; nobody can make another one or
+  // write through any fd, including ones reopened from /proc. The program
+  // gets a read-only open of it as well, deliberately not close-on-exec
+  // so every exec'd program maps it again.
+  char self[64];
+  snprintf(self, sizeof(self), "/proc/self/fd/%d", rw);
+  if (fcntl(rw, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) == -1 ||
+      (*fd = open(self, O_RDONLY)) == -1) {
+    munmap(segment, sizeof(preload_segment_t));
+    close(rw);
+    return NULL;
+  }
+  close(rw);
+  return segment;
+}
+
+const preload_segment_t *preload_segment_map(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size != sizeof(preload_segment_t)) {
+    return NULL;
+  }
+  const preload_segment_t *segment = mmap(NULL, sizeof(preload_segment_t), PROT_READ, MAP_SHARED, fd, 0);
+  if (segment == MAP_FAILED) {
+    return NULL;
+  }
+  if (memcmp(segment->magic, PRELOAD_MAGIC, sizeof(PRELOAD_MAGIC)) != 0) {
+    munmap((void *)segment, sizeof(preload_segment_t));
+    return NULL;
+  }
+  return segment;
+}
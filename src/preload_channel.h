@@ -0,0 +1,59 @@
+#ifndef PRELOAD_CHANNEL_H
+#define PRELOAD_CHANNEL_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "sandbox_common.h"
+
+// The shared memory between the sandbox and the LD_PRELOAD shim
+// (libsandbox_preload.so) in every sandboxed process: a table of settled
+// (path, operation) verdicts, written only by the sandbox's tracer threads
+// and read lock-free by the shims.
+//
+// The shims only use it to fail a denied call without making it. An
+// allowed call is still made as a raw syscall, so it stops the tracer,
+// which decides it from its own state. The table is a sealed memfd the
+// sandbox maps writable before forking; the program gets a read-only fd
+// to it (its number in PRELOAD_FD_ENV, kept open across exec) and can
+// neither map it writable nor write to it.
+
+#define PRELOAD_MAGIC "SBXPRE2"
+#define PRELOAD_FD_ENV "SANDBOX_PRELOAD_FD"
+
+#define PRELOAD_VERDICT_SLOTS 65536   // Power of two
+#define PRELOAD_VERDICT_PROBES 16
+
+// A settled answer. `tag` is 0 while the slot is empty and is published
+// last, so a reader that sees it also sees `check` and `allowed`.
+typedef struct {
+  _Atomic uint64_t tag;
+  uint64_t check;
+  uint32_t allowed;
+  uint32_t unused;
+} preload_verdict_t;
+
+typedef struct {
+  char magic[8];
+  preload_verdict_t verdicts[PRELOAD_VERDICT_SLOTS];
+} preload_segment_t;
+
+// Key of `op` on `path` in the verdict table: a tag (never 0) and an
+// independent check hash, so a false hit needs both 64-bit hashes to collide
+void preload_verdict_key(const char *path, int op, uint64_t *tag, uint64_t *check);
+
+// The settled answer for a key: 1 allowed, 0 denied, -1 not in the table
+int preload_verdict_lookup(const preload_segment_t *segment, uint64_t tag, uint64_t check);
+
+// Record an answer (sandbox side, one writer at a time). A full probe run
+// drops it.
+void preload_verdict_store(preload_segment_t *segment, uint64_t tag, uint64_t check, int allowed);
+
+// Create the segment as a sealed memfd and map it writable for the
+// sandbox. Sets `*fd` to an inheritable read-only fd for the program.
+// Returns the mapping, or NULL on error.
+preload_segment_t *preload_segment_create(int *fd);
+
+// Map the segment behind `fd` read-only (shim side), or NULL if it is not one
+const preload_segment_t *preload_segment_map(int fd);
+
+#endif /* PRELOAD_CHANNEL_H */
@@ -0,0 +1,28 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include "preload_server.h"
+
+static preload_segment_t *segment = NULL;
+// The table has one writer at a time
+static pthread_mutex_t share_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic uint64_t shared_count = 0;
+
+void preload_server_init(preload_segment_t *seg) {
+  segment = seg;
+}
+
+void preload_server_share(const char *path, int op, int allowed) {
+  if (!segment) {
+    return;
+  }
+  uint64_t tag, check;
+  preload_verdict_key(path, op, &tag, &check);
+  pthread_mutex_lock(&share_lock);
+  preload_verdict_store(segment, tag, check, allowed);
+  pthread_mutex_unlock(&share_lock);
+  atomic_fetch_add_explicit(&shared_count, 1, memory_order_relaxed);
+}
+
+uint64_t preload_server_shared(void) {
+  return atomic_load(&shared_count);
+}
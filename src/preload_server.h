@@ -0,0 +1,21 @@
+#ifndef PRELOAD_SERVER_H
+#define PRELOAD_SERVER_H
+
+#include <stdint.h>
+#include "preload_channel.h"
+
+// The sandbox end of the --preload channel: the tracer threads share
+// every answer they settle without the broker through the verdict table,
+// so the shims can fail the calls it denies without making them.
+
+// Share answers through `segment` from now on
+void preload_server_init(preload_segment_t *segment);
+
+// Record that `op` on `path` is `allowed`. Safe from any tracer thread;
+// does nothing before preload_server_init().
+void preload_server_share(const char *path, int op, int allowed);
+
+// Answers shared so far
+uint64_t preload_server_shared(void);
+
+#endif /* PRELOAD_SERVER_H */
@@ -0,0 +1,388 @@
+// libsandbox_preload.so: loaded into sandboxed programs by --preload.
+// It interposes libc's open, read, write and unlink families and checks
+// those calls in-process against the verdict table the sandbox shares
+// (see preload_channel.h). A call the table denies fails with EPERM
+// without being made; every other call is made as usual and stops the
+// tracer, which stays the one to let it through.
+//
+// Opens always go to the tracer, so its fd tables stay complete. The shim
+// only remembers which path each fd it saw opened refers to, and checks
+// reads and writes on those fds itself.
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "path_policy.h"
+#include "path_resolve.h"
+#include "preload_channel.h"
+
+#define SHIM_EXPORT __attribute__((visibility("default")))
+
+// fds above this are left to the tracer
+#define SHIM_MAX_FDS 4096
+
+// Distinct paths the shim keeps for fds; beyond this, fds are left to the
+// tracer
+#define SHIM_MAX_PATHS 65536
+#define SHIM_PATH_PROBES 64
+
+// What the shim knows about one fd it saw opened. `path` is interned, so
+// a close on one thread never frees it under a read on another. `known`
+// and `allowed` hold one bit per policy_op_t, for verdicts found in the
+// table.
+typedef struct {
+  _Atomic(const char *) path;
+  _Atomic uint32_t known;
+  _Atomic uint32_t allowed;
+} shim_fd_t;
+
+static shim_fd_t fds[SHIM_MAX_FDS];
+// Interned paths, never freed. Slots are claimed with a compare-and-swap,
+// so interning takes no lock and is safe across fork().
+static _Atomic(const char *) paths[SHIM_MAX_PATHS];
+static const preload_segment_t *segment = NULL;
+
+// The libc functions being interposed, looked up on first use
+#define REAL(name) ({                                                   \
+    if (!real_##name) {                                                 \
+      real_##name = (__typeof__(real_##name))dlsym(RTLD_NEXT, #name);   \
+    }                                                                   \
+    real_##name; })
+
+static int (*real_open)(const char *, int, ...);
+static int (*real_open64)(const char *, int, ...);
+static int (*real_openat)(int, const char *, int, ...);
+static int (*real_openat64)(int, const char *, int, ...);
+static int (*real_creat)(const char *, mode_t);
+static int (*real_creat64)(const char *, mode_t);
+static int (*real___open_2)(const char *, int);
+static int (*real___open64_2)(const char *, int);
+static int (*real___openat_2)(int, const char *, int);
+static int (*real___openat64_2)(int, const char *, int);
+static ssize_t (*real_read)(int, void *, size_t);
+static ssize_t (*real___read_chk)(int, void *, size_t, size_t);
+static ssize_t (*real_pread)(int, void *, size_t, off_t);
+static ssize_t (*real_write)(int, const void *, size_t);
+static ssize_t (*real_pwrite)(int, const void *, size_t, off_t);
+static int (*real_unlink)(const char *);
+static int (*real_unlinkat)(int, const char *, int);
+static int (*real_close)(int);
+static int (*real_close_range)(unsigned int, unsigned int, int);
+static int (*real_fclose)(FILE *);
+static int (*real_closedir)(DIR *);
+static int (*real_dup)(int);
+static int (*real_dup2)(int, int);
+static int (*real_dup3)(int, int, int);
+
+__attribute__((constructor)) static void shim_init(void) {
+  const char *fd_text = getenv(PRELOAD_FD_ENV);
+  if (!fd_text) {
+    return;
+  }
+  segment = preload_segment_map(atoi(fd_text));
+}
+
+// Absolute canonical form of `path`, as the tracer would resolve it
+static int resolve(int dirfd, const char *path, char *out) {
+  if (!path) {
+    return -1;
+  }
+  char base[MAX_PATH];
+  const char *anchor = NULL;
+  if (path[0] != '/') {
+    if (dirfd == AT_FDCWD ? !getcwd(base, sizeof(base))
+                          : proc_fd_path(getpid(), dirfd, base, sizeof(base)) == -1) {
+      return -1;
+    }
+    anchor = base;
+  }
+  return path_canonicalize(anchor, path, out, MAX_PATH) == -1 ? -1 : 0;
+}
+
+// Verdict for `op` on `path`: 1 allowed, 0 denied, -1 not settled yet
+static int check_path(policy_op_t op, const char *path) {
+  uint64_t tag, check;
+  preload_verdict_key(path, (int)op, &tag, &check);
+  return preload_verdict_lookup(segment, tag, check);
+}
+
+// Verdict for `op` on the file behind `fd`, as check_path(). Table hits
+// are kept on the fd, so a hot fd costs two loads per call.
+static int check_fd(policy_op_t op, int fd) {
+  if (!segment || fd < 0 || fd >= SHIM_MAX_FDS) {
+    return -1;
+  }
+  shim_fd_t *entry = &fds[fd];
+  uint32_t bit = 1u << op;
+  if (atomic_load_explicit(&entry->known, memory_order_acquire) & bit) {
+    return (atomic_load_explicit(&entry->allowed, memory_order_relaxed) & bit) != 0;
+  }
+  const char *path = atomic_load_explicit(&entry->path, memory_order_acquire);
+  if (!path) {
+    return -1;
+  }
+
+  uint64_t tag, check;
+  preload_verdict_key(path, (int)op, &tag, &check);
+  int verdict = preload_verdict_lookup(segment, tag, check);
+  if (verdict != -1) {
+    if (verdict) {
+      atomic_fetch_or_explicit(&entry->allowed, bit, memory_order_relaxed);
+    }
+    atomic_fetch_or_explicit(&entry->known, bit, memory_order_release);
+  }
+  return verdict;
+}
+
+// The one copy of `path`, or NULL if the table is full or out of memory
+static const char *intern_path(const char *path) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+    hash = (hash ^ *p) * 0x100000001b3ULL;
+  }
+
+  char *copy = NULL;
+  for (uint64_t i = 0; i < SHIM_PATH_PROBES; i++) {
+    _Atomic(const char *) *slot = &paths[(hash + i) & (SHIM_MAX_PATHS - 1)];
+    const char *seen = atomic_load_explicit(slot, memory_order_acquire);
+    if (!seen) {
+      if (!copy && !(copy = strdup(path))) {
+        return NULL;
+      }
+      if (atomic_compare_exchange_strong_explicit(slot, &seen, copy, memory_order_acq_rel,
+                                                  memory_order_acquire)) {
+        return copy;
+      }
+      // Another thread took the slot; `seen` is what it put there
+    }
+    if (strcmp(seen, path) == 0) {
+      free(copy);   // Never published
+      return seen;
+    }
+  }
+  free(copy);
+  return NULL;
+}
+
+static void forget_fd(int fd) {
+  if (fd < 0 || fd >= SHIM_MAX_FDS) {
+    return;
+  }
+  shim_fd_t *entry = &fds[fd];
+  atomic_store_explicit(&entry->path, NULL, memory_order_release);
+  atomic_store_explicit(&entry->known, 0, memory_order_relaxed);
+  atomic_store_explicit(&entry->allowed, 0, memory_order_relaxed);
+}
+
+static void set_fd_path(int fd, const char *path) {
+  forget_fd(fd);
+  if (path) {
+    atomic_store_explicit(&fds[fd].path, path, memory_order_release);
+  }
+}
+
+// After an open the tracer allowed: remember where `fd` points
+static void remember_fd(int fd, int dirfd, const char *path) {
+  if (!segment || fd < 0 || fd >= SHIM_MAX_FDS) {
+    return;
+  }
+  char resolved[MAX_PATH];
+  set_fd_path(fd, resolve(dirfd, path, resolved) == 0 ? intern_path(resolved) : NULL);
+}
+
+static void copy_fd(int oldfd, int newfd) {
+  if (!segment || newfd < 0 || newfd >= SHIM_MAX_FDS) {
+    return;
+  }
+  const char *path = oldfd >= 0 && oldfd < SHIM_MAX_FDS ? atomic_load(&fds[oldfd].path) : NULL;
+  set_fd_path(newfd, path);
+}
+
+// The mode argument of the open family, present when the flags need it
+#define OPEN_MODE(flags, last) ({                       \
+    mode_t mode_ = 0;                                   \
+    if ((flags) & (O_CREAT | O_TMPFILE)) {              \
+      va_list ap_;                                      \
+      va_start(ap_, last);                              \
+      mode_ = va_arg(ap_, mode_t);                      \
+      va_end(ap_);                                      \
+    }                                                   \
+    mode_; })
+
+SHIM_EXPORT int open(const char *path, int flags, ...) {
+  int fd = REAL(open)(path, flags, OPEN_MODE(flags, flags));
+  remember_fd(fd, AT_FDCWD, path);
+  return fd;
+}
+
+SHIM_EXPORT int open64(const char *path, int flags, ...) {
+  int fd = REAL(open64)(path, flags, OPEN_MODE(flags, flags));
+  remember_fd(fd, AT_FDCWD, path);
+  return fd;
+}
+
+SHIM_EXPORT int openat(int dirfd, const char *path, int flags, ...) {
+  int fd = REAL(openat)(dirfd, path, flags, OPEN_MODE(flags, flags));
+  remember_fd(fd, dirfd, path);
+  return fd;
+}
+
+SHIM_EXPORT int openat64(int dirfd, const char *path, int flags, ...) {
+  int fd = REAL(openat64)(dirfd, path, flags, OPEN_MODE(flags, flags));
+  remember_fd(fd, dirfd, path);
+  return fd;
+}
+
+SHIM_EXPORT int creat(const char *path, mode_t mode) {
+  int fd = REAL(creat)(path, mode);
+  remember_fd(fd, AT_FDCWD, path);
+  return fd;
+}
+
+SHIM_EXPORT int creat64(const char *path, mode_t mode) {
+  int fd = REAL(creat64)(path, mode);
+  remember_fd(fd, AT_FDCWD, path);
+  return fd;
+}
+
+// _FORTIFY_SOURCE variants
+SHIM_EXPORT int __open_2(const char *path, int flags) {
+  int fd = REAL(__open_2)(path, flags);
+  remember_fd(fd, AT_FDCWD, path);
+  return fd;
+}
+
+SHIM_EXPORT int __open64_2(const char *path, int flags) {
+  int fd = REAL(__open64_2)(path, flags);
+  remember_fd(fd, AT_FDCWD, path);
+  return fd;
+}
+
+SHIM_EXPORT int __openat_2(int dirfd, const char *path, int flags) {
+  int fd = REAL(__openat_2)(dirfd, path, flags);
+  remember_fd(fd, dirfd, path);
+  return fd;
+}
+
+SHIM_EXPORT int __openat64_2(int dirfd, const char *path, int flags) {
+  int fd = REAL(__openat64_2)(dirfd, path, flags);
+  remember_fd(fd, dirfd, path);
+  return fd;
+}
+
+SHIM_EXPORT ssize_t read(int fd, void *buf, size_t count) {
+  if (check_fd(POLICY_OP_READ, fd) == 0) {
+    errno = EPERM;
+    return -1;
+  }
+  return REAL(read)(fd, buf, count);
+}
+
+SHIM_EXPORT ssize_t __read_chk(int fd, void *buf, size_t count, size_t size) {
+  if (count > size) {
+    return REAL(__read_chk)(fd, buf, count, size);   // Let libc report the overflow
+  }
+  return read(fd, buf, count);
+}
+
+SHIM_EXPORT ssize_t pread(int fd, void *buf, size_t count, off_t offset) {
+  if (check_fd(POLICY_OP_READ, fd) == 0) {
+    errno = EPERM;
+    return -1;
+  }
+  return REAL(pread)(fd, buf, count, offset);
+}
+
+SHIM_EXPORT ssize_t pread64(int fd, void *buf, size_t count, off_t offset) {
+  return pread(fd, buf, count, offset);
+}
+
+SHIM_EXPORT ssize_t write(int fd, const void *buf, size_t count) {
+  if (check_fd(POLICY_OP_WRITE, fd) == 0) {
+    errno = EPERM;
+    return -1;
+  }
+  return REAL(write)(fd, buf, count);
+}
+
+SHIM_EXPORT ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset) {
+  if (check_fd(POLICY_OP_WRITE, fd) == 0) {
+    errno = EPERM;
+    return -1;
+  }
+  return REAL(pwrite)(fd, buf, count, offset);
+}
+
+SHIM_EXPORT ssize_t pwrite64(int fd, const void *buf, size_t count, off_t offset) {
+  return pwrite(fd, buf, count, offset);
+}
+
+SHIM_EXPORT int unlinkat(int dirfd, const char *path, int flags) {
+  char resolved[MAX_PATH];
+  if (segment && resolve(dirfd, path, resolved) == 0 && check_path(POLICY_OP_DELETE, resolved) == 0) {
+    errno = EPERM;
+    return -1;
+  }
+  return REAL(unlinkat)(dirfd, path, flags);
+}
+
+SHIM_EXPORT int unlink(const char *path) {
+  return segment ? unlinkat(AT_FDCWD, path, 0) : REAL(unlink)(path);
+}
+
+// Everything that can close an fd the shim remembers, so a reused number
+// never inherits a stale path
+SHIM_EXPORT int close(int fd) {
+  forget_fd(fd);
+  return REAL(close)(fd);
+}
+
+SHIM_EXPORT int close_range(unsigned int first, unsigned int last, int flags) {
+  if (!(flags & CLOSE_RANGE_CLOEXEC)) {
+    for (unsigned int fd = first; fd <= last && fd < SHIM_MAX_FDS; fd++) {
+      forget_fd((int)fd);
+    }
+  }
+  if (!REAL(close_range)) {
+    errno = ENOSYS;
+    return -1;
+  }
+  return real_close_range(first, last, flags);
+}
+
+SHIM_EXPORT int fclose(FILE *stream) {
+  forget_fd(fileno(stream));
+  return REAL(fclose)(stream);
+}
+
+SHIM_EXPORT int closedir(DIR *dir) {
+  forget_fd(dirfd(dir));
+  return REAL(closedir)(dir);
+}
+
+SHIM_EXPORT int dup(int oldfd) {
+  int fd = REAL(dup)(oldfd);
+  copy_fd(oldfd, fd);
+  return fd;
+}
+
+SHIM_EXPORT int dup2(int oldfd, int newfd) {
+  int fd = REAL(dup2)(oldfd, newfd);
+  if (fd != -1 && oldfd != newfd) {
+    copy_fd(oldfd, fd);
+  }
+  return fd;
+}
+
+SHIM_EXPORT int dup3(int oldfd, int newfd, int flags) {
+  int fd = REAL(dup3)(oldfd, newfd, flags);
+  copy_fd(oldfd, fd);
+  return fd;
+}
@@ -57,12 +57,16 @@
 #define TRUE 1
 #define FALSE 0
 
-// Function to read a string from the child's memory
-char* read_string(pid_t child_pid, unsigned long addr) {
-  static char buffer[MAX_PATH];
-  int i = 0;
+// Function to read a string from the child's memory into a caller-owned
+// buffer. Returns the string length, or -1 if nothing could be read.
+ssize_t read_string(pid_t child_pid, unsigned long addr, char *buf, size_t size) {
+  size_t i = 0;
+
+  if (!buf || size == 0) {
+    return -1;
+  }
   
-  while (i < MAX_PATH - sizeof(long)) {
+  while (i + sizeof(long) <= size - 1) {
     long data;
     
     errno = 0;
@@ -76,22 +80,20 @@ char* read_string(pid_t child_pid, unsigned long addr) {
       break;
     }
     
-    memcpy(buffer + i, &data, sizeof(long));
+    memcpy(buf + i, &data, sizeof(long));
     
     // Check for null terminator in the bytes we just read
-    int j;
-    for (j = 0; j < sizeof(long); j++) {
-      if (buffer[i + j] == '\0') {
-        return buffer;
-      }
+    char *nul = memchr(buf + i, '\0', sizeof(long));
+    if (nul) {
+      return nul - buf;
     }
     
     i += sizeof(long);
   }
   
-  // Ensure null termination
-  buffer[MAX_PATH - 1] = '\0';
-  return buffer;
+  // Terminate after the last byte actually read, never past the buffer
+  buf[i] = '\0';
+  return i > 0 ? (ssize_t)i : -1;
 }
 
 // Check if a file exists (cross-platform)
@@ -363,7 +365,8 @@ int main(int argc, char *argv[]) {
       // Check if it's an unlink syscall
       if (regs.orig_rax == SYS_UNLINK) {
         // Get the file path from the child's memory
-        char* path = read_string(child_pid, regs.rdi);
+        char path[MAX_PATH];
+        read_string(child_pid, regs.rdi, path, sizeof(path));
         
         printf("\n🔔 ALERT: Program is attempting to delete file: %s\n", path);
         printf("Allow this operation? (y/n): ");
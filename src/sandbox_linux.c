@@ -1,141 +1,1316 @@
 /* #define _GNU_SOURCE */
 #include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ptrace.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
-#include <sys/reg.h>
 #include <sys/syscall.h>
-#include <sys/user.h>
+#include <linux/sched.h>
+#include "decision_broker.h"
+#include "event_log.h"
+#include "fd_table.h"
+#include "io_stats.h"
+#include "landlock_policy.h"
+#include "monitor.h"
+#include "notify_backend.h"
+#include "path_resolve.h"
+#include "path_store.h"
+#include "preload_server.h"
 #include "sandbox_common.h"
+#include "sandbox_server.h"
+#include "seccomp_filter.h"
+#include "syscall_profile.h"
+#include "task_table.h"
+#include "tracee_memory.h"
+#include "tracee_regs.h"
+#include "tracer_stats.h"
+#include "trusted_exec.h"
+#include "verdict_cache.h"
 
-// Linux x86_64 syscall numbers
-#define SYS_READ 0
-#define SYS_WRITE 1
-#define SYS_OPEN 2
-#define SYS_OPENAT 257
-#define SYS_UNLINK 87
-#define SYS_UNLINKAT 263
 #define MAX_PATH 4096
 #define TRUE 1
 #define FALSE 0
 
-// Global variables to track open files
-#define MAX_TRACKED_FDS 128
+// Whether the syscall's exit stop is needed to keep the fd table in sync
+int needs_exit_stop(long syscall_nr, const unsigned long *args) {
+  const syscall_desc_t *desc = syscall_desc(syscall_nr);
+  if (!desc) {
+    return 0;
+  }
+  if (syscall_nr == SYS_FCNTL) {
+    int cmd = (int)args[1];
+    return cmd == F_DUPFD || cmd == F_DUPFD_CLOEXEC || cmd == F_SETFD;
+  }
+  return (desc->flags & SYSCALL_EXIT_STOP) != 0;
+}
+
+// Check if a file exists
+int file_exists(const char *filepath) {
+  FILE *file = fopen(filepath, "r");
+  if (file) {
+    fclose(file);
+    return 1;
+  }
+  return 0;
+}
+
+// Set by --seccomp: only monitored syscalls stop the tracee
+int use_seccomp = 0;
+
+// Set by --notify: use the ptrace-free seccomp user-notification backend
+int use_notify = 0;
+
+// Set by --policy: rules deciding which paths are allowed, denied or asked
+const char *policy_file = NULL;
+
+// Set by --remember: where "always" / "never" answers are kept between runs
+const char *answers_file = NULL;
+
+// Set by --timeout, --default and --daemon: how unanswered prompts are settled
+broker_config_t broker_config = { NULL, 0, 0, 0 };
+
+// Set by --log and --log-format: where every decided event is written, and how
+const char *log_filename = NULL;
+event_log_format_t log_format = EVENT_LOG_TEXT;
+
+// Set by --record: trace of every decided event, for sandbox-replay
+const char *record_filename = NULL;
+
+// Set by --batch: no prompts or per-event output, a summary at the end and
+// BATCH_EXIT_DENIED if anything was denied
+int use_batch = 0;
+#define BATCH_EXIT_DENIED 3
+#define BATCH_TOP_DENIED 10
+
+// Set by --tracers: number of tracer threads (default: one per online CPU)
+int num_tracers = 0;
+
+// Set by --stats: keep per-syscall latency histograms for sandbox-top
+int use_stats = 0;
+
+// Set by --io and --io-dump: account reads and writes through tracked fds,
+// report the busiest at exit and optionally dump them all to a file
+int use_io = 0;
+const char *io_dump_filename = NULL;
+#define IO_TOP_ENTRIES 10
+
+// Set by --profile: time every syscall and what the tracer adds to it
+int use_profile = 0;
+
+// Set by --trust: allowlist of executables whose processes are let go
+const char *trust_file = NULL;
+
+// Set by --landlock: leave the policy's static rules to the kernel
+int use_landlock = 0;
+
+// Set by --serve: run jobs from sandbox-run on this socket instead of a program
+const char *serve_socket = NULL;
+
+#ifndef SANDBOX_LIBDIR
+  #define SANDBOX_LIBDIR "/usr/local/lib"
+#endif
+
+// Set by --preload: check libc file calls in-process with libsandbox_preload.so
+int use_preload = 0;
+
+// A task detached by one shard for another to seize
+typedef struct handoff {
+  pid_t tid;
+  fd_table_t *fds;
+  int trusted;
+  struct handoff *next;
+} handoff_t;
+
+// One tracer thread and the tasks it traces. ptrace ties a tracee to the
+// thread that attached it, so a task is only ever touched by its shard.
+// Threads and CLONE_FILES children stay with their parent's shard, which
+// keeps each fd table owned by a single tracer thread.
 typedef struct {
-  int fd;
-  char path[MAX_PATH];
-  int active;
-} tracked_fd_t;
+  int index;
+  pthread_t thread;
+  task_table_t *tasks;
+  _Atomic(handoff_t *) inbox;   // Lock-free stack of incoming handoffs
+  _Atomic(struct decision *) answers;  // Broker answers for parked tasks
+  unsigned int next_ticket;     // Tells answers for a reused tid apart
+  pid_t waker;                  // Traced helper that other shards signal
+  tracer_stats_t *stats;        // This thread's histograms, NULL without --stats
+  io_stats_t *io;               // Reads and writes this thread saw, NULL without --io
+  syscall_profile_t *profile;   // Syscalls this thread timed, NULL without --profile
+} shard_t;
+
+// A broker answer for a task parked at syscall entry
+typedef struct decision {
+  shard_t *shard;
+  pid_t tid;
+  unsigned int ticket;
+  int allowed;
+  struct decision *next;
+} decision_t;
+
+static shard_t *shards = NULL;
+static atomic_uint next_shard;
+
+// Tasks alive across all shards, plus handoffs in flight
+static atomic_int live_tasks;
+
+// The sandboxed program itself, whose exit the main thread reports
+static pid_t program_pid = -1;
+
+// Its wait status once it is gone, -1 before
+static int program_status = -1;
+
+// Processes detached after exec'ing a trusted executable
+static atomic_ulong detached_count;
+
+// Options for PTRACE_SETOPTIONS, also used when seizing a handed-off task
+static int trace_options = 0;
+
+// Lets every shard start its waker before the program runs
+static pthread_barrier_t shards_ready;
+
+// A shard spends its time blocked in waitpid(), which only returns for its
+// own tracees. To wake it, each shard traces a helper process that just
+// sleeps: signalling the helper produces a ptrace stop the shard reaps
+// like any other, so a wakeup is queued by the kernel and never lost.
+static void start_waker(shard_t *shard) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    for (;;) {
+      pause();
+    }
+  }
+  if (pid == -1 || ptrace(PTRACE_SEIZE, pid, NULL, PTRACE_O_EXITKILL) == -1) {
+    perror("tracer waker");
+    if (pid > 0) {
+      kill(pid, SIGKILL);
+      waitpid(pid, NULL, __WALL);
+    }
+    exit(1);
+  }
+  shard->waker = pid;
+}
+
+static void stop_waker(shard_t *shard) {
+  int status;
+  kill(shard->waker, SIGKILL);
+  while (waitpid(shard->waker, &status, __WALL) == shard->waker && WIFSTOPPED(status)) {
+  }
+}
+
+static void wake_shard(shard_t *shard) {
+  if (!pthread_equal(shard->thread, pthread_self())) {
+    kill(shard->waker, SIGUSR1);
+  }
+}
+
+// Drop one live task; the last one lets idle shards exit
+static void release_live_task(void) {
+  if (atomic_fetch_sub(&live_tasks, 1) == 1) {
+    for (int i = 0; i < num_tracers; i++) {
+      wake_shard(&shards[i]);
+    }
+  }
+}
+
+static task_t *shard_add_task(shard_t *shard, pid_t tid) {
+  int created;
+  task_t *task = task_add(shard->tasks, tid, &created);
+  if (task && created) {
+    atomic_fetch_add(&live_tasks, 1);
+  }
+  return task;
+}
+
+static void shard_remove_task(shard_t *shard, pid_t tid) {
+  if (task_find(shard->tasks, tid)) {
+    task_remove(shard->tasks, tid);
+    release_live_task();
+  }
+}
+
+// Resume a stopped task, delivering `sig`. In seccomp mode the kernel
+// stops the task for us, so plain PTRACE_CONT is enough unless the task
+// asked for the exit stop of the syscall it is in.
+int resume_task(task_t *task, int sig) {
+  int request = (use_seccomp && !task->in_syscall) ? PTRACE_CONT : PTRACE_SYSCALL;
+  if (ptrace(request, task->tid, NULL, sig) == -1) {
+    // The task may have been killed meanwhile (e.g. by another thread's exec)
+    if (errno != ESRCH) {
+      perror("ptrace resume");
+    }
+    return -1;
+  }
+  return 0;
+}
+
+// Record how long a task sat in the syscall stop it has just left
+static void record_stop(shard_t *shard, task_t *task) {
+  if (task->stopped_ns) {
+    tracer_stats_record(shard->stats, task->syscall_nr, STAT_STOP, task->stopped_ns);
+    task->stopped_ns = 0;
+  }
+}
+
+// A task in a profiled syscall has stopped at `reaped`: it was running
+// in the kernel since it was last resumed
+static void profile_stopped(task_t *task, uint64_t reaped) {
+  if (task->profile_resumed_ns) {
+    task->profile_kernel_ns += reaped - task->profile_resumed_ns;
+    task->profile_resumed_ns = 0;
+  }
+}
+
+// A task has entered a syscall at `reaped`; `peeking` is when the tracer
+// started asking ptrace which one
+static void profile_entered(shard_t *shard, task_t *task, uint64_t reaped, uint64_t peeking) {
+  syscall_profile_enter(shard->profile, task->syscall_nr);
+  syscall_profile_part(shard->profile, task->syscall_nr, PROFILE_PTRACE, peeking);
+  task->profile_start_ns = reaped;
+  task->profile_resumed_ns = 0;
+  task->profile_kernel_ns = 0;
+  task->profile_tracer_ns = 0;
+}
+
+// A task stopped at `reaped` has been resumed by a request sent at
+// `resuming`. After the exit stop (`exited`) its syscall is complete.
+static void profile_resumed(shard_t *shard, task_t *task, uint64_t reaped, uint64_t resuming,
+                            const syscall_info_t *exited) {
+  if (!task->profile_start_ns) {
+    return;
+  }
+  syscall_profile_part(shard->profile, task->syscall_nr, PROFILE_PTRACE, resuming);
+  uint64_t now = syscall_profile_start(shard->profile);
+  task->profile_tracer_ns += now - reaped;
+  task->profile_resumed_ns = now;
+  if (exited) {
+    syscall_profile_exit(shard->profile, task->syscall_nr, exited->ret, now - task->profile_start_ns,
+                         task->profile_kernel_ns, task->profile_tracer_ns);
+    task->profile_start_ns = 0;
+    task->profile_resumed_ns = 0;
+  }
+}
+
+// Record the syscall a task has just entered. The arguments are kept so
+// the exit stop does not depend on the argument registers surviving.
+void enter_syscall(task_t *task, const syscall_info_t *info) {
+  task->in_syscall = 1;
+  task->syscall_nr = info->nr;
+  memcpy(task->args, info->args, sizeof(task->args));
+}
+
+// Outcome of handle_syscall_entry()
+#define ENTRY_ALLOWED 0
+#define ENTRY_DENIED 1
+#define ENTRY_PENDING 2   // Parked until the decision broker answers
+
+// Called on the broker thread: queue the answer for the task's shard
+static void deliver_decision(void *ctx, int allowed) {
+  decision_t *decision = ctx;
+  shard_t *shard = decision->shard;
+  decision->allowed = allowed;
+
+  decision_t *head = atomic_load(&shard->answers);
+  do {
+    decision->next = head;
+  } while (!atomic_compare_exchange_weak(&shard->answers, &head, decision));
+  wake_shard(shard);
+}
+
+// Let the syscall a task is stopped in proceed, or make it fail with EPERM
+static int apply_decision(task_t *task, int allowed) {
+  if (allowed) {
+    return ENTRY_ALLOWED;
+  }
+
+  // No fd will come of it
+  task_clear_path(task);
+
+  // Skip the syscall with EPERM already in place as its return value; in
+  // seccomp mode this spares us the exit stop entirely
+  if (tracee_skip_syscall(task->tid, -EPERM) == -1 && errno != ESRCH) {
+    perror("ptrace skip syscall");
+  }
+  return ENTRY_DENIED;
+}
+
+// What decode_event() reads a traced task's operands through
+typedef struct {
+  shard_t *shard;
+  task_t *task;
+} path_reader_t;
+
+static ssize_t read_path(void *ctx, unsigned long addr, char *buf, size_t size) {
+  path_reader_t *reader = ctx;
+  uint64_t start = tracer_stats_start(reader->shard->stats);
+  uint64_t profiled = syscall_profile_start(reader->shard->profile);
+  ssize_t len = read_string(reader->task->tid, addr, buf, size);
+  tracer_stats_record(reader->shard->stats, reader->task->syscall_nr, STAT_READ_STRING, start);
+  syscall_profile_part(reader->shard->profile, reader->task->syscall_nr, PROFILE_MEMORY, profiled);
+  if (len < 0) {
+    buf[0] = '\0';
+  }
+  return len;
+}
+
+static const char *fd_path(void *ctx, int fd, char *buf, size_t size, path_id_t *id) {
+  (void)buf;
+  (void)size;
+  path_reader_t *reader = ctx;
+  *id = fd_table_get(reader->task->fds, fd);
+  return path_lookup(*id); // NULL for untracked fds
+}
+
+static ssize_t read_path_memory(void *ctx, unsigned long addr, void *buf, size_t size) {
+  path_reader_t *reader = ctx;
+  uint64_t profiled = syscall_profile_start(reader->shard->profile);
+  ssize_t len = read_memory(reader->task->tid, addr, buf, size);
+  syscall_profile_part(reader->shard->profile, reader->task->syscall_nr, PROFILE_MEMORY, profiled);
+  return len;
+}
+
+// Directory a relative path of `task` is resolved against: the tracked
+// path of `dirfd` or the cached cwd. Only a miss costs a readlink, and
+// its answer is kept until a close, chdir or fchdir makes it stale. A
+// dirfd is kept with its real close-on-exec flag, so an exec drops it
+// when the kernel does; if the flag cannot be read it is not kept.
+static const char *base_path(void *ctx, int dirfd, char *buf, size_t size) {
+  path_reader_t *reader = ctx;
+  task_t *task = reader->task;
+  path_id_t id = dirfd == AT_FDCWD ? task->fds->cwd : fd_table_get(task->fds, dirfd);
+  if (id != PATH_ID_NONE) {
+    return path_lookup(id);
+  }
+
+  if (proc_fd_path(task->tid, dirfd == AT_FDCWD ? -1 : dirfd, buf, size) == -1) {
+    return NULL;
+  }
+  if (dirfd == AT_FDCWD) {
+    id = path_intern(buf);
+    fd_table_set_cwd(task->fds, id);
+    path_unref(id);
+  } else {
+    int cloexec = proc_fd_cloexec(task->tid, dirfd);
+    if (cloexec != -1) {
+      id = path_intern(buf);
+      fd_table_set(task->fds, dirfd, id, cloexec ? FD_ENTRY_CLOEXEC : 0);
+      path_unref(id);
+    }
+  }
+  return buf;
+}
+
+// The fd a read or write goes through and the flag its verdict is kept
+// under, or -1 for any other syscall
+static int verdict_fd(const task_t *task, const syscall_desc_t *desc, unsigned int *op_flag) {
+  const operand_desc_t *operand = &desc->operand[0];
+  if (operand->fd < 0 || desc->operand[1].fd >= 0 || desc->operand[1].path >= 0) {
+    return -1;
+  }
+  if (operand->op == POLICY_OP_READ) {
+    *op_flag = FD_ENTRY_READ_OK;
+  } else if (operand->op == POLICY_OP_WRITE) {
+    *op_flag = FD_ENTRY_WRITE_OK;
+  } else {
+    return -1;
+  }
+  return (int)task->args[operand->fd];
+}
+
+// A read or write through an untracked fd, or one whose verdict is
+// already known, is allowed without decoding or asking the policy: a
+// single lookup in the fd table
+static int known_allowed(const task_t *task, const syscall_desc_t *desc, unsigned int generation) {
+  unsigned int op_flag;
+  int fd = verdict_fd(task, desc, &op_flag);
+  if (fd == -1) {
+    return 0;
+  }
+  if (fd_table_get(task->fds, fd) == PATH_ID_NONE) {
+    return 1;
+  }
+  // Unless the event has to be logged
+  if (event_log_wants_allowed() || !fd_table_allowed(task->fds, fd, op_flag, generation)) {
+    return 0;
+  }
+  event_log_count_allowed();
+  return 1;
+}
+
+// The tracked fd a read or write that --io accounts goes through, or -1.
+// ftruncate and fallocate are writes to the policy but move no data.
+static int io_fd(const task_t *task, int *write) {
+  const syscall_desc_t *desc = syscall_desc(task->syscall_nr);
+  unsigned int op_flag;
+  if (!desc || task->syscall_nr == SYS_FTRUNCATE || task->syscall_nr == SYS_FALLOCATE) {
+    return -1;
+  }
+  int fd = verdict_fd(task, desc, &op_flag);
+  if (fd == -1 || fd_table_get(task->fds, fd) == PATH_ID_NONE) {
+    return -1;
+  }
+  *write = op_flag == FD_ENTRY_WRITE_OK;
+  return fd;
+}
+
+// Whether the syscall a task is in has to stop again at its exit: to keep
+// the fd table in sync, or for --io to see how much was transferred
+static int wants_exit_stop(const shard_t *shard, const task_t *task) {
+  int write;
+  return needs_exit_stop(task->syscall_nr, task->args) || (shard->io && io_fd(task, &write) != -1);
+}
+
+// Account a read or write that has just returned `ret`
+static void account_io(shard_t *shard, const task_t *task, long ret) {
+  int write;
+  int fd = io_fd(task, &write);
+  if (fd == -1) {
+    return;
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  io_stats_add(shard->io, task->tid, fd, fd_table_get(task->fds, fd), write, ret,
+               (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec);
+}
+
+// Inspect a monitored syscall at entry. Returns ENTRY_ALLOWED or
+// ENTRY_DENIED, or ENTRY_PENDING if the task must stay stopped until
+// the broker answers.
+int handle_syscall_entry(shard_t *shard, task_t *task) {
+  char paths[2][MAX_PATH];
+  monitor_event_t event;
+  long nr = task->syscall_nr;
+  const syscall_desc_t *desc = syscall_desc(nr);
+
+  // Read before deciding, so an answer remembered meanwhile invalidates
+  // the verdict this decision leaves on the fd
+  unsigned int generation = verdict_cache_generation();
+  if (known_allowed(task, desc, generation)) {
+    return ENTRY_ALLOWED;
+  }
+
+  init_event(&event, task->tid, nr);
+  operand_reader_t reader = { read_path, fd_path, read_path_memory, base_path,
+                              &(path_reader_t){ shard, task } };
+  decode_event(&event, task->args, &reader, paths);
+
+  // Keep the path for the exit stop, which records the new fd
+  if (desc->flags & SYSCALL_NEW_FD) {
+    task->path = path_intern(paths[0]);
+    task->open_flags = event.flags;
+    event.path_id = task->path;
+  }
+  if (task->trusted) {
+    return ENTRY_ALLOWED;
+  }
+
+  decision_t *decision = malloc(sizeof(decision_t));
+  if (!decision) {
+    perror("malloc");
+    return apply_decision(task, 0);
+  }
+  decision->shard = shard;
+  decision->tid = task->tid;
+  // Ticket 0 means "not waiting"
+  if (++shard->next_ticket == 0) {
+    shard->next_ticket = 1;
+  }
+  decision->ticket = shard->next_ticket;
+
+  uint64_t start = tracer_stats_start(shard->stats);
+  uint64_t profiled = syscall_profile_start(shard->profile);
+  int allowed = decide_event(&event, deliver_decision, decision);
+  tracer_stats_record(shard->stats, nr, STAT_POLICY, start);
+  syscall_profile_part(shard->profile, nr, PROFILE_POLICY, profiled);
+  if (allowed == DECISION_PENDING) {
+    task->decision = decision->ticket;
+    task->parked_ns = tracer_stats_start(shard->stats);
+    return ENTRY_PENDING;
+  }
+  free(decision);
+
+  // The shims can now fail this call in-process the next time
+  if (use_preload && event.path && !event.unresolved && desc->operand[1].path == -1 && desc->operand[1].fd == -1) {
+    preload_server_share(event.path, (int)event.op, allowed);
+  }
+
+  // Later reads or writes through the same fd can skip all of the above
+  unsigned int op_flag;
+  int fd = allowed == 1 ? verdict_fd(task, desc, &op_flag) : -1;
+  if (fd != -1) {
+    fd_table_allow(task->fds, fd, op_flag, generation);
+  }
+  return apply_decision(task, allowed);
+}
+
+// Resume a task parked at syscall entry once its answer has arrived
+static void resume_decided_task(shard_t *shard, task_t *task, int allowed) {
+  int blocked = apply_decision(task, allowed);
+  if (use_seccomp && (blocked || !wants_exit_stop(shard, task))) {
+    task->in_syscall = 0;
+    task_clear_path(task);
+  }
+  uint64_t resuming = syscall_profile_start(shard->profile);
+  resume_task(task, 0);
+  record_stop(shard, task);
+  if (task->profile_start_ns) {
+    // The wait for the answer was neither kernel nor tracer time
+    syscall_profile_part(shard->profile, task->syscall_nr, PROFILE_PTRACE, resuming);
+    task->profile_resumed_ns = syscall_profile_start(shard->profile);
+  }
+}
+
+// Apply the broker answers that arrived for this shard
+static void apply_answers(shard_t *shard) {
+  decision_t *decision = atomic_exchange(&shard->answers, NULL);
+  while (decision) {
+    decision_t *next = decision->next;
+    // The task may have been killed while it waited
+    task_t *task = task_find(shard->tasks, decision->tid);
+    if (task && task->decision == decision->ticket) {
+      task->decision = 0;
+      tracer_stats_record(shard->stats, task->syscall_nr, STAT_DECISION, task->parked_ns);
+      task->parked_ns = 0;
+      resume_decided_task(shard, task, decision->allowed);
+    }
+    free(decision);
+    decision = next;
+  }
+}
+
+// Track a successful open: the new fd now refers to the path captured at entry
+void track_open(task_t *task, int new_fd, int flags) {
+  if (task->path == PATH_ID_NONE) {
+    return;
+  }
+  fd_table_set(task->fds, new_fd, task->path, (flags & O_CLOEXEC) ? FD_ENTRY_CLOEXEC : 0);
+
+  // Settle reads and writes through it now, for the access it was opened
+  // with, so they never need the policy
+  unsigned int generation = verdict_cache_generation();
+  const char *path = path_lookup(task->path);
+  int mode = flags & O_ACCMODE;
+  unsigned int allowed = 0;
+  if (mode != O_WRONLY && monitor_allows(path, POLICY_OP_READ)) {
+    allowed |= FD_ENTRY_READ_OK;
+  }
+  if (mode != O_RDONLY && monitor_allows(path, POLICY_OP_WRITE)) {
+    allowed |= FD_ENTRY_WRITE_OK;
+  }
+  fd_table_allow(task->fds, new_fd, allowed, generation);
+}
+
+// Handle fd bookkeeping that can be done at syscall entry
+void handle_fd_syscall_entry(task_t *task) {
+  // close() releases the fd even when it reports an error
+  if (task->syscall_nr == SYS_CLOSE) {
+    fd_table_close(task->fds, (int)task->args[0]);
+  }
+}
+
+// Handle a syscall-exit stop for the syscall the task entered
+void handle_syscall_exit(shard_t *shard, task_t *task, long ret) {
+  unsigned long *args = task->args;
+  fd_table_t *fds = task->fds;
+
+  if (shard->io) {
+    account_io(shard, task, ret);
+  }
+
+  if (ret >= 0 && task->path != PATH_ID_NONE) {
+    track_open(task, (int)ret, task->open_flags);
+  } else if (ret >= 0) {
+    switch (task->syscall_nr) {
+      case SYS_DUP:
+        fd_table_dup(fds, (int)args[0], (int)ret, 0);
+        break;
+#ifdef SYS_DUP2
+      case SYS_DUP2:
+        fd_table_dup(fds, (int)args[0], (int)args[1], 0);
+        break;
+#endif
+      case SYS_DUP3:
+        fd_table_dup(fds, (int)args[0], (int)args[1],
+                     ((int)args[2] & O_CLOEXEC) ? FD_ENTRY_CLOEXEC : 0);
+        break;
+      case SYS_FCNTL: {
+        int cmd = (int)args[1];
+        if (cmd == F_DUPFD) {
+          fd_table_dup(fds, (int)args[0], (int)ret, 0);
+        } else if (cmd == F_DUPFD_CLOEXEC) {
+          fd_table_dup(fds, (int)args[0], (int)ret, FD_ENTRY_CLOEXEC);
+        } else if (cmd == F_SETFD) {
+          fd_table_set_cloexec(fds, (int)args[0], (int)args[2] & FD_CLOEXEC);
+        }
+        break;
+      }
+      case SYS_CLOSE_RANGE:
+        fd_table_close_range(fds, (unsigned int)args[0], (unsigned int)args[1],
+                             (unsigned int)args[2]);
+        break;
+      case SYS_CHDIR:
+        // Read back from /proc on the next relative path
+        fd_table_set_cwd(fds, PATH_ID_NONE);
+        break;
+      case SYS_FCHDIR:
+        fd_table_set_cwd(fds, fd_table_get(fds, (int)args[0]));
+        break;
+    }
+  }
+  task->in_syscall = 0;
+  task_clear_path(task);
+}
+
+// Move a task stopped at its initial SIGSTOP to the shard it was assigned.
+// Detaching with SIGSTOP keeps it stopped until the target has seized it.
+void hand_off_task(shard_t *shard, task_t *task) {
+  shard_t *target = &shards[task->move_to];
+  handoff_t *handoff = malloc(sizeof(handoff_t));
+  if (!handoff || ptrace(PTRACE_DETACH, task->tid, NULL, SIGSTOP) == -1) {
+    if (handoff) {
+      perror("ptrace detach for handoff");
+    }
+    free(handoff);
+    // Keep tracing it here instead
+    task->move_to = -1;
+    resume_task(task, 0);
+    return;
+  }
+
+  handoff->tid = task->tid;
+  handoff->fds = task->fds;
+  handoff->trusted = task->trusted;
+  task->fds = NULL;
+
+  // The handoff counts as live until it is seized
+  atomic_fetch_add(&live_tasks, 1);
+  shard_remove_task(shard, handoff->tid);
+
+  handoff->next = atomic_load(&target->inbox);
+  while (!atomic_compare_exchange_weak(&target->inbox, &handoff->next, handoff)) {
+  }
+  wake_shard(target);
+}
+
+// Let a new task run once its initial stop has been consumed
+void start_task(shard_t *shard, task_t *task) {
+  if (task->move_to >= 0) {
+    hand_off_task(shard, task);
+  } else {
+    resume_task(task, 0);
+  }
+}
+
+// Attach to the tasks other shards handed to this one
+void seize_handoffs(shard_t *shard) {
+  handoff_t *handoff = atomic_exchange(&shard->inbox, NULL);
+  while (handoff) {
+    handoff_t *next = handoff->next;
+
+    task_t *task = shard_add_task(shard, handoff->tid);
+    if (task) {
+      task->fds = handoff->fds;
+      task->trusted = handoff->trusted;
+      task->handed_off = 1;
+      handoff->fds = NULL;
+      if (ptrace(PTRACE_SEIZE, handoff->tid, NULL, trace_options) == -1) {
+        // Never let a task run unmonitored
+        perror("ptrace seize");
+        kill(handoff->tid, SIGKILL);
+        shard_remove_task(shard, handoff->tid);
+      }
+    } else {
+      perror("task table");
+      kill(handoff->tid, SIGKILL);
+    }
+
+    fd_table_release(handoff->fds);
+    free(handoff);
+    release_live_task();
+    handoff = next;
+  }
+}
+
+// A traced task forked or cloned: give the new task its file table and
+// pick the shard that will trace it
+void handle_new_task(shard_t *shard, task_t *parent) {
+  unsigned long new_tid;
+  if (ptrace(PTRACE_GETEVENTMSG, parent->tid, NULL, &new_tid) == -1) {
+    perror("ptrace geteventmsg");
+    return;
+  }
+  long nr;
+  unsigned long arg0;
+  if (tracee_current_syscall(parent->tid, &nr, &arg0) == -1) {
+    perror("ptrace peekuser");
+    return;
+  }
+
+  // fork() and vfork() always copy the table; clone() shares it with CLONE_FILES
+  unsigned long flags = 0;
+  if (nr == SYS_CLONE) {
+    flags = arg0;
+  } else if (nr == SYS_CLONE3) {
+    // struct clone_args starts with the flags
+    uint64_t clone_flags = 0;
+    if (read_memory(parent->tid, arg0, &clone_flags, sizeof(clone_flags)) == sizeof(clone_flags)) {
+      flags = clone_flags;
+    }
+  }
 
-tracked_fd_t tracked_fds[MAX_TRACKED_FDS] = {0};
+  task_t *child = shard_add_task(shard, (pid_t)new_tid);
+  if (!child) {
+    perror("task table");
+    return;
+  }
+  child->trusted = parent->trusted;
+  if (!child->fds) {
+    if (flags & CLONE_FILES) {
+      fd_table_ref(parent->fds);
+      child->fds = parent->fds;
+    } else {
+      child->fds = fd_table_clone(parent->fds);
+    }
+  }
+
+  // New processes are spread over the shards round-robin. A handed-off
+  // task is untraced until its new shard seizes it, and a SIGCONT from
+  // its parent can let it run meanwhile; only the seccomp filter makes
+  // that safe, by failing its monitored syscalls with ENOSYS while no
+  // tracer is attached.
+  if (num_tracers > 1 && use_seccomp && !(flags & (CLONE_THREAD | CLONE_FILES))) {
+    int target = (int)(atomic_fetch_add(&next_shard, 1) % (unsigned int)num_tracers);
+    if (target != shard->index) {
+      child->move_to = target;
+    }
+  }
+
+  // The child stopped before this event arrived; it can go now
+  if (child->parked) {
+    child->parked = 0;
+    start_task(shard, child);
+  }
+}
+
+// A traced task completed an exec. Returns 1 if the task was detached
+// because it now runs a trusted executable.
+int handle_exec(shard_t *shard, task_t *task) {
+  unsigned long former_tid;
+  if (ptrace(PTRACE_GETEVENTMSG, task->tid, NULL, &former_tid) == -1) {
+    former_tid = (unsigned long)task->tid;
+  }
+
+  // A non-leader thread called exec: it now runs under the leader's tid
+  // and its execve() exit stop is reported there
+  if ((pid_t)former_tid != task->tid) {
+    task_t *execer = task_find(shard->tasks, (pid_t)former_tid);
+    if (execer) {
+      task->in_syscall = execer->in_syscall;
+      task->syscall_nr = execer->syscall_nr;
+      memcpy(task->args, execer->args, sizeof(task->args));
+      shard_remove_task(shard, (pid_t)former_tid);
+    }
+  }
+
+  // exec unshares the file table, then closes the close-on-exec fds
+  if (task->fds && task->fds->refcount > 1) {
+    fd_table_t *own = fd_table_clone(task->fds);
+    fd_table_release(task->fds);
+    task->fds = own;
+  }
+  fd_table_exec(task->fds);
+
+  if (!trust_file) {
+    return 0;
+  }
+  task->trusted = trusted_exec_check(task->tid);
+  // Let a trusted process and everything it starts run untraced. With
+  // --seccomp that cannot be done (an untraced SECCOMP_RET_TRACE fails
+  // with ENOSYS), and the program's own exit status is reaped here, so
+  // those stay traced and only skip their checks.
+  if (!task->trusted || use_seccomp || task->tid == program_pid) {
+    return 0;
+  }
+  if (ptrace(PTRACE_DETACH, task->tid, NULL, NULL) == -1) {
+    if (errno != ESRCH) {
+      perror("ptrace detach trusted");
+    }
+    return 0;
+  }
+  atomic_fetch_add(&detached_count, 1);
+  shard_remove_task(shard, task->tid);
+  return 1;
+}
+
+// Trace the tasks of one shard until every task of every shard is gone
+void trace_loop(shard_t *shard, pid_t root_pid) {
+  int status;
+  syscall_info_t info;
+
+  // Run until every task on every shard has exited
+  while (atomic_load(&live_tasks) > 0) {
+    if (atomic_load(&shard->inbox)) {
+      seize_handoffs(shard);
+      continue;
+    }
+    if (atomic_load(&shard->answers)) {
+      apply_answers(shard);
+      continue;
+    }
+
+    pid_t tid = waitpid(-1, &status, __WALL | __WNOTHREAD);
+    if (tid == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("waitpid");
+      break;
+    }
+    // When the stop was reaped, for --stats and --profile (0 without them)
+    uint64_t reaped = shard->stats ? tracer_stats_start(shard->stats) : syscall_profile_start(shard->profile);
+
+    if (tid == shard->waker) {
+      // Woken by another shard; resume the waker without its signal
+      if (WIFSTOPPED(status)) {
+        ptrace(PTRACE_CONT, tid, NULL, NULL);
+      }
+      continue;
+    }
+    
+    // Check if the task has exited
+    if (WIFEXITED(status) || WIFSIGNALED(status)) {
+      if (tid == root_pid) {
+        program_status = status;
+      }
+      if (tid == root_pid && WIFEXITED(status)) {
+        printf("Child process exited with status %d\n", WEXITSTATUS(status));
+      } else if (tid == root_pid) {
+        printf("Child process terminated by signal %d\n", WTERMSIG(status));
+      }
+      shard_remove_task(shard, tid);
+      continue;
+    }
+    if (!WIFSTOPPED(status)) {
+      continue;
+    }
+
+    // A new task can report its first stop before its parent's fork event
+    task_t *task = shard_add_task(shard, tid);
+    if (!task) {
+      perror("task table");
+      break;
+    }
+
+    if (task->profile_start_ns) {
+      profile_stopped(task, reaped);
+    }
+
+    int event = status >> 16;
+    const syscall_info_t *exited = NULL;    // Set at a syscall's exit stop
+
+    // Auto-attached tasks start with a SIGSTOP that is not meant for them
+    if (!task->started && WSTOPSIG(status) == SIGSTOP) {
+      task->started = 1;
+
+      // A handed-off task may already be in the group-stop our SIGSTOP
+      // caused. Resuming it would only stop it again, so end the stop with
+      // SIGCONT (the parent sees it as stopped and continued).
+      if (task->handed_off && event == PTRACE_EVENT_STOP) {
+        task->sigcont_sent = 1;
+        kill(tid, SIGCONT);
+      }
+      if (!task->fds) {
+        // Wait for the fork event to say which file table it has
+        task->parked = 1;
+      } else {
+        start_task(shard, task);
+      }
+      continue;
+    }
+
+    // Check if this is a seccomp-stop (only filtered syscalls get here)
+    if (event == PTRACE_EVENT_SECCOMP) {
+      if (tracee_syscall_info(tid, SYSCALL_STOP_SECCOMP, &info) == -1) {
+        perror("ptrace syscall info");
+        continue;
+      }
+      task->stopped_ns = reaped;
+
+      enter_syscall(task, &info);
+      int blocked = 0;
+      if (is_monitored_syscall(task->syscall_nr)) {
+        int entry = handle_syscall_entry(shard, task);
+        if (entry == ENTRY_PENDING) {
+          continue;
+        }
+        blocked = entry == ENTRY_DENIED;
+      } else {
+        handle_fd_syscall_entry(task);
+      }
 
-// Helper function to check if the path should be monitored
-int should_monitor_path(const char* path) {
-  if (!path) return 0;
-  
-  // Skip system libraries and other system paths
-  if (strncmp(path, "/etc/", 5) == 0 ||
-      strncmp(path, "/usr/lib/", 9) == 0 ||
-      strncmp(path, "/lib/", 5) == 0 ||
-      strncmp(path, "/dev/", 5) == 0 ||
-      strncmp(path, "/proc/", 6) == 0 ||
-      strncmp(path, "/sys/", 5) == 0) {
-    return 0;
+      // Only ask for the exit stop when the result changes the fd table,
+      // or is a transfer --io accounts
+      if (blocked || !wants_exit_stop(shard, task)) {
+        task->in_syscall = 0;
+        task_clear_path(task);
+      }
+    } else if (event == PTRACE_EVENT_FORK || event == PTRACE_EVENT_VFORK ||
+               event == PTRACE_EVENT_CLONE) {
+      handle_new_task(shard, task);
+    } else if (event == PTRACE_EVENT_EXEC) {
+      // The exec succeeded: close-on-exec fds are gone
+      if (handle_exec(shard, task)) {
+        continue;
+      }
+    } else if (event == PTRACE_EVENT_STOP && WSTOPSIG(status) != SIGTRAP) {
+      // Group-stop of a seized task: stay stopped until SIGCONT. (With
+      // SIGTRAP it is only the notification that a SIGCONT arrived.)
+      if (ptrace(PTRACE_LISTEN, tid, NULL, NULL) == -1 && errno != ESRCH) {
+        perror("ptrace listen");
+      }
+      continue;
+    } else if (event) {
+      // Other ptrace events need no handling
+    } else if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+      // Syscall-stop. The kernel says whether it is an entry or an exit,
+      // so a missed stop (e.g. around an exec) cannot flip the two.
+      syscall_stop_t guess = task->in_syscall ? SYSCALL_STOP_EXIT : SYSCALL_STOP_ENTRY;
+      uint64_t peeking = syscall_profile_start(shard->profile);
+      if (tracee_syscall_info(tid, guess, &info) == -1) {
+        perror("ptrace syscall info");
+        continue;
+      }
+      task->stopped_ns = reaped;
+      
+      if (info.stop == SYSCALL_STOP_ENTRY && !tracee_native_syscall(&info)) {
+        // An i386 or x32 syscall: its number would be looked up in the
+        // wrong table, so it is refused before it runs. The task is left
+        // out of the syscall, so its exit stop is ignored.
+        if (tracee_skip_syscall(tid, -EPERM) == -1 && errno != ESRCH) {
+          perror("ptrace skip syscall");
+        }
+      } else if (info.stop == SYSCALL_STOP_ENTRY) {
+        enter_syscall(task, &info);
+        if (shard->profile) {
+          profile_entered(shard, task, reaped, peeking);
+        }
+        
+        // Check for monitored syscalls
+        if (is_monitored_syscall(task->syscall_nr)) {
+          if (handle_syscall_entry(shard, task) == ENTRY_PENDING) {
+            if (task->profile_start_ns) {
+              task->profile_tracer_ns += syscall_profile_start(shard->profile) - reaped;
+            }
+            continue;
+          }
+        } else if (syscall_desc(task->syscall_nr)) {
+          handle_fd_syscall_entry(task);
+        }
+      } else if (info.stop == SYSCALL_STOP_EXIT && task->in_syscall) {
+        syscall_profile_part(shard->profile, task->syscall_nr, PROFILE_PTRACE, peeking);
+        handle_syscall_exit(shard, task, info.ret);
+        exited = &info;
+      }
+    } else if (WSTOPSIG(status) == SIGCONT && task->sigcont_sent) {
+      // Our own SIGCONT from the handoff
+      task->sigcont_sent = 0;
+    } else {
+      // Got a regular signal - forward it
+      int sig = WSTOPSIG(status);
+      printf("Child got signal: %d\n", sig);
+      uint64_t resuming = syscall_profile_start(shard->profile);
+      resume_task(task, sig);
+      profile_resumed(shard, task, reaped, resuming, NULL);
+      continue;
+    }
+    
+    // Continue to the next syscall
+    uint64_t resuming = syscall_profile_start(shard->profile);
+    resume_task(task, 0);
+    record_stop(shard, task);
+    profile_resumed(shard, task, reaped, resuming, exited);
   }
-  
-  // In a real implementation, you would have a more sophisticated
-  // way to determine which paths to monitor. For now, we'll 
-  // monitor all non-system paths.
-  return 1;
+
+  stop_waker(shard);
 }
 
-// Helper to track a new file descriptor and its path
-void track_fd(int fd, const char* path) {
-  if (fd < 0 || !path) return;
-  
-  // Find an empty slot or update existing fd
-  for (int i = 0; i < MAX_TRACKED_FDS; i++) {
-    if (!tracked_fds[i].active || tracked_fds[i].fd == fd) {
-      tracked_fds[i].fd = fd;
-      strncpy(tracked_fds[i].path, path, MAX_PATH - 1);
-      tracked_fds[i].path[MAX_PATH - 1] = '\0'; // Ensure null termination
-      tracked_fds[i].active = 1;
-      return;
-    }
-  }
+void *tracer_thread(void *arg) {
+  shard_t *shard = arg;
+  start_waker(shard);
+  pthread_barrier_wait(&shards_ready);
+  trace_loop(shard, -1);
+  return NULL;
 }
 
-// Helper to get path for a file descriptor
-const char* get_fd_path(int fd) {
-  for (int i = 0; i < MAX_TRACKED_FDS; i++) {
-    if (tracked_fds[i].active && tracked_fds[i].fd == fd) {
-      return tracked_fds[i].path;
+// Syscalls the seccomp filter has to stop for when only `traced_ops` are
+// left to the tracer: fd-table syscalls and openers are kept whenever
+// anything is traced, since reads and writes through an fd need its path
+static int traced_syscalls(unsigned int traced_ops, int *syscalls, int max) {
+  int all[SYSCALL_TABLE_SIZE];
+  int total = syscall_list(SYSCALL_MONITORED | SYSCALL_FD_TABLE, all, SYSCALL_TABLE_SIZE);
+  int count = 0;
+  for (int i = 0; i < total && count < max; i++) {
+    const syscall_desc_t *desc = syscall_desc(all[i]);
+    unsigned int ops = 0;
+    for (int k = 0; k < 2; k++) {
+      if (desc->operand[k].path != -1 || desc->operand[k].fd != -1) {
+        ops |= 1u << desc->operand[k].op;
+      }
+    }
+    int keep = (ops & traced_ops) ||
+               (traced_ops && (desc->flags & (SYSCALL_FD_TABLE | SYSCALL_NEW_FD)));
+    if (keep) {
+      syscalls[count++] = all[i];
     }
   }
-  return NULL;
+  return count;
 }
 
-// Function to read a string from the child's memory
-char* read_string(pid_t child_pid, unsigned long addr) {
-  static char buffer[MAX_PATH];
-  int i = 0;
-  
-  while (i < MAX_PATH - sizeof(long)) {
-    long data;
-    
-    errno = 0;
-    data = ptrace(PTRACE_PEEKDATA, child_pid, addr + i, NULL);
-    if (errno != 0) {
-      perror("ptrace peek");
-      break;
-    }
-    
-    memcpy(buffer + i, &data, sizeof(long));
-    
-    // Check for null terminator in the bytes we just read
-    int j;
-    for (j = 0; j < sizeof(long); j++) {
-      if (buffer[i + j] == '\0') {
-        return buffer;
+// libsandbox_preload.so next to the sandbox binary (a build tree), or
+// where it is installed. Returns 0 with the path in `buf`, or -1.
+static int find_preload_library(char *buf, size_t size) {
+  ssize_t len = readlink("/proc/self/exe", buf, size - 1);
+  if (len > 0) {
+    buf[len] = '\0';
+    char *slash = strrchr(buf, '/');
+    if (slash && (size_t)(slash - buf) + sizeof("/libsandbox_preload.so") <= size) {
+      strcpy(slash, "/libsandbox_preload.so");
+      if (access(buf, R_OK) == 0) {
+        return 0;
       }
     }
-    
-    i += sizeof(long);
   }
-  
-  // Ensure null termination
-  buffer[MAX_PATH - 1] = '\0';
-  return buffer;
+  snprintf(buf, size, "%s/libsandbox_preload.so", SANDBOX_LIBDIR);
+  return access(buf, R_OK) == 0 ? 0 : -1;
 }
 
-// Check if a file exists
-int file_exists(const char *filepath) {
-  FILE *file = fopen(filepath, "r");
-  if (file) {
-    fclose(file);
+// In the child: load the shim ahead of any LD_PRELOAD the user set, and
+// tell it where the channel is
+static int set_preload_env(const char *library, int fd) {
+  char value[2 * MAX_PATH];
+  const char *existing = getenv("LD_PRELOAD");
+  snprintf(value, sizeof(value), existing && *existing ? "%s:%s" : "%s", library, existing);
+  char fd_text[16];
+  snprintf(fd_text, sizeof(fd_text), "%d", fd);
+  return setenv("LD_PRELOAD", value, 1) == -1 || setenv(PRELOAD_FD_ENV, fd_text, 1) == -1 ? -1 : 0;
+}
+
+// Trace the event log is recording to, if any
+static const char *recording = NULL;
+
+static int start_event_log(const char *filename, const char *trace_filename) {
+  recording = trace_filename;
+  if (use_batch) {
+    event_log_quiet();
+  }
+  return event_log_start(filename, log_format, trace_filename);
+}
+
+// What --batch prints at the end: how many operations were decided
+// which way, and the paths denied most often
+static void print_batch_summary(void) {
+  event_log_totals_t totals;
+  event_log_totals(&totals);
+  printf("%sBatch summary: %lu operations decided, %lu allowed, %lu denied%s\n", INFO_COLOR,
+         (unsigned long)(totals.allowed + totals.denied), (unsigned long)totals.allowed,
+         (unsigned long)totals.denied, COLOR_RESET);
+  event_log_denial_t top[BATCH_TOP_DENIED];
+  int count = event_log_top_denied(top, BATCH_TOP_DENIED);
+  if (count) {
+    printf("%sMost denied:%s\n", BLOCKED_COLOR, COLOR_RESET);
+  }
+  for (int i = 0; i < count; i++) {
+    printf("%s%10lu  %-6s %s%s\n", BLOCKED_COLOR, (unsigned long)top[i].count, policy_op_name(top[i].op),
+           top[i].path, COLOR_RESET);
+  }
+}
+
+// Flush the event log and say how much of the run was recorded
+static void close_event_log(void) {
+  long recorded = event_log_close();
+  if (recording && recorded >= 0) {
+    printf("%sRecorded %ld events to %s%s\n", INFO_COLOR, recorded, recording, COLOR_RESET);
+  }
+  if (use_batch) {
+    print_batch_summary();
+  }
+}
+
+// The exit status --batch reports for a program that ended with wait
+// status `status`
+static int batch_exit_status(int status) {
+  event_log_totals_t totals;
+  event_log_totals(&totals);
+  if (totals.denied) {
+    return BATCH_EXIT_DENIED;
+  }
+  if (status == -1) {
     return 1;
   }
-  return 0;
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+// What --io prints at the end, and the --io-dump file
+static void report_io(void) {
+  io_stats_t **tables = malloc((size_t)num_tracers * sizeof(io_stats_t *));
+  if (!tables) {
+    perror("malloc");
+    return;
+  }
+  for (int i = 0; i < num_tracers; i++) {
+    tables[i] = shards[i].io;
+  }
+  io_stats_report(tables, num_tracers, IO_TOP_ENTRIES, stdout);
+  if (io_dump_filename && io_stats_dump(tables, num_tracers, io_dump_filename) == 0) {
+    printf("%sWrote I/O stats to %s%s\n", INFO_COLOR, io_dump_filename, COLOR_RESET);
+  }
+  for (int i = 0; i < num_tracers; i++) {
+    io_stats_free(shards[i].io);
+    shards[i].io = NULL;
+  }
+  free(tables);
 }
 
-// Global variable to track if we're entering or exiting syscall
-int in_syscall = 0;
-unsigned long saved_syscall = 0;
+// The --profile table of all tracer threads
+static void report_profile(void) {
+  syscall_profile_t **profiles = malloc((size_t)num_tracers * sizeof(syscall_profile_t *));
+  if (!profiles) {
+    perror("malloc");
+    return;
+  }
+  for (int i = 0; i < num_tracers; i++) {
+    profiles[i] = shards[i].profile;
+  }
+  syscall_profile_report(profiles, num_tracers, stdout);
+  for (int i = 0; i < num_tracers; i++) {
+    syscall_profile_free(shards[i].profile);
+    shards[i].profile = NULL;
+  }
+  free(profiles);
+}
 
-int main(int argc, char *argv[]) {
-  if (argc < 2) {
-    fprintf(stderr, "Usage: %s <program_to_sandbox> [args...]\n", argv[0]);
+// Everything the policy says is enforced by Landlock: run the program
+// without a tracer, so it never stops
+static int run_untraced(const path_policy_t *policy, const landlock_plan_t *plan, char *argv[]) {
+  printf("%sNothing left to trace: running %s under Landlock only%s\n", INFO_COLOR, argv[0], COLOR_RESET);
+  fflush(stdout);
+  pid_t child_pid = fork();
+  if (child_pid == -1) {
+    perror("fork failed");
     return 1;
   }
+  if (child_pid == 0) {
+    if (landlock_apply(policy, plan) == -1) {
+      perror("landlock");
+      exit(1);
+    }
+    execvp(argv[0], argv);
+    perror("execvp failed");
+    exit(1);
+  }
+  int status;
+  while (waitpid(child_pid, &status, 0) == -1) {
+    if (errno != EINTR) {
+      perror("waitpid");
+      return 1;
+    }
+  }
+  program_status = status;
+  if (WIFEXITED(status)) {
+    printf("Child process exited with status %d\n", WEXITSTATUS(status));
+  } else {
+    printf("Child process terminated by signal %d\n", WTERMSIG(status));
+  }
+  close_event_log();
+  return 0;
+}
 
-  char *program = argv[1];    // Program to run
-  
-  printf("%sSandbox monitoring: %s%s\n", INFO_COLOR, program, COLOR_RESET);
-  printf("%sFile operations monitored: read, write, open, and delete%s\n", INFO_COLOR, COLOR_RESET);
+void print_usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [options] <program_to_sandbox> [args...]\n", prog);
+  fprintf(stderr, "       %s [options] --serve <socket>\n", prog);
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --seccomp   Only stop the program on monitored syscalls (seccomp-BPF pre-filter)\n");
+  fprintf(stderr, "  --notify    Supervise through seccomp user notifications instead of ptrace\n");
+  fprintf(stderr, "  --policy <file>\n");
+  fprintf(stderr, "              Load allow/deny/ask path rules (default: allow system paths, ask for the rest)\n");
+  fprintf(stderr, "  --remember <file>\n");
+  fprintf(stderr, "              Keep \"always\" / \"never\" answers in <file> and reuse them on later runs\n");
+  fprintf(stderr, "  --tracers <n>\n");
+  fprintf(stderr, "              Number of tracer threads with --seccomp (default: one per CPU)\n");
+  fprintf(stderr, "  --timeout <seconds>\n");
+  fprintf(stderr, "              Settle prompts nobody answers in time with the default answer\n");
+  fprintf(stderr, "  --default <allow|deny>\n");
+  fprintf(stderr, "              Answer used on timeout or when the policy daemon is gone (default: deny)\n");
+  fprintf(stderr, "  --log <file>\n");
+  fprintf(stderr, "              Write every decided operation to <file>\n");
+  fprintf(stderr, "  --log-format <text|json|binary>\n");
+  fprintf(stderr, "              Format of the --log file (default: text)\n");
+  fprintf(stderr, "  --record <file>\n");
+  fprintf(stderr, "              Record every decided operation as a trace sandbox-replay can test policies on\n");
+  fprintf(stderr, "  --daemon <socket>\n");
+  fprintf(stderr, "              Ask the policy daemon listening on a Unix socket instead of the terminal\n");
+  fprintf(stderr, "  --stats     Keep per-syscall latency stats for sandbox-top; dump them on SIGUSR1 and at exit\n");
+  fprintf(stderr, "  --io        Count bytes, calls and request sizes of reads and writes through tracked fds\n");
+  fprintf(stderr, "              per fd, path and process, and report the busiest at exit\n");
+  fprintf(stderr, "  --io-dump <file>\n");
+  fprintf(stderr, "              Like --io, and write every entry to <file> (JSON if it ends in .json, else CSV)\n");
+  fprintf(stderr, "  --profile   Count and time every syscall, split into kernel and tracer time, and print a\n");
+  fprintf(stderr, "              table at exit (strace -c style; not with --seccomp)\n");
+  fprintf(stderr, "  --trust <file>\n");
+  fprintf(stderr, "              Stop tracing processes that exec a binary whose SHA-256 is listed in <file>\n");
+  fprintf(stderr, "  --landlock  Enforce the policy's static rules with Landlock and only trace the rest\n");
+  fprintf(stderr, "  --preload   Check libc file calls of dynamically linked programs in-process (implies --seccomp)\n");
+  fprintf(stderr, "  --batch     Never prompt: operations the policy asks about get the --default answer. Print a\n");
+  fprintf(stderr, "              summary at the end and exit with %d if anything was denied\n", BATCH_EXIT_DENIED);
+  fprintf(stderr, "  --serve <socket>\n");
+  fprintf(stderr, "              Stay up and run the programs sandbox-run submits on <socket>, keeping what they learn\n");
+}
+
+// Run the program in argv under the sandbox, once the policy and the
+// broker are set up. Returns the sandbox's exit code; the program's own
+// wait status is left in program_status.
+static int run_program(path_policy_t *policy, char *argv[]) {
+  landlock_plan_t plan = { 0, 0, (1u << POLICY_OP_COUNT) - 1 };
+  if (use_landlock) {
+    printf("%s", INFO_COLOR);
+    landlock_plan(policy, &plan, stdout);
+    printf("%s", COLOR_RESET);
+    if (!plan.traced_ops) {
+      return run_untraced(policy, &plan, argv);
+    }
+  }
+  if (use_notify) {
+    int result = run_notify_sandbox(argv, &program_status);
+    close_event_log();
+    return result;
+  }
+  if (use_seccomp) {
+    printf("%sUsing seccomp pre-filter: unmonitored syscalls run without stopping%s\n", INFO_COLOR, COLOR_RESET);
+  }
+  int preload_fd = -1;
+  char preload_lib[MAX_PATH];
+  if (use_preload) {
+    if (find_preload_library(preload_lib, sizeof(preload_lib)) == -1) {
+      fprintf(stderr, "Cannot find libsandbox_preload.so next to the sandbox or in %s\n", SANDBOX_LIBDIR);
+      return 1;
+    }
+    preload_segment_t *segment = preload_segment_create(&preload_fd);
+    if (!segment) {
+      perror("preload segment");
+      return 1;
+    }
+    preload_server_init(segment);
+    printf("%sChecking libc file calls in-process with %s%s\n", INFO_COLOR, preload_lib, COLOR_RESET);
+  }
 
   // Fork a child process
   pid_t child_pid = fork();
@@ -153,9 +1328,34 @@ int main(int argc, char *argv[]) {
       perror("ptrace traceme");
       exit(1);
     }
+
+    // Stop so the parent can set ptrace options before the filter takes
+    // effect; a SECCOMP_RET_TRACE without PTRACE_O_TRACESECCOMP set
+    // would fail the syscall with ENOSYS
+    if (use_seccomp) {
+      int filter_syscalls[SYSCALL_TABLE_SIZE];
+      int count = traced_syscalls(plan.traced_ops, filter_syscalls, SYSCALL_TABLE_SIZE);
+
+      if (use_preload && set_preload_env(preload_lib, preload_fd) == -1) {
+        perror("setenv");
+        exit(1);
+      }
+      raise(SIGSTOP);
+      if (use_landlock && landlock_apply(policy, &plan) == -1) {
+        perror("landlock");
+        exit(1);
+      }
+      if (install_trace_filter(filter_syscalls, count) == -1) {
+        perror("seccomp filter");
+        exit(1);
+      }
+    } else if (use_landlock && landlock_apply(policy, &plan) == -1) {
+      perror("landlock");
+      exit(1);
+    }
     
     // Execute the program
-    execvp(program, &argv[1]);
+    execvp(argv[0], argv);
     
     // If we get here, execvp failed
     perror("execvp failed");
@@ -164,197 +1364,406 @@ int main(int argc, char *argv[]) {
   
   // Parent process (sandbox)
   int status;
-  struct user_regs_struct regs;
+  if (serve_socket) {
+    serve_job_program(child_pid);
+  }
   
-  // Wait for child to stop after execvp (first trap)
+  // Wait for child to stop after execvp (first trap), or at its SIGSTOP
+  // before installing the seccomp filter
   waitpid(child_pid, &status, 0);
   
   /* This makes it easy for the tracer to 
   *  distinguish normal traps from those caused by a system call. */  
-  if (ptrace(PTRACE_SETOPTIONS, child_pid, 0, 
-             PTRACE_O_TRACESYSGOOD) == -1) {
+  int options = PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEEXEC | PTRACE_O_TRACEFORK |
+                PTRACE_O_TRACEVFORK | PTRACE_O_TRACECLONE;
+  if (use_seccomp) {
+    options |= PTRACE_O_TRACESECCOMP;
+  }
+  trace_options = options;
+  if (ptrace(PTRACE_SETOPTIONS, child_pid, 0, options) == -1) {
     perror("ptrace setoptions");
     return 1;
   }
   
-  printf("%sStarting to trace process with PID %d%s\n", INFO_COLOR, child_pid, COLOR_RESET);
-  
-  // Continue to the next syscall
-  if (ptrace(PTRACE_SYSCALL, child_pid, NULL, NULL) == -1) {
-    perror("ptrace syscall");
+  // In seccomp mode the child is still before execvp; let it install the
+  // filter and run up to the exec event
+  if (use_seccomp) {
+    if (ptrace(PTRACE_CONT, child_pid, NULL, NULL) == -1) {
+      perror("ptrace cont");
+      return 1;
+    }
+    waitpid(child_pid, &status, 0);
+    if (!WIFSTOPPED(status)) {
+      fprintf(stderr, "Child exited before starting the program\n");
+      return 1;
+    }
+  }
+
+  // Without the seccomp filter every process stays with the thread that
+  // traces its parent (see handle_new_task()), so more threads would idle
+  if (!use_seccomp) {
+    if (num_tracers > 1) {
+      fprintf(stderr, "--tracers needs --seccomp to spread processes; using one tracer thread\n");
+    }
+    num_tracers = 1;
+  } else if (num_tracers <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_tracers = cpus > 0 ? (int)cpus : 1;
+  }
+  shards = calloc(num_tracers, sizeof(shard_t));
+  if (!shards) {
+    perror("calloc");
     return 1;
   }
-  
-  // Monitor the child process
-  while (1) {
-    // Wait for the child to stop
-    if (waitpid(child_pid, &status, 0) == -1) {
-      perror("waitpid");
-      break;
+  if (use_stats && tracer_stats_create(num_tracers) == -1) {
+    return 1;
+  }
+  for (int i = 0; i < num_tracers; i++) {
+    shards[i].index = i;
+    shards[i].tasks = task_table_new();
+    if (!shards[i].tasks) {
+      perror("task table");
+      return 1;
     }
-    
-    // Check if the child has exited
-    if (WIFEXITED(status)) {
-      printf("Child process exited with status %d\n", WEXITSTATUS(status));
-      break;
+    shards[i].stats = tracer_stats_shard(i);
+    if (use_io && !(shards[i].io = io_stats_new())) {
+      perror("io stats");
+      return 1;
     }
-    
-    // Check if the child was terminated by a signal
-    if (WIFSIGNALED(status)) {
-      printf("Child process terminated by signal %d\n", WTERMSIG(status));
-      break;
+    if (use_profile && !(shards[i].profile = syscall_profile_new())) {
+      perror("syscall profile");
+      return 1;
     }
-    
-    // Check if this is a syscall-stop
-    if (WIFSTOPPED(status) && (WSTOPSIG(status) & 0x80)) {
-      // Get the registers to see what syscall was made
-      if (ptrace(PTRACE_GETREGS, child_pid, NULL, &regs) == -1) {
-        perror("ptrace getregs");
+  }
+
+  // This thread traces the first shard, which holds the sandboxed program
+  shard_t *main_shard = &shards[0];
+  main_shard->thread = pthread_self();
+  program_pid = child_pid;
+  task_t *root = shard_add_task(main_shard, child_pid);
+  if (!root) {
+    perror("task table");
+    return 1;
+  }
+  root->fds = fd_table_new();
+  root->started = 1;
+
+  // Even a single shard needs its waker for answers from the broker
+  pthread_barrier_init(&shards_ready, NULL, (unsigned int)num_tracers);
+  for (int i = 1; i < num_tracers; i++) {
+    if (pthread_create(&shards[i].thread, NULL, tracer_thread, &shards[i]) != 0) {
+      perror("pthread_create");
+      return 1;
+    }
+  }
+  start_waker(main_shard);
+  pthread_barrier_wait(&shards_ready);
+  if (num_tracers > 1) {
+    printf("%sTracing with %d threads%s\n", INFO_COLOR, num_tracers, COLOR_RESET);
+  }
+
+  if (use_stats) {
+    printf("%sRecording tracer stats: watch with sandbox-top %d, dump with kill -USR1 %d%s\n",
+           INFO_COLOR, (int)getpid(), (int)getpid(), COLOR_RESET);
+  }
+  printf("%sStarting to trace process with PID %d%s\n", INFO_COLOR, child_pid, COLOR_RESET);
+
+  // Continue to the next syscall
+  if (resume_task(root, 0) == -1) {
+    return 1;
+  }
+  
+  trace_loop(main_shard, child_pid);
+
+  for (int i = 1; i < num_tracers; i++) {
+    pthread_join(shards[i].thread, NULL);
+  }
+  if (trust_file) {
+    trusted_exec_stats_t trusted;
+    trusted_exec_stats(&trusted);
+    printf("%sTrusted executables: %lu of %lu execs matched, %lu processes detached, %lu binaries hashed%s\n",
+           INFO_COLOR, (unsigned long)trusted.trusted, (unsigned long)trusted.execs,
+           (unsigned long)atomic_load(&detached_count), (unsigned long)trusted.hashed, COLOR_RESET);
+  }
+  if (use_preload) {
+    printf("%sPreload shim: %lu verdicts shared%s\n", INFO_COLOR, (unsigned long)preload_server_shared(),
+           COLOR_RESET);
+  }
+  if (use_io) {
+    report_io();
+  }
+  if (use_profile) {
+    report_profile();
+  }
+  close_event_log();
+  tracer_stats_close();
+  
+  return 0;
+}
+
+// Policy the --serve jobs run under, loaded once by the server
+static path_policy_t *serve_policy = NULL;
+
+// One --serve job, in a process forked for it: it gets its own log file
+// (<log>.<job>), trace (<trace>.<job>), broker and tracer threads
+static int serve_job(char *argv[], int job_id) {
+  static char job_log[MAX_PATH], job_trace[MAX_PATH], job_dump[MAX_PATH];
+  const char *log = log_filename;
+  const char *trace = record_filename;
+  if (log_filename) {
+    snprintf(job_log, sizeof(job_log), "%s.%d", log_filename, job_id);
+    log = job_log;
+  }
+  if (record_filename) {
+    snprintf(job_trace, sizeof(job_trace), "%s.%d", record_filename, job_id);
+    trace = job_trace;
+  }
+  if (io_dump_filename) {
+    // This process only runs the one job
+    snprintf(job_dump, sizeof(job_dump), "%s.%d", io_dump_filename, job_id);
+    io_dump_filename = job_dump;
+  }
+  if (start_event_log(log, trace) == -1 || broker_start(&broker_config) == -1) {
+    return -1;
+  }
+  printf("%sSandbox monitoring: %s (job %d)%s\n", INFO_COLOR, argv[0], job_id, COLOR_RESET);
+  fflush(stdout);
+  run_program(serve_policy, argv);
+  if (use_batch) {
+    // The client exits with the status a batch run would
+    return W_EXITCODE(batch_exit_status(program_status), 0);
+  }
+  return program_status;
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {
+    {"seccomp", no_argument, 0, 's'},
+    {"notify", no_argument, 0, 'n'},
+    {"policy", required_argument, 0, 'p'},
+    {"remember", required_argument, 0, 'r'},
+    {"tracers", required_argument, 0, 't'},
+    {"timeout", required_argument, 0, 'T'},
+    {"default", required_argument, 0, 'd'},
+    {"daemon", required_argument, 0, 'D'},
+    {"log", required_argument, 0, 'l'},
+    {"log-format", required_argument, 0, 'F'},
+    {"stats", no_argument, 0, 'S'},
+    {"io", no_argument, 0, 'I'},
+    {"io-dump", required_argument, 0, 'O'},
+    {"profile", no_argument, 0, 'C'},
+    {"trust", required_argument, 0, 'A'},
+    {"landlock", no_argument, 0, 'L'},
+    {"preload", no_argument, 0, 'P'},
+    {"serve", required_argument, 0, 'V'},
+    {"record", required_argument, 0, 'R'},
+    {"batch", no_argument, 0, 'B'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+
+  // Stop at the first non-option so the sandboxed program's args are left alone
+  int opt;
+  while ((opt = getopt_long(argc, argv, "+snp:r:t:T:d:D:l:F:SIO:CA:LPV:R:Bh", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 's':
+        use_seccomp = 1;
         break;
-      }
-      
-      if (!in_syscall) {
-        // Entering syscall
-        in_syscall = 1;
-        saved_syscall = regs.orig_rax;
-        
-// Check for monitored syscalls
-        if (saved_syscall == SYS_UNLINK || saved_syscall == SYS_UNLINKAT || 
-            saved_syscall == SYS_READ || saved_syscall == SYS_WRITE || 
-            saved_syscall == SYS_OPEN || saved_syscall == SYS_OPENAT) {
-          
-          char* path = NULL;
-          char* operation = NULL;
-          char details[MAX_PATH + 100] = {0};
-          int should_monitor = 0;
-          
-          // Get operation type and path based on syscall
-          if (saved_syscall == SYS_UNLINK) {
-            operation = "delete";
-            path = read_string(child_pid, regs.rdi);
-            sprintf(details, "delete file: %s", path);
-            should_monitor = should_monitor_path(path);
-          } else if (saved_syscall == SYS_UNLINKAT) {
-            operation = "delete";
-            int dirfd = (int)regs.rdi;
-            path = read_string(child_pid, regs.rsi);
-            sprintf(details, "delete file: %s (dirfd: %d)", path, dirfd);
-            should_monitor = should_monitor_path(path);
-          } else if (saved_syscall == SYS_READ) {
-            operation = "read";
-            int fd = (int)regs.rdi;
-            const char* fd_path = get_fd_path(fd);
-            if (fd_path) {
-              sprintf(details, "read from file: %s (fd: %d)", fd_path, fd);
-              should_monitor = should_monitor_path(fd_path);
-            } else {
-              sprintf(details, "read from file descriptor: %d", fd);
-              should_monitor = 0; // Skip untracked file descriptors
-            }
-          } else if (saved_syscall == SYS_WRITE) {
-            operation = "write";
-            int fd = (int)regs.rdi;
-            const char* fd_path = get_fd_path(fd);
-            if (fd_path) {
-              sprintf(details, "write to file: %s (fd: %d)", fd_path, fd);
-              should_monitor = should_monitor_path(fd_path);
-            } else {
-              sprintf(details, "write to file descriptor: %d", fd);
-              should_monitor = 0; // Skip untracked file descriptors
-            }
-          } else if (saved_syscall == SYS_OPEN) {
-            operation = "open";
-            path = read_string(child_pid, regs.rdi);
-            int flags = (int)regs.rsi;
-            sprintf(details, "open file: %s (flags: 0x%x)", path, flags);
-            should_monitor = should_monitor_path(path);
-          } else if (saved_syscall == SYS_OPENAT) {
-            operation = "open";
-            int dirfd = (int)regs.rdi;
-            path = read_string(child_pid, regs.rsi);
-            int flags = (int)regs.rdx;
-            sprintf(details, "open file: %s (dirfd: %d, flags: 0x%x)", path, dirfd, flags);
-            should_monitor = should_monitor_path(path);
-          }
-          
-          // Only prompt for monitored paths
-          if (should_monitor) {
-            printf("\n%s[!] ALERT: Program is attempting to %s%s\n", ALERT_COLOR, details, COLOR_RESET);
-            printf("%sAllow this operation? (y/n): %s", PROMPT_COLOR, COLOR_RESET);
-            fflush(stdout);
-            
-            char response;
-            if (scanf(" %c", &response) != 1) {
-              response = 'n'; // Default to blocking if read fails
-            }
-            
-            // Clear input buffer
-            int c;
-            while ((c = getchar()) != '\n' && c != EOF);
-            
-            if (response == 'y' || response == 'Y') {
-              printf("%s[+] ALLOWED: User permitted %s operation%s\n", ALLOWED_COLOR, operation, COLOR_RESET);
-              // Allow the syscall to proceed normally
-            } else {
-              printf("%s[-] BLOCKED: User denied %s operation%s\n", BLOCKED_COLOR, operation, COLOR_RESET);
-              
-              // Set syscall to -1 to prevent it from executing
-              regs.orig_rax = -1;
-              if (ptrace(PTRACE_SETREGS, child_pid, NULL, &regs) == -1) {
-                perror("ptrace setregs");
-              }
-            }
-          }
+      case 'n':
+        use_notify = 1;
+        break;
+      case 'p':
+        policy_file = optarg;
+        break;
+      case 'r':
+        answers_file = optarg;
+        break;
+      case 't':
+        num_tracers = atoi(optarg);
+        if (num_tracers < 1) {
+          fprintf(stderr, "--tracers needs a positive number\n");
+          return 1;
         }
-      } else {
-        // Exiting syscall
-        in_syscall = 0;
-        
-        // Special handling for successful open/openat calls to track file descriptors
-        if ((saved_syscall == SYS_OPEN || saved_syscall == SYS_OPENAT) && regs.rax >= 0) {
-          int new_fd = (int)regs.rax;
-          char* path = NULL;
-          
-          if (saved_syscall == SYS_OPEN) {
-            // For open, get the path from arg1
-            path = read_string(child_pid, regs.rdi);
-          } else if (saved_syscall == SYS_OPENAT) {
-            // For openat, get the path from arg2
-            path = read_string(child_pid, regs.rsi);
-          }
-          
-          if (path) {
-            // Track this new file descriptor
-            track_fd(new_fd, path);
-          }
+        break;
+      case 'T':
+        broker_config.timeout_ms = (int)(atof(optarg) * 1000);
+        if (broker_config.timeout_ms < 1) {
+          fprintf(stderr, "--timeout needs a positive number of seconds\n");
+          return 1;
         }
-        
-        // If we blocked a syscall, make it return EPERM
-        if (regs.orig_rax == -1) {
-          regs.rax = -EPERM;
-          if (ptrace(PTRACE_SETREGS, child_pid, NULL, &regs) == -1) {
-            perror("ptrace setregs for return value");
-          }
+        break;
+      case 'd':
+        if (strcmp(optarg, "allow") == 0) {
+          broker_config.default_allow = 1;
+        } else if (strcmp(optarg, "deny") == 0) {
+          broker_config.default_allow = 0;
+        } else {
+          fprintf(stderr, "--default must be allow or deny\n");
+          return 1;
         }
-      }
-    } else if (WIFSTOPPED(status)) {
-      // Got a regular signal - forward it
-      int sig = WSTOPSIG(status);
-      printf("Child got signal: %d\n", sig);
-      
-      if (ptrace(PTRACE_SYSCALL, child_pid, NULL, sig) == -1) {
-        perror("ptrace syscall (signal forwarding)");
         break;
-      }
-      continue;
-    }
-    
-    // Continue to the next syscall
-    if (ptrace(PTRACE_SYSCALL, child_pid, NULL, NULL) == -1) {
-      perror("ptrace syscall");
-      break;
+      case 'D':
+        broker_config.daemon_socket = optarg;
+        break;
+      case 'l':
+        log_filename = optarg;
+        break;
+      case 'F':
+        if (strcmp(optarg, "text") == 0) {
+          log_format = EVENT_LOG_TEXT;
+        } else if (strcmp(optarg, "json") == 0) {
+          log_format = EVENT_LOG_JSON;
+        } else if (strcmp(optarg, "binary") == 0) {
+          log_format = EVENT_LOG_BINARY;
+        } else {
+          fprintf(stderr, "--log-format must be text, json or binary\n");
+          return 1;
+        }
+        break;
+      case 'S':
+        use_stats = 1;
+        break;
+      case 'I':
+        use_io = 1;
+        break;
+      case 'O':
+        use_io = 1;
+        io_dump_filename = optarg;
+        break;
+      case 'C':
+        use_profile = 1;
+        break;
+      case 'A':
+        trust_file = optarg;
+        break;
+      case 'L':
+        use_landlock = 1;
+        break;
+      case 'P':
+        use_preload = 1;
+        use_seccomp = 1;
+        break;
+      case 'V':
+        serve_socket = optarg;
+        break;
+      case 'R':
+        record_filename = optarg;
+        break;
+      case 'B':
+        use_batch = 1;
+        broker_config.batch = 1;
+        break;
+      case 'h':
+        print_usage(argv[0]);
+        return 0;
+      default:
+        print_usage(argv[0]);
+        return 1;
     }
   }
-  
-  return 0;
+
+  if (optind >= argc && !serve_socket) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  tracee_memory_init();
+
+  if (use_seccomp && use_notify) {
+    fprintf(stderr, use_preload ? "--preload needs the ptrace backend\n"
+                                : "--seccomp and --notify are mutually exclusive\n");
+    return 1;
+  }
+  if (use_stats && use_notify) {
+    fprintf(stderr, "--stats needs the ptrace backend\n");
+    return 1;
+  }
+  if (use_io && use_notify) {
+    fprintf(stderr, "--io needs the ptrace backend\n");
+    return 1;
+  }
+  if (use_profile && use_notify) {
+    fprintf(stderr, "--profile needs the ptrace backend\n");
+    return 1;
+  }
+  if (use_profile && use_seccomp) {
+    fprintf(stderr, "--profile times every syscall, which --seccomp and --preload do not stop\n");
+    return 1;
+  }
+  if (trust_file && use_notify) {
+    fprintf(stderr, "--trust needs the ptrace backend\n");
+    return 1;
+  }
+  if (use_landlock && use_notify) {
+    fprintf(stderr, "--landlock needs the ptrace backend\n");
+    return 1;
+  }
+  if (use_batch && broker_config.daemon_socket) {
+    fprintf(stderr, "--batch and --daemon are mutually exclusive\n");
+    return 1;
+  }
+  if (serve_socket && use_notify) {
+    fprintf(stderr, "--serve needs the ptrace backend\n");
+    return 1;
+  }
+  if (serve_socket && optind < argc) {
+    fprintf(stderr, "--serve takes no program: submit jobs with sandbox-run\n");
+    return 1;
+  }
+  int num_trusted = trust_file ? trusted_exec_load(trust_file) : 0;
+  if (num_trusted == -1) {
+    return 1;
+  }
+
+  path_policy_t *policy = policy_file ? policy_load_file(policy_file) : policy_default();
+  if (!policy) {
+    return 1;
+  }
+  monitor_set_policy(policy);
+  if (answers_file && verdict_cache_open(answers_file) == -1) {
+    return 1;
+  }
+
+  if (!serve_socket) {
+    printf("%sSandbox monitoring: %s%s\n", INFO_COLOR, argv[optind], COLOR_RESET);
+  }
+  printf("%sFile operations monitored: read, write, open, and delete%s\n", INFO_COLOR, COLOR_RESET);
+  if (policy_file) {
+    printf("%sLoaded policy %s (%d rules)%s\n", INFO_COLOR, policy_file, policy_rule_count(policy), COLOR_RESET);
+  }
+  if (answers_file) {
+    printf("%sRemembering answers in %s (%d so far)%s\n", INFO_COLOR, answers_file, verdict_cache_count(), COLOR_RESET);
+  }
+  if (broker_config.daemon_socket) {
+    printf("%sAsking the policy daemon at %s%s\n", INFO_COLOR, broker_config.daemon_socket, COLOR_RESET);
+  }
+  if (use_batch) {
+    printf("%sBatch mode: operations the policy asks about are %s%s\n", INFO_COLOR,
+           broker_config.default_allow ? "allowed" : "denied", COLOR_RESET);
+  } else if (broker_config.timeout_ms) {
+    printf("%sUnanswered prompts are %s after %gs%s\n", INFO_COLOR,
+           broker_config.default_allow ? "allowed" : "denied", broker_config.timeout_ms / 1000.0, COLOR_RESET);
+  }
+  if (log_filename) {
+    printf("%sLogging decisions to %s%s\n", INFO_COLOR, log_filename, COLOR_RESET);
+  }
+  if (record_filename) {
+    printf("%sRecording a trace to %s%s\n", INFO_COLOR, record_filename, COLOR_RESET);
+  }
+  if (use_io) {
+    printf("%sAccounting reads and writes through tracked fds%s%s%s\n", INFO_COLOR,
+           io_dump_filename ? ", dumping them to " : "", io_dump_filename ? io_dump_filename : "", COLOR_RESET);
+  }
+  if (trust_file) {
+    printf("%sTrusting %d executables from %s%s\n", INFO_COLOR, num_trusted, trust_file, COLOR_RESET);
+  }
+
+  if (serve_socket) {
+    serve_policy = policy;
+    return serve_forever(serve_socket, serve_job);
+  }
+  if (start_event_log(log_filename, record_filename) == -1 || broker_start(&broker_config) == -1) {
+    return 1;
+  }
+  int result = run_program(policy, &argv[optind]);
+  return use_batch && result == 0 ? batch_exit_status(program_status) : result;
 }
@@ -41,12 +41,16 @@
 #define TRUE 1
 #define FALSE 0
 
-// Function to read a string from the child's memory
-char* read_string(pid_t child_pid, unsigned long addr) {
-  static char buffer[MAX_PATH];
-  int i = 0;
+// Function to read a string from the child's memory into a caller-owned
+// buffer. Returns the string length, or -1 if nothing could be read.
+ssize_t read_string(pid_t child_pid, unsigned long addr, char *buf, size_t size) {
+  size_t i = 0;
+
+  if (!buf || size == 0) {
+    return -1;
+  }
   
-  while (i < MAX_PATH - sizeof(long)) {
+  while (i + sizeof(long) <= size - 1) {
     long data;
     
     errno = 0;
@@ -56,22 +60,20 @@ char* read_string(pid_t child_pid, unsigned long addr) {
       break;
     }
     
-    memcpy(buffer + i, &data, sizeof(long));
+    memcpy(buf + i, &data, sizeof(long));
     
     // Check for null terminator in the bytes we just read
-    int j;
-    for (j = 0; j < sizeof(long); j++) {
-      if (buffer[i + j] == '\0') {
-        return buffer;
-      }
+    char *nul = memchr(buf + i, '\0', sizeof(long));
+    if (nul) {
+      return nul - buf;
     }
     
     i += sizeof(long);
   }
   
-  // Ensure null termination
-  buffer[MAX_PATH - 1] = '\0';
-  return buffer;
+  // Terminate after the last byte actually read, never past the buffer
+  buf[i] = '\0';
+  return i > 0 ? (ssize_t)i : -1;
 }
 
 // Check if a file exists
@@ -194,13 +196,16 @@ int main(int argc, char *argv[]) {
         
         // Check for file-related syscalls
         char* operation_type = NULL;
+        char path_buf[MAX_PATH];
         char* filepath = NULL;
         int is_file_operation = FALSE;
         
         switch (syscall_num) {
           case SYS_OPEN:
             operation_type = "open";
-            filepath = read_string(child_pid, arg1);
+            if (read_string(child_pid, arg1, path_buf, sizeof(path_buf)) >= 0) {
+              filepath = path_buf;
+            }
             is_file_operation = TRUE;
             break;
           case SYS_READ:
@@ -213,12 +218,17 @@ int main(int argc, char *argv[]) {
             break;
           case SYS_UNLINK:
             operation_type = "delete";
-            filepath = read_string(child_pid, arg1);
+            if (read_string(child_pid, arg1, path_buf, sizeof(path_buf)) >= 0) {
+              filepath = path_buf;
+            }
             is_file_operation = TRUE;
             break;
           case SYS_UNLINKAT:
             operation_type = "delete";
-            filepath = read_string(child_pid, thread_state.__rsi);  // Second argument for unlinkat
+            // Second argument for unlinkat
+            if (read_string(child_pid, thread_state.__rsi, path_buf, sizeof(path_buf)) >= 0) {
+              filepath = path_buf;
+            }
             is_file_operation = TRUE;
             break;
         }
@@ -0,0 +1,285 @@
+// Offline policy check: evaluates a candidate policy against a trace
+// recorded with `sandbox --record`, and reports which recorded operations
+// it would decide differently. The trace is memory-mapped and scanned in
+// chunks by several threads; each (path, operation) pair is evaluated once
+// and its action shared.
+//
+// Usage: sandbox-replay [--threads <n>] [--show <n>] <policy> <trace>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "path_policy.h"
+#include "trace_file.h"
+
+#define CHUNK_RECORDS 65536
+
+// How the candidate policy treats a recorded event, against how it went
+typedef enum {
+  CHANGE_NONE,
+  CHANGE_NOW_DENIED,     // Was allowed
+  CHANGE_NOW_ALLOWED,    // Was denied
+  CHANGE_NOW_ASKED,      // Was settled without anyone asked, would prompt now
+  NUM_CHANGES
+} change_t;
+
+typedef struct {
+  uint64_t actions[POLICY_OP_COUNT][POLICY_ASK + 1];
+  uint64_t changes[NUM_CHANGES];
+  uint64_t *shown;       // Indices of the first changed records
+  int num_shown;
+} tally_t;
+
+static const trace_t *trace;
+static path_policy_t *policy;
+static _Atomic uint8_t *memo;     // Action per (path, op), 0 until evaluated
+static atomic_ulong next_chunk;
+static int max_shown = 20;
+
+static const char *source_names[] = { "policy", "remembered", "user", "daemon", "default" };
+
+static policy_action_t action_for(uint32_t path, uint8_t op) {
+  if (op >= POLICY_OP_COUNT) {
+    return POLICY_ALLOW;
+  }
+  _Atomic uint8_t *slot = &memo[(size_t)path * POLICY_OP_COUNT + op];
+  uint8_t action = atomic_load_explicit(slot, memory_order_relaxed);
+  if (action == POLICY_NONE) {
+    // Racing threads compute the same action, so either store is fine
+    action = (uint8_t)policy_evaluate(policy, trace_path(trace, path), (policy_op_t)op);
+    atomic_store_explicit(slot, action, memory_order_relaxed);
+  }
+  return (policy_action_t)action;
+}
+
+// The candidate's action for a whole event: a deny on either operand
+// wins, then an ask, as when the sandbox decides it
+static policy_action_t replay_record(const event_record_t *record, tally_t *tally) {
+  policy_action_t action = POLICY_ALLOW;
+  const uint32_t paths[2] = { record->path, record->path2 };
+  const uint8_t ops[2] = { record->op, record->op2 };
+  for (int i = 0; i < 2; i++) {
+    if (!paths[i]) {
+      continue;
+    }
+    policy_action_t operand = action_for(paths[i], ops[i]);
+    if (ops[i] < POLICY_OP_COUNT) {
+      tally->actions[ops[i]][operand]++;
+    }
+    if (operand == POLICY_DENY || (operand == POLICY_ASK && action == POLICY_ALLOW)) {
+      action = operand;
+    }
+  }
+  return action;
+}
+
+static change_t compare(const event_record_t *record, policy_action_t action) {
+  if (action == POLICY_ASK) {
+    // Someone was asked before too, so only a settled event is a change
+    int was_asked = record->source == EVENT_SOURCE_USER || record->source == EVENT_SOURCE_DAEMON ||
+                    record->source == EVENT_SOURCE_DEFAULT;
+    return was_asked ? CHANGE_NONE : CHANGE_NOW_ASKED;
+  }
+  if (action == POLICY_DENY && record->allowed) {
+    return CHANGE_NOW_DENIED;
+  }
+  if (action == POLICY_ALLOW && !record->allowed) {
+    return CHANGE_NOW_ALLOWED;
+  }
+  return CHANGE_NONE;
+}
+
+static void *scan_chunks(void *arg) {
+  tally_t *tally = arg;
+  uint64_t records = trace->header->records;
+  for (;;) {
+    uint64_t start = atomic_fetch_add(&next_chunk, 1) * CHUNK_RECORDS;
+    if (start >= records) {
+      return NULL;
+    }
+    uint64_t end = start + CHUNK_RECORDS < records ? start + CHUNK_RECORDS : records;
+    for (uint64_t i = start; i < end; i++) {
+      const event_record_t *record = &trace->records[i];
+      if (!record->path && !record->path2) {
+        continue;
+      }
+      change_t change = compare(record, replay_record(record, tally));
+      tally->changes[change]++;
+      if (change != CHANGE_NONE && tally->num_shown < max_shown) {
+        tally->shown[tally->num_shown++] = i;
+      }
+    }
+  }
+}
+
+static int by_index(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static void show_change(uint64_t index) {
+  const event_record_t *record = &trace->records[index];
+  policy_action_t actions[2] = { POLICY_NONE, POLICY_NONE };
+  if (record->path) {
+    actions[0] = action_for(record->path, record->op);
+  }
+  if (record->path2) {
+    actions[1] = action_for(record->path2, record->op2);
+  }
+  printf("  #%-8lu [%d] syscall %d: %s %s", (unsigned long)index, record->pid, record->syscall_nr,
+         record->op < POLICY_OP_COUNT ? policy_op_name((policy_op_t)record->op) : "?",
+         record->path ? trace_path(trace, record->path) : "-");
+  if (record->path2) {
+    printf(", %s %s", record->op2 < POLICY_OP_COUNT ? policy_op_name((policy_op_t)record->op2) : "?",
+           trace_path(trace, record->path2));
+  }
+  printf(": %s by %s, now %s", record->allowed ? "allowed" : "denied",
+         record->source < sizeof(source_names) / sizeof(source_names[0]) ? source_names[record->source] : "?",
+         policy_action_name(actions[0] != POLICY_NONE ? actions[0] : actions[1]));
+  if (record->path && record->path2) {
+    printf(" / %s", policy_action_name(actions[1]));
+  }
+  printf("\n");
+}
+
+static double elapsed(const struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void print_usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [options] <policy> <trace>\n", prog);
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --threads <n>  Scan with <n> threads (default: one per CPU)\n");
+  fprintf(stderr, "  --show <n>     List the first <n> changed events (default: 20)\n");
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {
+    {"threads", required_argument, 0, 't'},
+    {"show", required_argument, 0, 's'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int num_threads = cpus > 0 ? (int)cpus : 1;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "t:s:h", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 't':
+        num_threads = atoi(optarg);
+        if (num_threads < 1) {
+          fprintf(stderr, "--threads needs a positive number\n");
+          return 1;
+        }
+        break;
+      case 's':
+        max_shown = atoi(optarg);
+        if (max_shown < 0) {
+          max_shown = 0;
+        }
+        break;
+      case 'h':
+        print_usage(argv[0]);
+        return 0;
+      default:
+        print_usage(argv[0]);
+        return 1;
+    }
+  }
+  if (argc - optind != 2) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  policy = policy_load_file(argv[optind]);
+  if (!policy) {
+    return 1;
+  }
+  static trace_t mapped;
+  if (trace_open(argv[optind + 1], &mapped) == -1) {
+    return 1;
+  }
+  trace = &mapped;
+
+  memo = calloc((size_t)(trace->header->paths + 1) * POLICY_OP_COUNT, sizeof(*memo));
+  tally_t *tallies = calloc((size_t)num_threads, sizeof(tally_t));
+  pthread_t *threads = calloc((size_t)num_threads, sizeof(pthread_t));
+  if (!memo || !tallies || !threads) {
+    perror("calloc");
+    return 1;
+  }
+  for (int i = 0; i < num_threads; i++) {
+    tallies[i].shown = calloc((size_t)max_shown + 1, sizeof(uint64_t));
+    if (!tallies[i].shown) {
+      perror("calloc");
+      return 1;
+    }
+  }
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 1; i < num_threads; i++) {
+    if (pthread_create(&threads[i], NULL, scan_chunks, &tallies[i]) != 0) {
+      perror("pthread_create");
+      return 1;
+    }
+  }
+  scan_chunks(&tallies[0]);
+  for (int i = 1; i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  double seconds = elapsed(&start);
+
+  // Merge the threads' tallies. Each thread took its chunks in order, so
+  // the first changes overall are among the first ones of some thread.
+  tally_t total;
+  memset(&total, 0, sizeof(total));
+  uint64_t *shown = calloc((size_t)num_threads * (size_t)max_shown + 1, sizeof(uint64_t));
+  if (!shown) {
+    perror("calloc");
+    return 1;
+  }
+  for (int i = 0; i < num_threads; i++) {
+    for (int op = 0; op < POLICY_OP_COUNT; op++) {
+      for (int action = 0; action <= POLICY_ASK; action++) {
+        total.actions[op][action] += tallies[i].actions[op][action];
+      }
+    }
+    for (int c = 0; c < NUM_CHANGES; c++) {
+      total.changes[c] += tallies[i].changes[c];
+    }
+    memcpy(shown + total.num_shown, tallies[i].shown, (size_t)tallies[i].num_shown * sizeof(uint64_t));
+    total.num_shown += tallies[i].num_shown;
+  }
+  qsort(shown, (size_t)total.num_shown, sizeof(uint64_t), by_index);
+
+  uint64_t records = trace->header->records;
+  printf("Replayed %lu events (%lu paths) against %s in %.3fs: %.1fM events/s with %d threads\n",
+         (unsigned long)records, (unsigned long)trace->header->paths, argv[optind], seconds,
+         seconds > 0 ? records / seconds / 1e6 : 0.0, num_threads);
+  printf("\n%-8s %12s %12s %12s\n", "", "allow", "deny", "ask");
+  for (int op = 0; op < POLICY_OP_COUNT; op++) {
+    printf("%-8s %12lu %12lu %12lu\n", policy_op_name((policy_op_t)op),
+           (unsigned long)total.actions[op][POLICY_ALLOW], (unsigned long)total.actions[op][POLICY_DENY],
+           (unsigned long)total.actions[op][POLICY_ASK]);
+  }
+  printf("\n%lu events decided differently: %lu now denied, %lu now allowed, %lu would now prompt\n",
+         (unsigned long)(total.changes[CHANGE_NOW_DENIED] + total.changes[CHANGE_NOW_ALLOWED] +
+                         total.changes[CHANGE_NOW_ASKED]),
+         (unsigned long)total.changes[CHANGE_NOW_DENIED], (unsigned long)total.changes[CHANGE_NOW_ALLOWED],
+         (unsigned long)total.changes[CHANGE_NOW_ASKED]);
+  for (int i = 0; i < total.num_shown && i < max_shown; i++) {
+    show_change(shown[i]);
+  }
+
+  trace_close(&mapped);
+  policy_free(policy);
+  return 0;
+}
@@ -0,0 +1,201 @@
+// Client of `sandbox --serve`: runs one program under an already running
+// sandbox server, on this terminal (or these pipes), in this directory and
+// with this environment. Signals it gets are passed on to the program, and
+// it exits the way the program did.
+//
+// Usage: sandbox-run <socket> <program> [args...]
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "serve_protocol.h"
+
+extern char **environ;
+
+static int server_fd = -1;
+
+static void forward_signal(int sig) {
+  unsigned char byte = (unsigned char)sig;
+  int saved_errno = errno;
+  if (send(server_fd, &byte, 1, MSG_NOSIGNAL) == -1) {
+    // The server is gone; its reply (or EOF) says how
+  }
+  errno = saved_errno;
+}
+
+static int connect_server(const char *socket_path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Socket path too long: %s\n", socket_path);
+    return -1;
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    perror("socket");
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+    fprintf(stderr, "Cannot reach a sandbox server on %s: %s\n", socket_path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Append a NUL-terminated string to the payload
+static int append(char **payload, size_t *size, size_t *cap, const char *text) {
+  size_t len = strlen(text) + 1;
+  if (*size + len > SERVE_MAX_REQUEST) {
+    return -1;
+  }
+  if (*size + len > *cap) {
+    size_t grown = *cap ? *cap * 2 : 4096;
+    while (grown < *size + len) {
+      grown *= 2;
+    }
+    char *bigger = realloc(*payload, grown);
+    if (!bigger) {
+      return -1;
+    }
+    *payload = bigger;
+    *cap = grown;
+  }
+  memcpy(*payload + *size, text, len);
+  *size += len;
+  return 0;
+}
+
+static int send_all(int fd, const char *buf, size_t size) {
+  while (size > 0) {
+    ssize_t n = send(fd, buf, size, MSG_NOSIGNAL);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return -1;
+    }
+    buf += n;
+    size -= (size_t)n;
+  }
+  return 0;
+}
+
+// Send the header with our stdin, stdout and stderr, then the payload
+static int send_request(int fd, int argc, char *argv[]) {
+  char cwd[PATH_MAX];
+  if (!getcwd(cwd, sizeof(cwd))) {
+    perror("getcwd");
+    return -1;
+  }
+  char *payload = NULL;
+  size_t size = 0, cap = 0;
+  int failed = append(&payload, &size, &cap, cwd);
+  for (int i = 0; i < argc && !failed; i++) {
+    failed = append(&payload, &size, &cap, argv[i]);
+  }
+  uint32_t envc = 0;
+  for (char **env = environ; *env && !failed; env++, envc++) {
+    failed = append(&payload, &size, &cap, *env);
+  }
+  if (failed) {
+    fprintf(stderr, "Command line and environment too large\n");
+    free(payload);
+    return -1;
+  }
+
+  serve_request_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SERVE_MAGIC, sizeof(SERVE_MAGIC));
+  header.argc = (uint32_t)argc;
+  header.envc = envc;
+  header.size = (uint32_t)size;
+
+  int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+  char control[CMSG_SPACE(sizeof(fds))];
+  memset(control, 0, sizeof(control));
+  struct iovec iov = { &header, sizeof(header) };
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  int result = 0;
+  if (sendmsg(fd, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(header) ||
+      send_all(fd, payload, size) == -1) {
+    perror("send");
+    result = -1;
+  }
+  free(payload);
+  return result;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s <socket> <program> [args...]\n", argv[0]);
+    return 1;
+  }
+  server_fd = connect_server(argv[1]);
+  if (server_fd == -1 || send_request(server_fd, argc - 2, &argv[2]) == -1) {
+    return 1;
+  }
+
+  // From here on the program owns the terminal: pass our signals on
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = forward_signal;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  int forwarded[] = { SIGINT, SIGQUIT, SIGTERM, SIGHUP, SIGUSR1, SIGUSR2 };
+  for (size_t i = 0; i < sizeof(forwarded) / sizeof(forwarded[0]); i++) {
+    sigaction(forwarded[i], &action, NULL);
+  }
+
+  char reply[512];
+  size_t len = 0;
+  while (len < sizeof(reply) - 1) {
+    ssize_t n = read(server_fd, reply + len, sizeof(reply) - 1 - len);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    len += (size_t)n;
+    if (memchr(reply, '\n', len)) {
+      break;
+    }
+  }
+  reply[len] = '\0';
+  reply[strcspn(reply, "\n")] = '\0';
+
+  int value;
+  if (sscanf(reply, "exit %d", &value) == 1) {
+    return value;
+  }
+  if (sscanf(reply, "signal %d", &value) == 1) {
+    return 128 + value;
+  }
+  if (strncmp(reply, "error ", 6) == 0) {
+    fprintf(stderr, "%s: %s\n", argv[0], reply + 6);
+  } else {
+    fprintf(stderr, "%s: the server closed the connection\n", argv[0]);
+  }
+  return 1;
+}
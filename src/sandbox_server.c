@@ -0,0 +1,553 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "sandbox_common.h"
+#include "sandbox_server.h"
+#include "serve_protocol.h"
+#include "trusted_exec.h"
+#include "verdict_cache.h"
+
+// A job passes what it learns back over a pipe as NUL-terminated records:
+//   N <program>                          the job started
+//   V <op> <scope> <verdict> <path>      an "always" / "never" answer
+//   X <dev> <ino> <sec> <nsec> <size> <trusted>   a hashed binary
+//   T <execs> <trusted> <hashed>         its trusted_exec counters, at the end
+//   E <wait status>                      how the program ended
+#define RECORD_MAX (MAX_PATH + 128)
+
+typedef struct {
+  pid_t pid;
+  int fd;                   // Read end of the job's record pipe
+  int id;
+  uint64_t start_ns;
+  int status;               // From its E record; -1 if it never ran
+  char program[256];
+  char buf[2 * RECORD_MAX];
+  size_t len;
+} job_t;
+
+static job_t *jobs = NULL;
+static int num_jobs = 0;
+static int jobs_cap = 0;
+
+// What the server has seen since it started
+static struct {
+  uint64_t started;
+  uint64_t succeeded;
+  uint64_t failed;
+  uint64_t busy_ns;
+  uint64_t answers;
+  uint64_t hashes;
+  uint64_t execs;
+  uint64_t trusted;
+} totals;
+
+static volatile sig_atomic_t stopping = 0;
+static volatile sig_atomic_t dump_requested = 0;
+
+// Job side: where records go, and the program to deliver client signals to
+static int record_fd = -1;
+static pthread_mutex_t record_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile pid_t job_program = 0;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void on_stop(int sig) {
+  (void)sig;
+  stopping = 1;
+}
+
+static void on_dump(int sig) {
+  (void)sig;
+  dump_requested = 1;
+}
+
+static void print_totals(void) {
+  printf("%sServed %lu jobs (%lu succeeded, %lu failed, %d running), busy for %.2fs%s\n", INFO_COLOR,
+         (unsigned long)totals.started, (unsigned long)totals.succeeded, (unsigned long)totals.failed,
+         num_jobs, totals.busy_ns / 1e9, COLOR_RESET);
+  printf("%sLearned %lu remembered answers and %lu binary hashes; %lu of %lu execs trusted; %d answers remembered in all%s\n",
+         INFO_COLOR, (unsigned long)totals.answers, (unsigned long)totals.hashes,
+         (unsigned long)totals.trusted, (unsigned long)totals.execs, verdict_cache_count(), COLOR_RESET);
+  fflush(stdout);
+}
+
+// ---- Job side ----
+
+static void send_record(const char *format, ...) {
+  char record[RECORD_MAX];
+  va_list ap;
+  va_start(ap, format);
+  int len = vsnprintf(record, sizeof(record), format, ap);
+  va_end(ap);
+  if (len < 0 || len >= (int)sizeof(record)) {
+    return;
+  }
+  // One write per record (with its NUL), from whichever thread learned it
+  pthread_mutex_lock(&record_lock);
+  if (write(record_fd, record, (size_t)len + 1) == -1) {
+    // The server is gone; the job still finishes
+  }
+  pthread_mutex_unlock(&record_lock);
+}
+
+static void relay_answer(policy_op_t op, const char *path, verdict_scope_t scope, verdict_t verdict) {
+  send_record("V %d %d %d %s", (int)op, (int)scope, (int)verdict, path);
+}
+
+static void relay_hash(const trusted_exec_entry_t *entry) {
+  send_record("X %llu %llu %lld %lld %lld %d", (unsigned long long)entry->dev,
+              (unsigned long long)entry->ino, (long long)entry->mtime_sec,
+              (long long)entry->mtime_nsec, (long long)entry->size, entry->trusted);
+}
+
+static void reply(int conn, const char *format, ...) {
+  char line[512];
+  va_list ap;
+  va_start(ap, format);
+  int len = vsnprintf(line, sizeof(line), format, ap);
+  va_end(ap);
+  if (len > 0 && send(conn, line, (size_t)len < sizeof(line) ? (size_t)len : sizeof(line) - 1,
+                      MSG_NOSIGNAL) == -1) {
+    // The client is gone
+  }
+}
+
+// Relays the client's signal bytes to the program, and a hangup when the
+// client goes away
+static void *watch_client(void *arg) {
+  int conn = (int)(intptr_t)arg;
+  unsigned char sig;
+  for (;;) {
+    ssize_t n = recv(conn, &sig, 1, 0);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    pid_t program = job_program;
+    if (n == 1) {
+      if (program > 0 && sig > 0 && sig < NSIG) {
+        kill(program, sig);
+      }
+      continue;
+    }
+    if (program > 0) {
+      kill(program, SIGHUP);
+    }
+    return NULL;
+  }
+}
+
+static int read_full(int fd, void *buf, size_t size) {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = read(fd, (char *)buf + done, size - done);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return -1;
+    }
+    done += (size_t)n;
+  }
+  return 0;
+}
+
+// Receive the request header and the client's three fds
+static int receive_header(int conn, serve_request_t *header, int fds[3]) {
+  char control[CMSG_SPACE(3 * sizeof(int))];
+  struct iovec iov = { header, sizeof(*header) };
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+  struct cmsghdr *cmsg = n > 0 ? CMSG_FIRSTHDR(&msg) : NULL;
+  if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int))) {
+    return -1;
+  }
+  memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+  // The rest of a short header follows as plain data
+  if ((size_t)n < sizeof(*header) && read_full(conn, (char *)header + n, sizeof(*header) - (size_t)n) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+// Split the payload into cwd, argv and env; returns -1 if it is malformed
+static int parse_payload(char *payload, uint32_t size, uint32_t argc, uint32_t envc,
+                         char **cwd, char **argv, char **env) {
+  char *p = payload;
+  char *end = payload + size;
+  for (uint32_t i = 0; i < 1 + argc + envc; i++) {
+    char *nul = memchr(p, '\0', (size_t)(end - p));
+    if (!nul) {
+      return -1;
+    }
+    if (i == 0) {
+      *cwd = p;
+    } else if (i <= argc) {
+      argv[i - 1] = p;
+    } else {
+      env[i - 1 - argc] = p;
+    }
+    p = nul + 1;
+  }
+  argv[argc] = NULL;
+  env[envc] = NULL;
+  return 0;
+}
+
+static void run_job(int conn, int id, serve_job_t run) {
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  signal(SIGUSR1, SIG_DFL);
+  signal(SIGCHLD, SIG_DFL);
+  // Ctrl-C on the server's terminal stops the server, not its jobs
+  setsid();
+
+  // Only the server's own user may run jobs
+  struct ucred cred;
+  socklen_t cred_len = sizeof(cred);
+  if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == -1 || cred.uid != getuid()) {
+    reply(conn, "error permission denied\n");
+    exit(1);
+  }
+
+  serve_request_t header;
+  int fds[3];
+  if (receive_header(conn, &header, fds) == -1 ||
+      memcmp(header.magic, SERVE_MAGIC, sizeof(SERVE_MAGIC)) != 0 || header.argc == 0 ||
+      header.size > SERVE_MAX_REQUEST || header.argc + header.envc > header.size) {
+    reply(conn, "error malformed request\n");
+    exit(1);
+  }
+  char *payload = malloc(header.size);
+  char **argv = calloc(header.argc + 1, sizeof(char *));
+  char **env = calloc(header.envc + 1, sizeof(char *));
+  char *cwd = NULL;
+  if (!payload || !argv || !env || read_full(conn, payload, header.size) == -1 ||
+      parse_payload(payload, header.size, header.argc, header.envc, &cwd, argv, env) == -1) {
+    reply(conn, "error malformed request\n");
+    exit(1);
+  }
+
+  // The job runs on the client's terminal or pipes
+  for (int i = 0; i < 3; i++) {
+    if (dup2(fds[i], i) == -1) {
+      reply(conn, "error cannot use the client's fds\n");
+      exit(1);
+    }
+    close(fds[i]);
+  }
+  if (chdir(cwd) == -1) {
+    reply(conn, "error cannot change to %s: %s\n", cwd, strerror(errno));
+    exit(1);
+  }
+  clearenv();
+  for (uint32_t i = 0; i < header.envc; i++) {
+    putenv(env[i]);
+  }
+
+  send_record("N %s", argv[0]);
+  verdict_cache_set_hook(relay_answer);
+  trusted_exec_set_hook(relay_hash);
+
+  pthread_t watcher;
+  if (pthread_create(&watcher, NULL, watch_client, (void *)(intptr_t)conn) == 0) {
+    pthread_detach(watcher);
+  }
+
+  int status = run(argv, id);
+  fflush(stdout);
+
+  trusted_exec_stats_t trusted;
+  trusted_exec_stats(&trusted);
+  send_record("T %llu %llu %llu", (unsigned long long)trusted.execs,
+              (unsigned long long)trusted.trusted, (unsigned long long)trusted.hashed);
+  send_record("E %d", status);
+
+  if (status == -1) {
+    reply(conn, "error the program could not be started\n");
+  } else if (WIFSIGNALED(status)) {
+    reply(conn, "signal %d\n", WTERMSIG(status));
+  } else {
+    reply(conn, "exit %d\n", WEXITSTATUS(status));
+  }
+  exit(0);
+}
+
+void serve_job_program(pid_t pid) {
+  job_program = pid;
+}
+
+// ---- Server side ----
+
+static void apply_record(job_t *job, const char *record) {
+  int op, scope, verdict, offset = 0;
+  unsigned long long dev, ino, execs, trusted, hashed;
+  long long sec, nsec, size;
+  int is_trusted, status;
+
+  switch (record[0]) {
+    case 'N':
+      snprintf(job->program, sizeof(job->program), "%s", record + 2);
+      break;
+    case 'V':
+      if (sscanf(record, "V %d %d %d %n", &op, &scope, &verdict, &offset) == 3 && offset > 0 &&
+          op >= 0 && op < POLICY_OP_COUNT && verdict_cache_remember((policy_op_t)op, record + offset,
+                                                                     (verdict_scope_t)scope,
+                                                                     (verdict_t)verdict) == 0) {
+        totals.answers++;
+      }
+      break;
+    case 'X':
+      if (sscanf(record, "X %llu %llu %lld %lld %lld %d", &dev, &ino, &sec, &nsec, &size, &is_trusted) == 6) {
+        trusted_exec_entry_t entry = { dev, ino, sec, nsec, size, is_trusted };
+        trusted_exec_learn(&entry);
+        totals.hashes++;
+      }
+      break;
+    case 'T':
+      if (sscanf(record, "T %llu %llu %llu", &execs, &trusted, &hashed) == 3) {
+        totals.execs += execs;
+        totals.trusted += trusted;
+      }
+      break;
+    case 'E':
+      if (sscanf(record, "E %d", &status) == 1) {
+        job->status = status;
+      }
+      break;
+  }
+}
+
+// Read what a job sent; returns 0, or -1 once it has closed its end
+static int read_records(job_t *job) {
+  ssize_t n = read(job->fd, job->buf + job->len, sizeof(job->buf) - job->len);
+  if (n == -1 && errno == EINTR) {
+    return 0;
+  }
+  if (n <= 0) {
+    return -1;
+  }
+  job->len += (size_t)n;
+
+  size_t start = 0;
+  for (size_t i = 0; i < job->len; i++) {
+    if (job->buf[i] == '\0') {
+      apply_record(job, job->buf + start);
+      start = i + 1;
+    }
+  }
+  if (start == 0 && job->len == sizeof(job->buf)) {
+    start = job->len;   // A record too long to be valid
+  }
+  memmove(job->buf, job->buf + start, job->len - start);
+  job->len -= start;
+  return 0;
+}
+
+static void finish_job(int index) {
+  job_t *job = &jobs[index];
+  while (waitpid(job->pid, NULL, 0) == -1 && errno == EINTR) {
+  }
+  close(job->fd);
+
+  double ms = (now_ns() - job->start_ns) / 1e6;
+  totals.busy_ns += now_ns() - job->start_ns;
+  if (job->status != -1 && WIFEXITED(job->status) && WEXITSTATUS(job->status) == 0) {
+    totals.succeeded++;
+  } else {
+    totals.failed++;
+  }
+  if (job->status == -1) {
+    printf("[job %d] %s: did not run (%.1fms)\n", job->id, job->program, ms);
+  } else if (WIFSIGNALED(job->status)) {
+    printf("[job %d] %s: terminated by signal %d after %.1fms\n", job->id, job->program,
+           WTERMSIG(job->status), ms);
+  } else {
+    printf("[job %d] %s: exited with status %d after %.1fms\n", job->id, job->program,
+           WEXITSTATUS(job->status), ms);
+  }
+  fflush(stdout);
+  jobs[index] = jobs[--num_jobs];
+}
+
+static void start_job(int conn, serve_job_t run) {
+  if (num_jobs == jobs_cap) {
+    int cap = jobs_cap ? jobs_cap * 2 : 16;
+    job_t *grown = realloc(jobs, (size_t)cap * sizeof(job_t));
+    if (!grown) {
+      perror("realloc");
+      close(conn);
+      return;
+    }
+    jobs = grown;
+    jobs_cap = cap;
+  }
+
+  int pipe_fds[2];
+  if (pipe2(pipe_fds, O_CLOEXEC) == -1) {
+    perror("pipe");
+    close(conn);
+    return;
+  }
+  int id = (int)++totals.started;
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == -1) {
+    perror("fork");
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    close(conn);
+    return;
+  }
+  if (pid == 0) {
+    close(pipe_fds[0]);
+    record_fd = pipe_fds[1];
+    run_job(conn, id, run);
+  }
+
+  close(pipe_fds[1]);
+  close(conn);
+  job_t *job = &jobs[num_jobs++];
+  memset(job, 0, sizeof(*job));
+  job->pid = pid;
+  job->fd = pipe_fds[0];
+  job->id = id;
+  job->start_ns = now_ns();
+  job->status = -1;
+  snprintf(job->program, sizeof(job->program), "?");
+}
+
+static int open_socket(const char *socket_path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Socket path too long: %s\n", socket_path);
+    return -1;
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    perror("socket");
+    return -1;
+  }
+  // Take over a socket left behind, but never one a live server answers on
+  struct stat st;
+  if (lstat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+      fprintf(stderr, "A server is already listening on %s\n", socket_path);
+      close(fd);
+      return -1;
+    }
+    unlink(socket_path);
+  }
+
+  mode_t old_mask = umask(0177);
+  int bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+  umask(old_mask);
+  if (bound == -1 || listen(fd, 64) == -1) {
+    fprintf(stderr, "Cannot listen on %s: %s\n", socket_path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int serve_forever(const char *socket_path, serve_job_t run) {
+  int listen_fd = open_socket(socket_path);
+  if (listen_fd == -1) {
+    return 1;
+  }
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  sigemptyset(&action.sa_mask);
+  action.sa_handler = on_stop;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  action.sa_handler = on_dump;
+  sigaction(SIGUSR1, &action, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  printf("%sServing on %s (pid %d): run jobs with sandbox-run %s <program> [args...], "
+         "print totals with kill -USR1 %d%s\n", INFO_COLOR, socket_path, (int)getpid(), socket_path,
+         (int)getpid(), COLOR_RESET);
+  fflush(stdout);
+
+  struct pollfd *polls = NULL;
+  while (!stopping || num_jobs > 0) {
+    if (dump_requested) {
+      dump_requested = 0;
+      print_totals();
+    }
+    struct pollfd *grown = realloc(polls, (size_t)(num_jobs + 1) * sizeof(struct pollfd));
+    if (!grown) {
+      perror("realloc");
+      break;
+    }
+    polls = grown;
+    // Once stopping, running jobs are waited for but no new ones taken
+    polls[0].fd = stopping ? -1 : listen_fd;
+    polls[0].events = POLLIN;
+    for (int i = 0; i < num_jobs; i++) {
+      polls[i + 1].fd = jobs[i].fd;
+      polls[i + 1].events = POLLIN;
+    }
+    int count = num_jobs;
+    if (poll(polls, (nfds_t)count + 1, -1) == -1) {
+      if (errno != EINTR) {
+        perror("poll");
+        break;
+      }
+      if (stopping && num_jobs > 0) {
+        printf("%sWaiting for %d running jobs%s\n", INFO_COLOR, num_jobs, COLOR_RESET);
+        fflush(stdout);
+      }
+      continue;
+    }
+
+    // Finished jobs are swapped out of the array, so walk it backwards
+    for (int i = count - 1; i >= 0; i--) {
+      if (polls[i + 1].revents && read_records(&jobs[i]) == -1) {
+        finish_job(i);
+      }
+    }
+    if (polls[0].revents & POLLIN) {
+      int conn = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+      if (conn != -1) {
+        start_job(conn, run);
+      }
+    }
+  }
+
+  free(polls);
+  close(listen_fd);
+  unlink(socket_path);
+  print_totals();
+  return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef SANDBOX_SERVER_H
+#define SANDBOX_SERVER_H
+
+#include <sys/types.h>
+
+// `sandbox --serve`: a long-lived supervisor that runs jobs submitted by
+// sandbox-run over a Unix socket. The policy, remembered answers and
+// trusted-binary hashes are loaded once; each job is a fork of the server,
+// so it starts with them warm, and whatever a job learns (new answers,
+// newly hashed binaries) is passed back so later jobs start with it too.
+
+// Runs one job's program under the sandbox with the current environment
+// and cwd. Returns the program's wait status, or -1 if it never started.
+typedef int (*serve_job_t)(char *argv[], int job_id);
+
+// Listen on `socket_path` and run jobs with `run` until SIGINT or SIGTERM.
+// Only the server's own user may connect. Returns 0, or 1 on error.
+int serve_forever(const char *socket_path, serve_job_t run);
+
+// Called by a job once its program is forked, so signals the client
+// forwards (and the hangup when it goes away) reach the program
+void serve_job_program(pid_t pid);
+
+#endif /* SANDBOX_SERVER_H */
@@ -0,0 +1,140 @@
+// Live view of a sandbox started with --stats. Polls the tracer's shared
+// stats segment (the sandbox never pauses for it) and shows, per syscall,
+// the stop rate and stop, peek, policy and decision-wait latencies over
+// the last interval.
+//
+// Usage: sandbox-top <sandbox pid> [interval seconds]
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "tracer_stats.h"
+
+#define MAX_ROWS 25
+
+typedef stats_summary_t snapshot_t[STATS_MAX_SYSCALL][NUM_STATS];
+
+typedef struct {
+  long nr;
+  uint64_t stops;
+} row_t;
+
+static void take_snapshot(const stats_segment_t *segment, snapshot_t *snapshot) {
+  for (long nr = 0; nr < STATS_MAX_SYSCALL; nr++) {
+    for (int kind = 0; kind < NUM_STATS; kind++) {
+      tracer_stats_sum(segment, nr, (stat_kind_t)kind, &(*snapshot)[nr][kind]);
+    }
+  }
+}
+
+// What was recorded between `before` and `after`
+static void subtract(const stats_summary_t *after, const stats_summary_t *before,
+                     stats_summary_t *delta) {
+  delta->count = after->count - before->count;
+  delta->sum_ns = after->sum_ns - before->sum_ns;
+  delta->max_ns = after->max_ns;
+  for (int b = 0; b < STATS_BUCKETS; b++) {
+    delta->buckets[b] = after->buckets[b] - before->buckets[b];
+  }
+}
+
+static void format_percentile(const stats_summary_t *summary, double p, char *buf, size_t size) {
+  if (summary->count == 0) {
+    snprintf(buf, size, "-");
+  } else {
+    stats_format_ns(stats_percentile(summary, p), buf, size);
+  }
+}
+
+static int by_stops(const void *a, const void *b) {
+  const row_t *x = a, *y = b;
+  return x->stops < y->stops ? 1 : x->stops > y->stops ? -1 : (x->nr > y->nr) - (x->nr < y->nr);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <sandbox pid> [interval seconds]\n", argv[0]);
+    return 1;
+  }
+  pid_t pid = (pid_t)atoi(argv[1]);
+  double interval = argc > 2 ? atof(argv[2]) : 1.0;
+  if (interval <= 0) {
+    interval = 1.0;
+  }
+
+  const stats_segment_t *segment = tracer_stats_open(pid);
+  if (!segment) {
+    fprintf(stderr, "No tracer stats for pid %d (was the sandbox started with --stats?)\n", (int)pid);
+    return 1;
+  }
+
+  snapshot_t *previous = calloc(1, sizeof(snapshot_t));
+  snapshot_t *current = calloc(1, sizeof(snapshot_t));
+  if (!previous || !current) {
+    perror("calloc");
+    return 1;
+  }
+  take_snapshot(segment, previous);
+
+  struct timespec pause = { (time_t)interval, (long)((interval - (time_t)interval) * 1e9) };
+  row_t rows[STATS_MAX_SYSCALL];
+  for (;;) {
+    nanosleep(&pause, NULL);
+    if (kill(pid, 0) == -1 && errno == ESRCH) {
+      printf("Sandbox %d has exited\n", (int)pid);
+      return 0;
+    }
+    take_snapshot(segment, current);
+
+    int count = 0;
+    uint64_t total = 0, all_stops = 0;
+    for (long nr = 0; nr < STATS_MAX_SYSCALL; nr++) {
+      uint64_t stops = (*current)[nr][STAT_STOP].count;
+      uint64_t recent = stops - (*previous)[nr][STAT_STOP].count;
+      all_stops += stops;
+      total += recent;
+      if (stops || (*current)[nr][STAT_DECISION].count) {
+        rows[count].nr = nr;
+        rows[count].stops = recent;
+        count++;
+      }
+    }
+    qsort(rows, (size_t)count, sizeof(row_t), by_stops);
+
+    printf("\033[H\033[2J");
+    printf("sandbox %d: %.0f stops/s, %lu stops in total (percentiles over the last %gs, max since start)\n\n",
+           (int)pid, total / interval, (unsigned long)all_stops, interval);
+    printf("%-8s %10s %10s %10s %10s %10s %10s %8s %10s %10s\n", "syscall", "stops/s", "stop p50",
+           "stop p99", "stop max", "peek p50", "policy p50", "waits", "wait p50", "wait max");
+    for (int i = 0; i < count && i < MAX_ROWS; i++) {
+      long nr = rows[i].nr;
+      stats_summary_t delta[NUM_STATS];
+      for (int kind = 0; kind < NUM_STATS; kind++) {
+        subtract(&(*current)[nr][kind], &(*previous)[nr][kind], &delta[kind]);
+      }
+      char stop50[16], stop99[16], stopmax[16], peek50[16], policy50[16], wait50[16], waitmax[16];
+      format_percentile(&delta[STAT_STOP], 0.5, stop50, sizeof(stop50));
+      format_percentile(&delta[STAT_STOP], 0.99, stop99, sizeof(stop99));
+      stats_format_ns(delta[STAT_STOP].max_ns, stopmax, sizeof(stopmax));
+      format_percentile(&delta[STAT_READ_STRING], 0.5, peek50, sizeof(peek50));
+      format_percentile(&delta[STAT_POLICY], 0.5, policy50, sizeof(policy50));
+      format_percentile(&delta[STAT_DECISION], 0.5, wait50, sizeof(wait50));
+      if (delta[STAT_DECISION].max_ns) {
+        stats_format_ns(delta[STAT_DECISION].max_ns, waitmax, sizeof(waitmax));
+      } else {
+        snprintf(waitmax, sizeof(waitmax), "-");
+      }
+      printf("%-8ld %10.0f %10s %10s %10s %10s %10s %8lu %10s %10s\n", nr, rows[i].stops / interval,
+             stop50, stop99, stopmax, peek50, policy50, (unsigned long)delta[STAT_DECISION].count,
+             wait50, waitmax);
+    }
+    fflush(stdout);
+
+    snapshot_t *swap = previous;
+    previous = current;
+    current = swap;
+  }
+}
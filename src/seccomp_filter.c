@@ -0,0 +1,81 @@
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include "seccomp_filter.h"
+
+// x32 ABI syscalls share the x86_64 audit arch but have this bit set
+#define X32_SYSCALL_BIT 0x40000000
+
+// Build and install a filter returning `action` for the listed syscalls.
+// Returns the seccomp() result (a listener fd with NEW_LISTENER), or -1.
+static int install_filter(const int *syscalls, int count, unsigned int action, unsigned int flags) {
+  // Layout: [arch check] [load nr] [x32 check] [one JEQ per syscall]
+  //         [RET ALLOW] [RET action] [RET EPERM]
+  int len = count + 7;
+  struct sock_filter *prog = calloc(len, sizeof(struct sock_filter));
+  if (!prog) {
+    return -1;
+  }
+
+  int deny_idx = len - 1;
+  int action_idx = len - 2;
+  int allow_idx = len - 3;
+  int i = 0;
+
+  prog[i] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+                                         offsetof(struct seccomp_data, arch));
+  i++;
+  // Foreign-arch syscalls (e.g. int 0x80) and x32 ones below use other
+  // numbers and layouts than the supervisor decodes, so they are refused
+  prog[i] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, FILTER_AUDIT_ARCH,
+                                         0, deny_idx - i - 1);
+  i++;
+  prog[i] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+                                         offsetof(struct seccomp_data, nr));
+  i++;
+  prog[i] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, X32_SYSCALL_BIT,
+                                         deny_idx - i - 1, 0);
+  i++;
+
+  for (int s = 0; s < count; s++) {
+    prog[i] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (unsigned int)syscalls[s],
+                                           action_idx - i - 1, 0);
+    i++;
+  }
+
+  prog[allow_idx] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+  prog[action_idx] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, action);
+  prog[deny_idx] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | EPERM);
+
+  struct sock_fprog fprog = {
+    .len = (unsigned short)len,
+    .filter = prog,
+  };
+
+  // Required to install a filter without CAP_SYS_ADMIN
+  if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == -1) {
+    free(prog);
+    return -1;
+  }
+
+  int ret = (int)syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, flags, &fprog);
+  int saved_errno = errno;
+  free(prog);
+  errno = saved_errno;
+  return ret;
+}
+
+int install_trace_filter(const int *syscalls, int count) {
+  return install_filter(syscalls, count, SECCOMP_RET_TRACE, 0) == -1 ? -1 : 0;
+}
+
+int install_notify_filter(const int *syscalls, int count) {
+  return install_filter(syscalls, count, SECCOMP_RET_USER_NOTIF,
+                        SECCOMP_FILTER_FLAG_NEW_LISTENER);
+}
@@ -0,0 +1,29 @@
+#ifndef SECCOMP_FILTER_H
+#define SECCOMP_FILTER_H
+
+#include <linux/audit.h>
+
+// Audit arch of the native syscall ABI, the only one that gets decoded
+#if defined(__x86_64__)
+  #define FILTER_AUDIT_ARCH AUDIT_ARCH_X86_64
+#elif defined(__aarch64__)
+  #define FILTER_AUDIT_ARCH AUDIT_ARCH_AARCH64
+#else
+  #error "seccomp filter: unsupported architecture"
+#endif
+
+// Install a seccomp-BPF filter in the calling process that returns
+// SECCOMP_RET_TRACE for every syscall number in `syscalls` and
+// SECCOMP_RET_ALLOW for everything else. Meant to be called in the
+// child after PTRACE_TRACEME and right before execvp, so the tracer
+// only gets stopped for the syscalls it actually inspects. Syscalls of
+// any other ABI (i386 int 0x80, x32) fail with EPERM.
+// Returns 0 on success, -1 on failure (errno is set).
+int install_trace_filter(const int *syscalls, int count);
+
+// Same as install_trace_filter(), but the listed syscalls are routed to a
+// seccomp user-notification fd instead of a ptrace tracer.
+// Returns the listener fd, or -1 on failure (errno is set).
+int install_notify_filter(const int *syscalls, int count);
+
+#endif /* SECCOMP_FILTER_H */
@@ -0,0 +1,30 @@
+#ifndef SERVE_PROTOCOL_H
+#define SERVE_PROTOCOL_H
+
+#include <stdint.h>
+
+// What sandbox-run and `sandbox --serve` say over the server's Unix
+// socket. The client sends one request: this header, with its stdin,
+// stdout and stderr attached as SCM_RIGHTS, then `size` bytes holding the
+// working directory, the `argc` arguments and the `envc` environment
+// strings, each NUL-terminated. The job runs on the client's own fds, so
+// its output and the sandbox's prompts and events reach the client
+// directly.
+//
+// While the job runs, each byte the client sends is a signal number to
+// deliver to the program; closing the connection hangs it up. The server
+// answers with one line: "exit <status>", "signal <number>" or
+// "error <message>".
+
+#define SERVE_MAGIC "SBXRUN1"
+#define SERVE_MAX_REQUEST (1 << 20)
+
+typedef struct {
+  char magic[8];
+  uint32_t argc;
+  uint32_t envc;
+  uint32_t size;
+  uint32_t reserved;
+} serve_request_t;
+
+#endif /* SERVE_PROTOCOL_H */
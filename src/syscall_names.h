@@ -0,0 +1,11 @@
+#ifndef SYSCALL_NAMES_H
+#define SYSCALL_NAMES_H
+
+// First syscall number shared by every architecture (pidfd_send_signal)
+#define SYSCALL_NAMES_UNIFIED 424
+
+// Name of syscall `syscall_nr` on the architecture being built for, e.g.
+// "openat", or NULL if it is not known
+const char *syscall_name(long syscall_nr);
+
+#endif /* SYSCALL_NAMES_H */
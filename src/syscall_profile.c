@@ -0,0 +1,163 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "syscall_names.h"
+#include "syscall_profile.h"
+#include "tracer_stats.h"
+
+typedef struct {
+  uint64_t calls;       // Entries seen
+  uint64_t timed;       // Calls whose exit was seen too
+  uint64_t errors;
+  uint64_t wall_ns;
+  uint64_t kernel_ns;
+  uint64_t tracer_ns;
+  uint64_t part_ns[NUM_PROFILE_PARTS];
+} profile_row_t;
+
+struct syscall_profile {
+  profile_row_t rows[STATS_MAX_SYSCALL];
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+syscall_profile_t *syscall_profile_new(void) {
+  return calloc(1, sizeof(syscall_profile_t));
+}
+
+void syscall_profile_free(syscall_profile_t *profile) {
+  free(profile);
+}
+
+uint64_t syscall_profile_start(const syscall_profile_t *profile) {
+  return profile ? now_ns() : 0;
+}
+
+void syscall_profile_part(syscall_profile_t *profile, long syscall_nr, profile_part_t part, uint64_t start) {
+  if (!profile || !start || syscall_nr < 0 || syscall_nr >= STATS_MAX_SYSCALL) {
+    return;
+  }
+  profile->rows[syscall_nr].part_ns[part] += now_ns() - start;
+}
+
+void syscall_profile_enter(syscall_profile_t *profile, long syscall_nr) {
+  if (profile && syscall_nr >= 0 && syscall_nr < STATS_MAX_SYSCALL) {
+    profile->rows[syscall_nr].calls++;
+  }
+}
+
+void syscall_profile_exit(syscall_profile_t *profile, long syscall_nr, long ret, uint64_t wall_ns,
+                          uint64_t kernel_ns, uint64_t tracer_ns) {
+  if (!profile || syscall_nr < 0 || syscall_nr >= STATS_MAX_SYSCALL) {
+    return;
+  }
+  profile_row_t *row = &profile->rows[syscall_nr];
+  row->timed++;
+  // Only the last 4095 values are errors; mmap and friends return addresses
+  if (ret < 0 && ret > -4096) {
+    row->errors++;
+  }
+  row->wall_ns += wall_ns;
+  row->kernel_ns += kernel_ns;
+  row->tracer_ns += tracer_ns;
+}
+
+typedef struct {
+  long nr;
+  profile_row_t row;
+} ranked_row_t;
+
+static int by_wall(const void *a, const void *b) {
+  const ranked_row_t *x = a, *y = b;
+  if (x->row.wall_ns != y->row.wall_ns) {
+    return x->row.wall_ns < y->row.wall_ns ? 1 : -1;
+  }
+  return (x->row.calls < y->row.calls) - (x->row.calls > y->row.calls);
+}
+
+static double percent(uint64_t part, uint64_t whole) {
+  return whole ? 100.0 * (double)part / (double)whole : 0.0;
+}
+
+static void print_row(const char *name, const profile_row_t *row, uint64_t total_wall, FILE *out) {
+  fprintf(out, "%6.2f %11.6f %11.2f %7.1f%% %7.1f%% %7.1f%% %7.1f%% %7.1f%% %10lu %8lu  %s\n",
+          percent(row->wall_ns, total_wall), row->wall_ns / 1e9,
+          row->timed ? row->wall_ns / 1e3 / (double)row->timed : 0.0, percent(row->kernel_ns, row->wall_ns),
+          percent(row->tracer_ns, row->wall_ns), percent(row->part_ns[PROFILE_PTRACE], row->wall_ns),
+          percent(row->part_ns[PROFILE_MEMORY], row->wall_ns), percent(row->part_ns[PROFILE_POLICY], row->wall_ns),
+          (unsigned long)row->calls, (unsigned long)row->errors, name);
+}
+
+void syscall_profile_report(syscall_profile_t **profiles, int count, FILE *out) {
+  ranked_row_t *ranked = calloc(STATS_MAX_SYSCALL, sizeof(ranked_row_t));
+  if (!ranked) {
+    perror("calloc");
+    return;
+  }
+  int rows = 0;
+  profile_row_t total;
+  memset(&total, 0, sizeof(total));
+  for (long nr = 0; nr < STATS_MAX_SYSCALL; nr++) {
+    profile_row_t sum;
+    memset(&sum, 0, sizeof(sum));
+    for (int i = 0; i < count; i++) {
+      const profile_row_t *row = &profiles[i]->rows[nr];
+      sum.calls += row->calls;
+      sum.timed += row->timed;
+      sum.errors += row->errors;
+      sum.wall_ns += row->wall_ns;
+      sum.kernel_ns += row->kernel_ns;
+      sum.tracer_ns += row->tracer_ns;
+      for (int part = 0; part < NUM_PROFILE_PARTS; part++) {
+        sum.part_ns[part] += row->part_ns[part];
+      }
+    }
+    if (!sum.calls) {
+      continue;
+    }
+    ranked[rows].nr = nr;
+    ranked[rows++].row = sum;
+    total.calls += sum.calls;
+    total.timed += sum.timed;
+    total.errors += sum.errors;
+    total.wall_ns += sum.wall_ns;
+    total.kernel_ns += sum.kernel_ns;
+    total.tracer_ns += sum.tracer_ns;
+    for (int part = 0; part < NUM_PROFILE_PARTS; part++) {
+      total.part_ns[part] += sum.part_ns[part];
+    }
+  }
+  qsort(ranked, (size_t)rows, sizeof(ranked_row_t), by_wall);
+
+  fprintf(out, "\nSyscall profile (time from entry stop to resuming after the exit stop; kernel and\n"
+               "tracer as a share of it)\n");
+  fprintf(out, "%6s %11s %11s %8s %8s %8s %8s %8s %10s %8s  %s\n", "% time", "seconds", "usecs/call",
+          "kernel", "tracer", "ptrace", "memory", "policy", "calls", "errors", "syscall");
+  for (int i = 0; i < rows; i++) {
+    char number[32];
+    const char *name = syscall_name(ranked[i].nr);
+    if (!name) {
+      snprintf(number, sizeof(number), "syscall_%ld", ranked[i].nr);
+      name = number;
+    }
+    print_row(name, &ranked[i].row, total.wall_ns, out);
+  }
+  print_row("total", &total, total.wall_ns, out);
+
+  // The rest of the tracer time goes to decoding, the fd table and the
+  // trace loop itself
+  uint64_t parts = total.part_ns[PROFILE_PTRACE] + total.part_ns[PROFILE_MEMORY] + total.part_ns[PROFILE_POLICY];
+  uint64_t shown[6] = { total.tracer_ns, total.wall_ns, total.part_ns[PROFILE_PTRACE], total.part_ns[PROFILE_MEMORY],
+                        total.part_ns[PROFILE_POLICY], total.tracer_ns > parts ? total.tracer_ns - parts : 0 };
+  char text[6][16];
+  for (int i = 0; i < 6; i++) {
+    stats_format_ns(shown[i], text[i], sizeof(text[i]));
+  }
+  fprintf(out, "Tracer overhead: %s of %s (ptrace %s, memory reads %s, policy %s, other %s)\n", text[0], text[1],
+          text[2], text[3], text[4], text[5]);
+  free(ranked);
+}
@@ -0,0 +1,48 @@
+#ifndef SYSCALL_PROFILE_H
+#define SYSCALL_PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// strace -c style profile of every syscall the sandboxed program makes
+// (--profile). The time from a syscall's entry stop to its task resuming
+// after the exit stop is split into kernel time, when the task was running
+// in the syscall, and tracer time, when it sat stopped while the sandbox
+// looked at it; part of the tracer time is further put down to ptrace
+// calls, reading tracee memory and the policy. Time a task spends parked
+// for the broker's answer counts as neither. Each tracer thread owns one
+// profile, so recording is plain additions.
+
+typedef enum {
+  PROFILE_PTRACE,     // Syscall info and resume requests
+  PROFILE_MEMORY,     // Copying path arguments and structs out of the tracee
+  PROFILE_POLICY,     // Policy, remembered answers and queueing for the broker
+  NUM_PROFILE_PARTS
+} profile_part_t;
+
+typedef struct syscall_profile syscall_profile_t;
+
+// An empty profile, or NULL if out of memory
+syscall_profile_t *syscall_profile_new(void);
+
+void syscall_profile_free(syscall_profile_t *profile);
+
+// Timestamp for syscall_profile_part(); 0 when `profile` is NULL
+uint64_t syscall_profile_start(const syscall_profile_t *profile);
+
+// Put the time since `start` down to `part` of `syscall_nr`. Does nothing
+// when `profile` is NULL or `start` is 0.
+void syscall_profile_part(syscall_profile_t *profile, long syscall_nr, profile_part_t part, uint64_t start);
+
+// Count an entry into `syscall_nr`
+void syscall_profile_enter(syscall_profile_t *profile, long syscall_nr);
+
+// Add a call of `syscall_nr` that returned `ret` after `wall_ns`, of
+// which `kernel_ns` were spent in the kernel and `tracer_ns` stopped
+void syscall_profile_exit(syscall_profile_t *profile, long syscall_nr, long ret, uint64_t wall_ns,
+                          uint64_t kernel_ns, uint64_t tracer_ns);
+
+// Print the syscalls of all `count` profiles to `out`, most time first
+void syscall_profile_report(syscall_profile_t **profiles, int count, FILE *out);
+
+#endif /* SYSCALL_PROFILE_H */
@@ -0,0 +1,136 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "task_table.h"
+
+// Open-addressing index from tid to task (NULL = empty slot). Tasks are
+// allocated individually so pointers stay valid while the index grows.
+struct task_table {
+  task_t **slots;
+  uint32_t slots_cap;
+  int live_count;
+};
+
+static uint32_t tid_hash(pid_t tid) {
+  uint32_t h = (uint32_t)tid * 2654435761u;
+  return h ^ (h >> 16);
+}
+
+task_table_t *task_table_new(void) {
+  return calloc(1, sizeof(task_table_t));
+}
+
+static int slots_grow(task_table_t *table) {
+  uint32_t new_cap = table->slots_cap ? table->slots_cap * 2 : 256;
+  task_t **grown = calloc(new_cap, sizeof(task_t *));
+  if (!grown) {
+    return -1;
+  }
+
+  uint32_t mask = new_cap - 1;
+  for (uint32_t i = 0; i < table->slots_cap; i++) {
+    task_t *task = table->slots[i];
+    if (task) {
+      uint32_t pos = tid_hash(task->tid) & mask;
+      while (grown[pos]) {
+        pos = (pos + 1) & mask;
+      }
+      grown[pos] = task;
+    }
+  }
+
+  free(table->slots);
+  table->slots = grown;
+  table->slots_cap = new_cap;
+  return 0;
+}
+
+task_t *task_find(task_table_t *table, pid_t tid) {
+  if (!table->slots_cap) {
+    return NULL;
+  }
+
+  task_t **slots = table->slots;
+  uint32_t mask = table->slots_cap - 1;
+  for (uint32_t pos = tid_hash(tid) & mask; slots[pos]; pos = (pos + 1) & mask) {
+    if (slots[pos]->tid == tid) {
+      return slots[pos];
+    }
+  }
+  return NULL;
+}
+
+task_t *task_add(task_table_t *table, pid_t tid, int *created) {
+  task_t *task = task_find(table, tid);
+  if (created) {
+    *created = !task;
+  }
+  if (task) {
+    return task;
+  }
+
+  // Keep the index at most half full
+  if ((uint32_t)(table->live_count + 1) * 2 > table->slots_cap && slots_grow(table) == -1) {
+    return NULL;
+  }
+
+  task = calloc(1, sizeof(task_t));
+  if (!task) {
+    return NULL;
+  }
+  task->tid = tid;
+  task->move_to = -1;
+
+  uint32_t mask = table->slots_cap - 1;
+  uint32_t pos = tid_hash(tid) & mask;
+  while (table->slots[pos]) {
+    pos = (pos + 1) & mask;
+  }
+  table->slots[pos] = task;
+  table->live_count++;
+  if (created) {
+    *created = 1;
+  }
+  return task;
+}
+
+void task_clear_path(task_t *task) {
+  path_unref(task->path);
+  task->path = PATH_ID_NONE;
+}
+
+void task_remove(task_table_t *table, pid_t tid) {
+  if (!table->slots_cap) {
+    return;
+  }
+
+  task_t **slots = table->slots;
+  uint32_t mask = table->slots_cap - 1;
+  uint32_t pos = tid_hash(tid) & mask;
+  while (slots[pos] && slots[pos]->tid != tid) {
+    pos = (pos + 1) & mask;
+  }
+  if (!slots[pos]) {
+    return;
+  }
+
+  task_t *task = slots[pos];
+  task_clear_path(task);
+  fd_table_release(task->fds);
+  free(task);
+  table->live_count--;
+
+  // Backward-shift delete, as in the path store index
+  uint32_t hole = pos;
+  for (uint32_t next = (hole + 1) & mask; slots[next]; next = (next + 1) & mask) {
+    uint32_t home = tid_hash(slots[next]->tid) & mask;
+    if (((next - home) & mask) >= ((next - hole) & mask)) {
+      slots[hole] = slots[next];
+      hole = next;
+    }
+  }
+  slots[hole] = NULL;
+}
+
+int task_count(const task_table_t *table) {
+  return table->live_count;
+}
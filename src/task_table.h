@@ -0,0 +1,55 @@
+#ifndef TASK_TABLE_H
+#define TASK_TABLE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "fd_table.h"
+#include "path_store.h"
+
+// Tracer-side state of one traced thread, keyed by tid
+typedef struct {
+  pid_t tid;
+  int in_syscall;           // Entered a syscall whose exit stop is still to come
+  long syscall_nr;          // Syscall entered, valid while in_syscall
+  unsigned long args[6];    // Its arguments, as seen at entry
+  path_id_t path;           // Path argument captured at entry (one reference)
+  int open_flags;           // Its open flags, for the fd the exit stop records
+  fd_table_t *fds;          // File table; NULL until the creating fork/clone is seen
+  int started;              // Set once the initial SIGSTOP has been consumed
+  int parked;               // Stopped, waiting for its fds before it may run
+  int move_to;              // Tracer shard to hand the task to, -1 to keep it
+  int handed_off;           // Seized from another shard's detach
+  int sigcont_sent;         // SIGCONT sent to end a handoff's stop; not forwarded
+  int trusted;              // Runs an allowlisted executable (--trust): syscalls go unchecked
+  unsigned int decision;    // Ticket of the broker answer it is parked for, 0 = none
+  uint64_t stopped_ns;      // When its current syscall stop was reaped (--stats), else 0
+  uint64_t parked_ns;       // When it was parked for a broker answer (--stats), else 0
+  uint64_t profile_start_ns;    // --profile: when its current syscall's entry stop was reaped
+  uint64_t profile_resumed_ns;  // When it last went back into that syscall, 0 while stopped
+  uint64_t profile_kernel_ns;   // Time spent running in it so far
+  uint64_t profile_tracer_ns;   // Time spent stopped by the tracer so far
+} task_t;
+
+// The tasks one tracer thread owns. Only the owning thread touches it.
+typedef struct task_table task_table_t;
+
+task_table_t *task_table_new(void);
+
+// Find the task for `tid`, or NULL. O(1).
+task_t *task_find(task_table_t *table, pid_t tid);
+
+// Find or create the task for `tid`. A new task has no fd table and no
+// syscall in progress; `*created` (if given) says whether it is new.
+// Returns NULL if out of memory.
+task_t *task_add(task_table_t *table, pid_t tid, int *created);
+
+// Forget `tid`: drop its captured path and its reference on the fd table
+void task_remove(task_table_t *table, pid_t tid);
+
+// Drop the path captured at syscall entry, if any
+void task_clear_path(task_t *task);
+
+// Number of tasks in the table
+int task_count(const task_table_t *table);
+
+#endif /* TASK_TABLE_H */
@@ -0,0 +1,249 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "trace_file.h"
+
+struct trace_writer {
+  FILE *file;
+  uint64_t records;
+  // Path table being built: offsets[i] is where path i starts in `strings`
+  uint64_t *offsets;
+  uint64_t paths;
+  uint64_t offsets_cap;
+  char *strings;
+  uint64_t strings_size;
+  uint64_t strings_cap;
+  // Open-addressing index of the paths seen so far (0 = empty slot)
+  uint32_t *index;
+  uint64_t index_cap;
+};
+
+static uint64_t hash_path(const char *path) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+    h = (h ^ *p) * 0x100000001b3ULL;
+  }
+  return h;
+}
+
+static int grow_index(trace_writer_t *writer) {
+  uint64_t cap = writer->index_cap * 2;
+  uint32_t *index = calloc(cap, sizeof(uint32_t));
+  if (!index) {
+    return -1;
+  }
+  for (uint64_t i = 0; i < writer->index_cap; i++) {
+    uint32_t id = writer->index[i];
+    if (id) {
+      uint64_t slot = hash_path(writer->strings + writer->offsets[id]) & (cap - 1);
+      while (index[slot]) {
+        slot = (slot + 1) & (cap - 1);
+      }
+      index[slot] = id;
+    }
+  }
+  free(writer->index);
+  writer->index = index;
+  writer->index_cap = cap;
+  return 0;
+}
+
+// Index of `path` in the table, adding it the first time. 0 on error.
+static uint32_t intern(trace_writer_t *writer, const char *path) {
+  if (!path || !*path) {
+    return 0;
+  }
+  uint64_t mask = writer->index_cap - 1;
+  uint64_t slot = hash_path(path) & mask;
+  for (uint32_t id; (id = writer->index[slot]); slot = (slot + 1) & mask) {
+    if (strcmp(writer->strings + writer->offsets[id], path) == 0) {
+      return id;
+    }
+  }
+
+  size_t len = strlen(path) + 1;
+  if (writer->strings_size + len > writer->strings_cap) {
+    uint64_t cap = writer->strings_cap * 2;
+    while (cap < writer->strings_size + len) {
+      cap *= 2;
+    }
+    char *strings = realloc(writer->strings, cap);
+    if (!strings) {
+      return 0;
+    }
+    writer->strings = strings;
+    writer->strings_cap = cap;
+  }
+  if (writer->paths + 1 == writer->offsets_cap) {
+    uint64_t *offsets = realloc(writer->offsets, writer->offsets_cap * 2 * sizeof(uint64_t));
+    if (!offsets) {
+      return 0;
+    }
+    writer->offsets = offsets;
+    writer->offsets_cap *= 2;
+  }
+
+  uint32_t id = (uint32_t)++writer->paths;
+  writer->offsets[id] = writer->strings_size;
+  memcpy(writer->strings + writer->strings_size, path, len);
+  writer->strings_size += len;
+  writer->index[slot] = id;
+  // Keep the index at most half full
+  if (writer->paths * 2 > writer->index_cap && grow_index(writer) == -1) {
+    return 0;
+  }
+  return id;
+}
+
+static void free_writer(trace_writer_t *writer) {
+  free(writer->offsets);
+  free(writer->strings);
+  free(writer->index);
+  free(writer);
+}
+
+trace_writer_t *trace_writer_open(const char *filename) {
+  trace_writer_t *writer = calloc(1, sizeof(trace_writer_t));
+  if (!writer) {
+    perror("calloc");
+    return NULL;
+  }
+  writer->offsets_cap = 1024;
+  writer->strings_cap = 65536;
+  writer->index_cap = 2048;
+  writer->offsets = calloc(writer->offsets_cap, sizeof(uint64_t));
+  writer->strings = malloc(writer->strings_cap);
+  writer->index = calloc(writer->index_cap, sizeof(uint32_t));
+  if (!writer->offsets || !writer->strings || !writer->index) {
+    perror("calloc");
+    free_writer(writer);
+    return NULL;
+  }
+
+  // Close-on-exec so the sandboxed program cannot write to it
+  writer->file = fopen(filename, "wbe");
+  if (!writer->file) {
+    fprintf(stderr, "Cannot open trace %s: %s\n", filename, strerror(errno));
+    free_writer(writer);
+    return NULL;
+  }
+  // Room for the header, filled in by trace_writer_close()
+  trace_header_t header;
+  memset(&header, 0, sizeof(header));
+  fwrite(&header, sizeof(header), 1, writer->file);
+  return writer;
+}
+
+int trace_writer_add(trace_writer_t *writer, const event_record_t *record, const char *path,
+                     const char *path2) {
+  event_record_t out = *record;
+  out.path = intern(writer, path);
+  out.path2 = intern(writer, path2);
+  if (fwrite(&out, sizeof(out), 1, writer->file) != 1) {
+    return -1;
+  }
+  writer->records++;
+  return 0;
+}
+
+long trace_writer_close(trace_writer_t *writer) {
+  trace_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+  header.version = TRACE_VERSION;
+  header.record_size = sizeof(event_record_t);
+  header.records = writer->records;
+  header.paths = writer->paths;
+  header.paths_offset = sizeof(header) + writer->records * sizeof(event_record_t);
+  header.strings_offset = header.paths_offset + (writer->paths + 1) * sizeof(uint64_t);
+  header.strings_size = writer->strings_size;
+
+  int failed = fwrite(writer->offsets, sizeof(uint64_t), writer->paths + 1, writer->file) != writer->paths + 1 ||
+               fwrite(writer->strings, 1, writer->strings_size, writer->file) != writer->strings_size ||
+               fseek(writer->file, 0, SEEK_SET) == -1 ||
+               fwrite(&header, sizeof(header), 1, writer->file) != 1;
+  failed |= fclose(writer->file) != 0;
+  long records = (long)writer->records;
+  free_writer(writer);
+  if (failed) {
+    perror("trace");
+    return -1;
+  }
+  return records;
+}
+
+int trace_open(const char *filename, trace_t *trace) {
+  memset(trace, 0, sizeof(*trace));
+  int fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    fprintf(stderr, "Cannot open trace %s: %s\n", filename, strerror(errno));
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(trace_header_t)) {
+    fprintf(stderr, "%s: not a sandbox trace\n", filename);
+    close(fd);
+    return -1;
+  }
+  void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    perror("mmap");
+    return -1;
+  }
+
+  const trace_header_t *header = map;
+  uint64_t size = (uint64_t)st.st_size;
+  int valid = memcmp(header->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) == 0 &&
+              header->version == TRACE_VERSION && header->record_size == sizeof(event_record_t) &&
+              header->records <= (size - sizeof(*header)) / sizeof(event_record_t) &&
+              header->paths_offset == sizeof(*header) + header->records * sizeof(event_record_t) &&
+              header->paths < size / sizeof(uint64_t) &&
+              header->strings_offset == header->paths_offset + (header->paths + 1) * sizeof(uint64_t) &&
+              header->strings_offset <= size && header->strings_size == size - header->strings_offset;
+  if (valid) {
+    // Every path has to end inside the string table
+    const uint64_t *offsets = (const uint64_t *)((const char *)map + header->paths_offset);
+    const char *strings = (const char *)map + header->strings_offset;
+    valid = header->strings_size == 0 || strings[header->strings_size - 1] == '\0';
+    for (uint64_t i = 1; valid && i <= header->paths; i++) {
+      valid = offsets[i] < header->strings_size;
+    }
+    // And every record may only name paths the table has
+    const event_record_t *records = (const event_record_t *)((const char *)map + sizeof(*header));
+    for (uint64_t i = 0; valid && i < header->records; i++) {
+      valid = records[i].path <= header->paths && records[i].path2 <= header->paths;
+    }
+  }
+  if (!valid) {
+    fprintf(stderr, "%s: not a complete sandbox trace\n", filename);
+    munmap(map, (size_t)size);
+    return -1;
+  }
+
+  trace->header = header;
+  trace->records = (const event_record_t *)((const char *)map + sizeof(*header));
+  trace->path_offsets = (const uint64_t *)((const char *)map + header->paths_offset);
+  trace->strings = (const char *)map + header->strings_offset;
+  trace->size = (size_t)size;
+  return 0;
+}
+
+const char *trace_path(const trace_t *trace, uint32_t index) {
+  if (index == 0 || index > trace->header->paths) {
+    return NULL;
+  }
+  return trace->strings + trace->path_offsets[index];
+}
+
+void trace_close(trace_t *trace) {
+  if (trace->header) {
+    munmap((void *)trace->header, trace->size);
+    trace->header = NULL;
+  }
+}
@@ -0,0 +1,65 @@
+#ifndef TRACE_FILE_H
+#define TRACE_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "event_log.h"
+
+// A recorded trace (--record): every decided event of a run, laid out so
+// sandbox-replay can memory-map it and scan it without parsing.
+//
+//   trace_header_t
+//   event_record_t[records]      `path` / `path2` index the path table
+//   uint64_t[paths + 1]          offset of each path in the string table
+//   char[strings_size]           the paths, NUL-terminated, each stored once
+//
+// Path index 0 means "no path", as PATH_ID_NONE does. The header is written
+// last, so a trace whose run was cut short has no records.
+
+#define TRACE_MAGIC "SBXTRC1"
+#define TRACE_VERSION 1
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;    // sizeof(event_record_t) of the writer
+  uint64_t records;
+  uint64_t paths;          // Path table entries, not counting index 0
+  uint64_t paths_offset;   // File offset of the path offsets
+  uint64_t strings_offset;
+  uint64_t strings_size;
+} trace_header_t;
+
+typedef struct trace_writer trace_writer_t;
+
+// Create `filename` and start a trace. Returns NULL (after printing why)
+// on error.
+trace_writer_t *trace_writer_open(const char *filename);
+
+// Append an event; `record`'s path fields are ignored in favour of `path`
+// and `path2` (NULL or "" for none). Single-threaded.
+int trace_writer_add(trace_writer_t *writer, const event_record_t *record, const char *path,
+                     const char *path2);
+
+// Write the path table and the header, and close the file. Returns the
+// number of records, or -1 on error.
+long trace_writer_close(trace_writer_t *writer);
+
+// A mapped trace
+typedef struct {
+  const trace_header_t *header;
+  const event_record_t *records;
+  const uint64_t *path_offsets;
+  const char *strings;
+  size_t size;
+} trace_t;
+
+// Map and validate a trace. Returns 0, or -1 after printing why.
+int trace_open(const char *filename, trace_t *trace);
+
+// The path at `index` in the trace's table, or NULL for 0
+const char *trace_path(const trace_t *trace, uint32_t index);
+
+void trace_close(trace_t *trace);
+
+#endif /* TRACE_FILE_H */
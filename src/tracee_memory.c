@@ -0,0 +1,173 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "tracee_memory.h"
+
+// Set by tracee_memory_init() before any thread reads tracee memory
+static size_t page_size = 4096;
+
+void tracee_memory_init(void) {
+  long ps = sysconf(_SC_PAGESIZE);
+  page_size = ps > 0 ? (size_t)ps : 4096;
+}
+
+// Bulk read with process_vm_readv, never crossing a page boundary so a
+// string that ends just before an unmapped page is still readable.
+// Returns the string length, -2 if no terminator fit in the buffer, or -1
+// (with `*done` set to the bytes copied so far) if a read failed.
+static ssize_t read_string_vm(pid_t child_pid, unsigned long addr, char *buf,
+                              size_t size, size_t *done) {
+  size_t total = 0;
+
+  while (total < size - 1) {
+    unsigned long cur = addr + total;
+    size_t chunk = page_size - (cur & (page_size - 1));
+    if (chunk > size - 1 - total) {
+      chunk = size - 1 - total;
+    }
+
+    struct iovec local = { buf + total, chunk };
+    struct iovec remote = { (void *)cur, chunk };
+    ssize_t n = process_vm_readv(child_pid, &local, 1, &remote, 1, 0);
+    if (n <= 0) {
+      *done = total;
+      return -1;
+    }
+
+    // glibc's memchr scans for the terminator a vector at a time
+    char *nul = memchr(buf + total, '\0', (size_t)n);
+    if (nul) {
+      return nul - buf;
+    }
+    total += (size_t)n;
+  }
+
+  return -2;
+}
+
+// Word-at-a-time fallback for kernels or tracees where process_vm_readv
+// is not permitted. Continues from offset `start`.
+static ssize_t read_string_peek(pid_t child_pid, unsigned long addr, char *buf,
+                                size_t size, size_t start) {
+  // Resume on a word boundary relative to addr
+  size_t i = start - (start % sizeof(long));
+
+  while (i + sizeof(long) <= size - 1) {
+    long data;
+
+    errno = 0;
+    data = ptrace(PTRACE_PEEKDATA, child_pid, addr + i, NULL);
+    if (errno != 0) {
+      perror("ptrace peek");
+      break;
+    }
+
+    memcpy(buf + i, &data, sizeof(long));
+
+    char *nul = memchr(buf + i, '\0', sizeof(long));
+    if (nul) {
+      return nul - buf;
+    }
+
+    i += sizeof(long);
+  }
+
+  // Terminate after the last byte actually read, never past the buffer
+  buf[i] = '\0';
+  return i > 0 ? (ssize_t)i : -1;
+}
+
+ssize_t read_string(pid_t child_pid, unsigned long addr, char *buf, size_t size) {
+  if (!buf || size == 0) {
+    return -1;
+  }
+  buf[0] = '\0';
+  if (size == 1) {
+    return 0;
+  }
+
+  size_t done = 0;
+  ssize_t len = read_string_vm(child_pid, addr, buf, size, &done);
+  if (len >= 0) {
+    return len;
+  }
+  if (len == -2) {
+    // Truncate over-long strings
+    buf[size - 1] = '\0';
+    return (ssize_t)(size - 1);
+  }
+
+  return read_string_peek(child_pid, addr, buf, size, done);
+}
+
+ssize_t read_string_proc(pid_t pid, unsigned long addr, char *buf, size_t size) {
+  if (!buf || size == 0) {
+    return -1;
+  }
+  buf[0] = '\0';
+
+  char mem_path[64];
+  snprintf(mem_path, sizeof(mem_path), "/proc/%d/mem", (int)pid);
+  int fd = open(mem_path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return -1;
+  }
+
+  size_t total = 0;
+  ssize_t result = -1;
+  while (total < size - 1) {
+    unsigned long cur = addr + total;
+    size_t chunk = page_size - (cur & (page_size - 1));
+    if (chunk > size - 1 - total) {
+      chunk = size - 1 - total;
+    }
+
+    ssize_t n = pread(fd, buf + total, chunk, (off_t)cur);
+    if (n <= 0) {
+      break;
+    }
+
+    char *nul = memchr(buf + total, '\0', (size_t)n);
+    if (nul) {
+      result = nul - buf;
+      break;
+    }
+    total += (size_t)n;
+  }
+
+  close(fd);
+  if (result < 0) {
+    // Truncated or unreadable: keep what we have, terminated
+    buf[total] = '\0';
+    result = total > 0 ? (ssize_t)total : -1;
+  }
+  return result;
+}
+
+ssize_t read_memory(pid_t child_pid, unsigned long addr, void *buf, size_t size) {
+  struct iovec local = { buf, size };
+  struct iovec remote = { (void *)addr, size };
+  ssize_t n = process_vm_readv(child_pid, &local, 1, &remote, 1, 0);
+  if (n == (ssize_t)size) {
+    return n;
+  }
+
+  // Fall back to word-sized peeks; the tracee is ptrace-stopped
+  size_t i = 0;
+  while (i < size) {
+    errno = 0;
+    long data = ptrace(PTRACE_PEEKDATA, child_pid, addr + i, NULL);
+    if (errno != 0) {
+      return i > 0 ? (ssize_t)i : -1;
+    }
+    size_t chunk = size - i < sizeof(long) ? size - i : sizeof(long);
+    memcpy((char *)buf + i, &data, chunk);
+    i += chunk;
+  }
+  return (ssize_t)size;
+}
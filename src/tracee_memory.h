@@ -0,0 +1,26 @@
+#ifndef TRACEE_MEMORY_H
+#define TRACEE_MEMORY_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Look up the page size the readers below step by. Call once, before any
+// thread that reads tracee memory starts.
+void tracee_memory_init(void);
+
+// Read a NUL-terminated string from the tracee's memory at `addr` into the
+// caller-owned buffer `buf` of `size` bytes. Reads a page at a time with
+// process_vm_readv and only falls back to PTRACE_PEEKDATA when that fails.
+// The result is always NUL-terminated (truncated if longer than size - 1).
+// Returns the string length, or -1 if nothing could be read.
+ssize_t read_string(pid_t child_pid, unsigned long addr, char *buf, size_t size);
+
+// Same as read_string(), but reads through /proc/<pid>/mem so it works
+// on processes that are not ptrace-stopped (seccomp user notifications).
+ssize_t read_string_proc(pid_t pid, unsigned long addr, char *buf, size_t size);
+
+// Read `size` bytes of a ptrace-stopped tracee's memory at `addr`.
+// Returns the number of bytes read, or -1 if none could be.
+ssize_t read_memory(pid_t child_pid, unsigned long addr, void *buf, size_t size);
+
+#endif /* TRACEE_MEMORY_H */
@@ -0,0 +1,168 @@
+#include <elf.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <linux/audit.h>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include "tracee_regs.h"
+
+// Cleared once the kernel rejects PTRACE_GET_SYSCALL_INFO
+static atomic_int have_syscall_info = 1;
+
+#if defined(__x86_64__)
+
+// One register of struct user_regs_struct, for PEEKUSER / POKEUSER
+#define REG_OFFSET(reg) offsetof(struct user, regs.reg)
+
+static int regs_syscall_info(pid_t tid, syscall_stop_t guess, syscall_info_t *info) {
+  struct user_regs_struct regs;
+  if (ptrace(PTRACE_GETREGS, tid, NULL, &regs) == -1) {
+    return -1;
+  }
+  info->stop = guess;
+  info->arch = AUDIT_ARCH_X86_64;
+  info->nr = (long)regs.orig_rax;
+  info->args[0] = regs.rdi;
+  info->args[1] = regs.rsi;
+  info->args[2] = regs.rdx;
+  info->args[3] = regs.r10;
+  info->args[4] = regs.r8;
+  info->args[5] = regs.r9;
+  info->ret = (long)regs.rax;
+  return 0;
+}
+
+int tracee_current_syscall(pid_t tid, long *nr, unsigned long *arg0) {
+  errno = 0;
+  long value = ptrace(PTRACE_PEEKUSER, tid, REG_OFFSET(orig_rax), NULL);
+  if (errno) {
+    return -1;
+  }
+  *nr = value;
+  value = ptrace(PTRACE_PEEKUSER, tid, REG_OFFSET(rdi), NULL);
+  if (errno) {
+    return -1;
+  }
+  *arg0 = (unsigned long)value;
+  return 0;
+}
+
+int tracee_skip_syscall(pid_t tid, long ret) {
+  // The kernel skips syscall -1 and leaves rax as it is, so the return
+  // value can be set right away and the exit stop needs no fixing up
+  if (ptrace(PTRACE_POKEUSER, tid, REG_OFFSET(orig_rax), (void *)-1L) == -1 ||
+      ptrace(PTRACE_POKEUSER, tid, REG_OFFSET(rax), (void *)ret) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+// x32 syscalls share the arch of native ones and set this bit in the number
+#define X32_SYSCALL_BIT 0x40000000
+
+int tracee_native_syscall(const syscall_info_t *info) {
+  return info->arch == AUDIT_ARCH_X86_64 && !(info->nr & X32_SYSCALL_BIT);
+}
+
+#elif defined(__aarch64__)
+
+// arm64 has no PEEKUSER / POKEUSER for the general registers; the syscall
+// number is its own register set
+#ifndef NT_ARM_SYSTEM_CALL
+  #define NT_ARM_SYSTEM_CALL 0x404
+#endif
+
+static int get_regs(pid_t tid, struct user_regs_struct *regs) {
+  struct iovec iov = { regs, sizeof(*regs) };
+  return ptrace(PTRACE_GETREGSET, tid, (void *)NT_PRSTATUS, &iov) == -1 ? -1 : 0;
+}
+
+static int regs_syscall_info(pid_t tid, syscall_stop_t guess, syscall_info_t *info) {
+  struct user_regs_struct regs;
+  if (get_regs(tid, &regs) == -1) {
+    return -1;
+  }
+  info->stop = guess;
+  info->arch = AUDIT_ARCH_AARCH64;
+  info->nr = (long)regs.regs[8];
+  for (int i = 0; i < 6; i++) {
+    info->args[i] = regs.regs[i];
+  }
+  info->ret = (long)regs.regs[0];
+  return 0;
+}
+
+int tracee_current_syscall(pid_t tid, long *nr, unsigned long *arg0) {
+  struct user_regs_struct regs;
+  if (get_regs(tid, &regs) == -1) {
+    return -1;
+  }
+  *nr = (long)regs.regs[8];
+  *arg0 = regs.regs[0];
+  return 0;
+}
+
+int tracee_skip_syscall(pid_t tid, long ret) {
+  int nr = -1;
+  struct iovec nr_iov = { &nr, sizeof(nr) };
+  if (ptrace(PTRACE_SETREGSET, tid, (void *)NT_ARM_SYSTEM_CALL, &nr_iov) == -1) {
+    return -1;
+  }
+  // A skipped syscall returns whatever x0 holds
+  struct user_regs_struct regs;
+  if (get_regs(tid, &regs) == -1) {
+    return -1;
+  }
+  regs.regs[0] = (unsigned long)ret;
+  struct iovec iov = { &regs, sizeof(regs) };
+  return ptrace(PTRACE_SETREGSET, tid, (void *)NT_PRSTATUS, &iov) == -1 ? -1 : 0;
+}
+
+int tracee_native_syscall(const syscall_info_t *info) {
+  return info->arch == AUDIT_ARCH_AARCH64;
+}
+
+#else
+  #error "tracee registers: unsupported architecture"
+#endif
+
+int tracee_syscall_info(pid_t tid, syscall_stop_t guess, syscall_info_t *info) {
+  if (!have_syscall_info) {
+    return regs_syscall_info(tid, guess, info);
+  }
+
+  struct __ptrace_syscall_info raw;
+  if (ptrace(PTRACE_GET_SYSCALL_INFO, tid, (void *)sizeof(raw), &raw) == -1) {
+    if (errno != EIO && errno != EINVAL) {
+      return -1;
+    }
+    have_syscall_info = 0;
+    return regs_syscall_info(tid, guess, info);
+  }
+
+  info->arch = raw.arch;
+  switch (raw.op) {
+    case PTRACE_SYSCALL_INFO_ENTRY:
+      info->stop = SYSCALL_STOP_ENTRY;
+      info->nr = (long)raw.entry.nr;
+      memcpy(info->args, raw.entry.args, sizeof(info->args));
+      break;
+    case PTRACE_SYSCALL_INFO_SECCOMP:
+      info->stop = SYSCALL_STOP_SECCOMP;
+      info->nr = (long)raw.seccomp.nr;
+      memcpy(info->args, raw.seccomp.args, sizeof(info->args));
+      break;
+    case PTRACE_SYSCALL_INFO_EXIT:
+      info->stop = SYSCALL_STOP_EXIT;
+      info->ret = (long)raw.exit.rval;
+      break;
+    default:
+      info->stop = SYSCALL_STOP_NONE;
+      break;
+  }
+  return 0;
+}
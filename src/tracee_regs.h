@@ -0,0 +1,47 @@
+#ifndef TRACEE_REGS_H
+#define TRACEE_REGS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// Syscall state of a ptrace-stopped tracee, read with one
+// PTRACE_GET_SYSCALL_INFO instead of a full register dump, and written a
+// register at a time. Supports x86_64 and arm64.
+
+typedef enum {
+  SYSCALL_STOP_NONE,      // Not a syscall stop (e.g. a ptrace event)
+  SYSCALL_STOP_ENTRY,
+  SYSCALL_STOP_EXIT,
+  SYSCALL_STOP_SECCOMP    // SECCOMP_RET_TRACE, before the syscall runs
+} syscall_stop_t;
+
+typedef struct {
+  syscall_stop_t stop;
+  uint32_t arch;            // AUDIT_ARCH_* of the calling convention
+  long nr;                  // Entry and seccomp stops
+  unsigned long args[6];    // Entry and seccomp stops
+  long ret;                 // Exit stops: return value or negative errno
+} syscall_info_t;
+
+// Describe the syscall stop `tid` is in. Kernels before 5.3 lack
+// PTRACE_GET_SYSCALL_INFO; the registers are read instead and the stop is
+// taken to be `guess`, since entry and exit stops look alike there, and
+// the syscall to be a native one.
+// Returns 0 on success, -1 on error.
+int tracee_syscall_info(pid_t tid, syscall_stop_t guess, syscall_info_t *info);
+
+// Whether the syscall of an entry or seccomp stop uses the native calling
+// convention, so its number means what the syscall table says. An i386
+// `int 0x80` or x32 syscall on x86_64 (or an arm32 one on arm64) does not.
+int tracee_native_syscall(const syscall_info_t *info);
+
+// Number and first argument of the syscall `tid` is stopped inside, at a
+// ptrace event where there is no syscall info (e.g. a fork event).
+// Returns 0 on success, -1 on error.
+int tracee_current_syscall(pid_t tid, long *nr, unsigned long *arg0);
+
+// At an entry or seccomp stop: skip the syscall and make it return `ret`
+// (a negative errno). Returns 0 on success, -1 on error.
+int tracee_skip_syscall(pid_t tid, long ret);
+
+#endif /* TRACEE_REGS_H */
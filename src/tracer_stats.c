@@ -0,0 +1,290 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "tracer_stats.h"
+
+#define SUB_BUCKETS (1 << STATS_SUB_BUCKET_BITS)
+
+static stats_segment_t *segment = NULL;
+static size_t segment_size = 0;
+static char segment_name[64];
+
+// SIGUSR1 only writes to this pipe; the dump thread does the printing
+static int dump_pipe[2] = { -1, -1 };
+static pthread_t dump_thread;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void segment_path(pid_t pid, char *buf, size_t size) {
+  snprintf(buf, size, "/sandbox-stats-%d", (int)pid);
+}
+
+static int bucket_index(uint64_t ns) {
+  if (ns < SUB_BUCKETS) {
+    return (int)ns;
+  }
+  int exponent = 63 - __builtin_clzll(ns);
+  if (exponent > STATS_MAX_EXPONENT) {
+    return STATS_BUCKETS - 1;
+  }
+  int sub = (int)(ns >> (exponent - STATS_SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+  return ((exponent - STATS_SUB_BUCKET_BITS + 1) << STATS_SUB_BUCKET_BITS) + sub;
+}
+
+// Smallest value that lands in bucket `index`
+static uint64_t bucket_floor(int index) {
+  if (index < SUB_BUCKETS) {
+    return (uint64_t)index;
+  }
+  int exponent = (index >> STATS_SUB_BUCKET_BITS) + STATS_SUB_BUCKET_BITS - 1;
+  uint64_t sub = (uint64_t)(index & (SUB_BUCKETS - 1));
+  return (SUB_BUCKETS + sub) << (exponent - STATS_SUB_BUCKET_BITS);
+}
+
+static void on_sigusr1(int sig) {
+  (void)sig;
+  int saved = errno;
+  char request = 'd';
+  if (write(dump_pipe[1], &request, 1) == -1) {
+    // Dumps already queued cover this one
+  }
+  errno = saved;
+}
+
+static void *dump_main(void *arg) {
+  (void)arg;
+  char request;
+  while (read(dump_pipe[0], &request, 1) == 1 && request == 'd') {
+    tracer_stats_print(segment, stderr);
+  }
+  return NULL;
+}
+
+int tracer_stats_create(int num_shards) {
+  segment_path(getpid(), segment_name, sizeof(segment_name));
+  int fd = shm_open(segment_name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  if (fd == -1) {
+    perror("shm_open");
+    return -1;
+  }
+  // Only the pages of syscalls that actually stop get backed
+  segment_size = sizeof(stats_segment_t) + (size_t)num_shards * sizeof(tracer_stats_t);
+  if (ftruncate(fd, (off_t)segment_size) == -1) {
+    perror("ftruncate");
+    close(fd);
+    shm_unlink(segment_name);
+    return -1;
+  }
+  segment = mmap(NULL, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (segment == MAP_FAILED) {
+    perror("mmap");
+    segment = NULL;
+    shm_unlink(segment_name);
+    return -1;
+  }
+  segment->pid = (int32_t)getpid();
+  segment->num_shards = (uint32_t)num_shards;
+  segment->start_ns = now_ns();
+  // Readers check the magic last
+  memcpy(segment->magic, STATS_MAGIC, sizeof(STATS_MAGIC));
+
+  if (pipe2(dump_pipe, O_CLOEXEC) == -1) {
+    perror("pipe");
+    return -1;
+  }
+  fcntl(dump_pipe[1], F_SETFL, O_NONBLOCK);
+  if (pthread_create(&dump_thread, NULL, dump_main, NULL) != 0) {
+    perror("pthread_create");
+    return -1;
+  }
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = on_sigusr1;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGUSR1, &action, NULL);
+  return 0;
+}
+
+tracer_stats_t *tracer_stats_shard(int index) {
+  return segment ? &segment->shards[index] : NULL;
+}
+
+uint64_t tracer_stats_start(const tracer_stats_t *stats) {
+  return stats ? now_ns() : 0;
+}
+
+static void add(_Atomic uint64_t *counter, uint64_t value) {
+  // Single writer: no read-modify-write needed
+  atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value,
+                        memory_order_relaxed);
+}
+
+void tracer_stats_record(tracer_stats_t *stats, long syscall_nr, stat_kind_t kind, uint64_t start) {
+  if (!stats || !start || syscall_nr < 0 || syscall_nr >= STATS_MAX_SYSCALL) {
+    return;
+  }
+  uint64_t ns = now_ns() - start;
+  stats_hist_t *hist = &stats->hist[syscall_nr][kind];
+  add(&hist->buckets[bucket_index(ns)], 1);
+  add(&hist->sum_ns, ns);
+  if (ns > atomic_load_explicit(&hist->max_ns, memory_order_relaxed)) {
+    atomic_store_explicit(&hist->max_ns, ns, memory_order_relaxed);
+  }
+  add(&hist->count, 1);
+}
+
+void tracer_stats_close(void) {
+  if (!segment) {
+    return;
+  }
+  signal(SIGUSR1, SIG_IGN);
+  char request = 'q';
+  if (write(dump_pipe[1], &request, 1) == 1) {
+    pthread_join(dump_thread, NULL);
+  }
+  close(dump_pipe[0]);
+  close(dump_pipe[1]);
+
+  tracer_stats_print(segment, stderr);
+  shm_unlink(segment_name);
+  munmap(segment, segment_size);
+  segment = NULL;
+}
+
+const stats_segment_t *tracer_stats_open(pid_t pid) {
+  char name[64];
+  segment_path(pid, name, sizeof(name));
+  int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+  if (fd == -1) {
+    return NULL;
+  }
+  struct stat st;
+  stats_segment_t *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(stats_segment_t)) {
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+  if (memcmp(map->magic, STATS_MAGIC, sizeof(STATS_MAGIC)) != 0 ||
+      sizeof(stats_segment_t) + map->num_shards * sizeof(tracer_stats_t) > (size_t)st.st_size) {
+    munmap(map, (size_t)st.st_size);
+    errno = EINVAL;
+    return NULL;
+  }
+  return map;
+}
+
+void tracer_stats_sum(const stats_segment_t *seg, long syscall_nr, stat_kind_t kind,
+                      stats_summary_t *summary) {
+  memset(summary, 0, sizeof(*summary));
+  for (uint32_t s = 0; s < seg->num_shards; s++) {
+    const stats_hist_t *hist = &seg->shards[s].hist[syscall_nr][kind];
+    uint64_t count = atomic_load_explicit(&hist->count, memory_order_relaxed);
+    if (count == 0) {
+      continue;
+    }
+    summary->count += count;
+    summary->sum_ns += atomic_load_explicit(&hist->sum_ns, memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&hist->max_ns, memory_order_relaxed);
+    if (max > summary->max_ns) {
+      summary->max_ns = max;
+    }
+    for (int b = 0; b < STATS_BUCKETS; b++) {
+      summary->buckets[b] += atomic_load_explicit(&hist->buckets[b], memory_order_relaxed);
+    }
+  }
+}
+
+uint64_t stats_percentile(const stats_summary_t *summary, double p) {
+  uint64_t total = 0;
+  for (int b = 0; b < STATS_BUCKETS; b++) {
+    total += summary->buckets[b];
+  }
+  if (total == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)(p * (double)total);
+  if (rank >= total) {
+    rank = total - 1;
+  }
+  uint64_t seen = 0;
+  for (int b = 0; b < STATS_BUCKETS - 1; b++) {
+    seen += summary->buckets[b];
+    if (seen > rank) {
+      // Report the top of the bucket, but never more than the real maximum
+      uint64_t top = bucket_floor(b + 1) - 1;
+      return summary->max_ns && top > summary->max_ns ? summary->max_ns : top;
+    }
+  }
+  return summary->max_ns;
+}
+
+void stats_format_ns(uint64_t ns, char *buf, size_t size) {
+  if (ns < 1000) {
+    snprintf(buf, size, "%luns", (unsigned long)ns);
+  } else if (ns < 1000000) {
+    snprintf(buf, size, "%.1fus", ns / 1e3);
+  } else if (ns < 1000000000) {
+    snprintf(buf, size, "%.1fms", ns / 1e6);
+  } else {
+    snprintf(buf, size, "%.2fs", ns / 1e9);
+  }
+}
+
+void tracer_stats_print(const stats_segment_t *seg, FILE *out) {
+  stats_summary_t summary[NUM_STATS];
+  char p50[16], p99[16], max[16];
+
+  double elapsed = (now_ns() - seg->start_ns) / 1e9;
+  fprintf(out, "\nTracer stats after %.1fs (times: p50 / p99 / max)\n", elapsed);
+  fprintf(out, "%-8s %10s  %-26s  %-26s  %-26s  %8s  %s\n", "syscall", "stops", "stop", "peek",
+          "policy", "waits", "wait");
+  uint64_t total = 0;
+  for (long nr = 0; nr < STATS_MAX_SYSCALL; nr++) {
+    for (int kind = 0; kind < NUM_STATS; kind++) {
+      tracer_stats_sum(seg, nr, (stat_kind_t)kind, &summary[kind]);
+    }
+    if (summary[STAT_STOP].count == 0 && summary[STAT_DECISION].count == 0) {
+      continue;
+    }
+    total += summary[STAT_STOP].count;
+    fprintf(out, "%-8ld %10lu", nr, (unsigned long)summary[STAT_STOP].count);
+    for (int kind = 0; kind < NUM_STATS; kind++) {
+      const stats_summary_t *s = &summary[kind];
+      if (kind == STAT_DECISION) {
+        fprintf(out, "  %8lu", (unsigned long)s->count);
+      }
+      if (s->count == 0) {
+        if (kind != STAT_DECISION) {
+          fprintf(out, "  %-26s", "-");
+        }
+        continue;
+      }
+      stats_format_ns(stats_percentile(s, 0.5), p50, sizeof(p50));
+      stats_format_ns(stats_percentile(s, 0.99), p99, sizeof(p99));
+      stats_format_ns(s->max_ns, max, sizeof(max));
+      char cell[sizeof(p50) + sizeof(p99) + sizeof(max) + 8];   // Room for the " / "s
+      snprintf(cell, sizeof(cell), "%s / %s / %s", p50, p99, max);
+      fprintf(out, kind == STAT_DECISION ? "  %s" : "  %-26s", cell);
+    }
+    fputc('\n', out);
+  }
+  fprintf(out, "%-8s %10lu\n", "total", (unsigned long)total);
+  fflush(out);
+}
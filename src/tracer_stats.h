@@ -0,0 +1,95 @@
+#ifndef TRACER_STATS_H
+#define TRACER_STATS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+// Per-syscall latency histograms of the ptrace tracer, kept in a shared
+// memory segment (/sandbox-stats-<pid>) so sandbox-top can read them while
+// the sandbox runs. Each tracer thread owns one block of the segment and is
+// its only writer, so recording is a few relaxed loads and stores.
+
+// Syscalls numbered at or above this are not recorded
+#define STATS_MAX_SYSCALL 512
+
+// Log buckets with 8 linear sub-buckets per power of two (HDR-style, at
+// most 12.5% error). Times of 2^36 ns (about 69s) and more land in the last.
+#define STATS_SUB_BUCKET_BITS 3
+#define STATS_MAX_EXPONENT 35
+#define STATS_BUCKETS ((STATS_MAX_EXPONENT - STATS_SUB_BUCKET_BITS + 2) << STATS_SUB_BUCKET_BITS)
+
+#define STATS_MAGIC "SBXSTA1"
+
+// What a histogram measures
+typedef enum {
+  STAT_STOP,          // From a syscall stop being reaped to the task resuming
+  STAT_READ_STRING,   // Copying the path argument out of the tracee
+  STAT_POLICY,        // Policy, remembered answers and queueing for the broker
+  STAT_DECISION,      // A parked task waiting for the broker's answer
+  NUM_STATS
+} stat_kind_t;
+
+typedef struct {
+  _Atomic uint64_t count;
+  _Atomic uint64_t sum_ns;
+  _Atomic uint64_t max_ns;
+  _Atomic uint64_t buckets[STATS_BUCKETS];
+} stats_hist_t;
+
+// The block one tracer thread writes
+typedef struct {
+  stats_hist_t hist[STATS_MAX_SYSCALL][NUM_STATS];
+} tracer_stats_t;
+
+typedef struct {
+  char magic[8];
+  int32_t pid;
+  uint32_t num_shards;
+  uint64_t start_ns;       // CLOCK_MONOTONIC when the segment was created
+  tracer_stats_t shards[];
+} stats_segment_t;
+
+// A histogram summed over all tracer threads
+typedef struct {
+  uint64_t count;
+  uint64_t sum_ns;
+  uint64_t max_ns;
+  uint64_t buckets[STATS_BUCKETS];
+} stats_summary_t;
+
+// Create the segment for `num_shards` tracer threads and dump it to stderr
+// whenever the sandbox gets SIGUSR1. Returns 0 on success, -1 on error.
+int tracer_stats_create(int num_shards);
+
+// The block of tracer thread `index`, or NULL when stats are off
+tracer_stats_t *tracer_stats_shard(int index);
+
+// Timestamp to pass to tracer_stats_record(); 0 when `stats` is NULL
+uint64_t tracer_stats_start(const tracer_stats_t *stats);
+
+// Record the time since `start` (from tracer_stats_start()) under
+// `syscall_nr`. Does nothing when `stats` is NULL or `start` is 0.
+void tracer_stats_record(tracer_stats_t *stats, long syscall_nr, stat_kind_t kind, uint64_t start);
+
+// Dump the stats to stderr, stop answering SIGUSR1 and remove the segment
+void tracer_stats_close(void);
+
+// Map the segment of the sandbox running as `pid` read-only, or NULL
+const stats_segment_t *tracer_stats_open(pid_t pid);
+
+// Sum the histograms of `kind` for `syscall_nr` over all tracer threads
+void tracer_stats_sum(const stats_segment_t *segment, long syscall_nr, stat_kind_t kind,
+                      stats_summary_t *summary);
+
+// Value below which a fraction `p` (0..1) of the recorded times fall
+uint64_t stats_percentile(const stats_summary_t *summary, double p);
+
+// Print a table of every syscall that stopped the tracer
+void tracer_stats_print(const stats_segment_t *segment, FILE *out);
+
+// Format a duration as e.g. "850ns", "12.3us", "4.5ms" or "1.20s"
+void stats_format_ns(uint64_t ns, char *buf, size_t size);
+
+#endif /* TRACER_STATS_H */
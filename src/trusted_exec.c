@@ -0,0 +1,256 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "sha256.h"
+#include "trusted_exec.h"
+
+// Sorted for bsearch
+static uint8_t (*allowed)[SHA256_DIGEST_SIZE] = NULL;
+static int num_allowed = 0;
+
+// Verdicts per binary, so each is hashed once. Open addressing; an
+// entry with size -1 is empty.
+typedef struct {
+  dev_t dev;
+  ino_t ino;
+  struct timespec mtime;
+  off_t size;
+  int trusted;
+} exe_entry_t;
+
+static exe_entry_t *exe_cache = NULL;
+static size_t exe_cache_cap = 0;
+static size_t exe_cache_count = 0;
+static pthread_mutex_t exe_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void (*learn_hook)(const trusted_exec_entry_t *entry) = NULL;
+
+static atomic_ulong exec_count;
+static atomic_ulong trusted_count;
+static atomic_ulong hashed_count;
+
+static int compare_digest(const void *a, const void *b) {
+  return memcmp(a, b, SHA256_DIGEST_SIZE);
+}
+
+static int parse_hex_digest(const char *hex, uint8_t digest[SHA256_DIGEST_SIZE]) {
+  for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+    unsigned int byte;
+    if (sscanf(hex + i * 2, "%2x", &byte) != 1) {
+      return -1;
+    }
+    digest[i] = (uint8_t)byte;
+  }
+  // The digest must end there
+  char next = hex[SHA256_DIGEST_SIZE * 2];
+  return next == '\0' || next == ' ' || next == '\t' || next == '\n' || next == '\r' ? 0 : -1;
+}
+
+int trusted_exec_load(const char *filename) {
+  FILE *file = fopen(filename, "r");
+  if (!file) {
+    perror(filename);
+    return -1;
+  }
+
+  char line[4096 + 80];
+  int line_no = 0;
+  int cap = 0;
+  while (fgets(line, sizeof(line), file)) {
+    line_no++;
+    const char *p = line;
+    while (*p == ' ' || *p == '\t') {
+      p++;
+    }
+    if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') {
+      continue;
+    }
+    if (num_allowed == cap) {
+      cap = cap ? cap * 2 : 64;
+      void *grown = realloc(allowed, (size_t)cap * SHA256_DIGEST_SIZE);
+      if (!grown) {
+        perror("realloc");
+        fclose(file);
+        return -1;
+      }
+      allowed = grown;
+    }
+    if (parse_hex_digest(p, allowed[num_allowed]) == -1) {
+      fprintf(stderr, "%s:%d: expected a SHA-256 hash in hex\n", filename, line_no);
+      fclose(file);
+      return -1;
+    }
+    num_allowed++;
+  }
+  fclose(file);
+
+  qsort(allowed, (size_t)num_allowed, SHA256_DIGEST_SIZE, compare_digest);
+  return num_allowed;
+}
+
+static size_t exe_slot(dev_t dev, ino_t ino) {
+  uint64_t h = ((uint64_t)dev * 0x9e3779b97f4a7c15ULL) ^ ((uint64_t)ino * 0xc2b2ae3d27d4eb4fULL);
+  return (size_t)(h ^ (h >> 29)) & (exe_cache_cap - 1);
+}
+
+static int same_binary(const exe_entry_t *entry, const struct stat *st) {
+  return entry->dev == st->st_dev && entry->ino == st->st_ino && entry->size == st->st_size &&
+         entry->mtime.tv_sec == st->st_mtim.tv_sec && entry->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+// The entry for the file `st` describes (whatever its version), or NULL.
+// Callers hold the lock.
+static exe_entry_t *exe_cache_entry(const struct stat *st) {
+  if (exe_cache_cap == 0) {
+    return NULL;
+  }
+  for (size_t i = exe_slot(st->st_dev, st->st_ino); exe_cache[i].size != -1;
+       i = (i + 1) & (exe_cache_cap - 1)) {
+    if (exe_cache[i].dev == st->st_dev && exe_cache[i].ino == st->st_ino) {
+      return &exe_cache[i];
+    }
+  }
+  return NULL;
+}
+
+static int exe_cache_grow(void) {
+  size_t new_cap = exe_cache_cap ? exe_cache_cap * 2 : 64;
+  exe_entry_t *grown = malloc(new_cap * sizeof(exe_entry_t));
+  if (!grown) {
+    return -1;
+  }
+  for (size_t i = 0; i < new_cap; i++) {
+    grown[i].size = -1;
+  }
+
+  exe_entry_t *old = exe_cache;
+  size_t old_cap = exe_cache_cap;
+  exe_cache = grown;
+  exe_cache_cap = new_cap;
+  for (size_t i = 0; i < old_cap; i++) {
+    if (old[i].size != -1) {
+      size_t j = exe_slot(old[i].dev, old[i].ino);
+      while (exe_cache[j].size != -1) {
+        j = (j + 1) & (exe_cache_cap - 1);
+      }
+      exe_cache[j] = old[i];
+    }
+  }
+  free(old);
+  return 0;
+}
+
+static void exe_cache_store(const struct stat *st, int trusted) {
+  // A binary replaced in place keeps its slot
+  exe_entry_t *entry = exe_cache_entry(st);
+  if (!entry) {
+    // Keep the load factor under one half
+    if ((exe_cache_count + 1) * 2 > exe_cache_cap && exe_cache_grow() == -1) {
+      return;
+    }
+    size_t slot = exe_slot(st->st_dev, st->st_ino);
+    while (exe_cache[slot].size != -1) {
+      slot = (slot + 1) & (exe_cache_cap - 1);
+    }
+    entry = &exe_cache[slot];
+    exe_cache_count++;
+  }
+  entry->dev = st->st_dev;
+  entry->ino = st->st_ino;
+  entry->mtime = st->st_mtim;
+  entry->size = st->st_size;
+  entry->trusted = trusted;
+}
+
+// Hash the whole file through one read-only mapping
+static int hash_file(int fd, off_t size, uint8_t digest[SHA256_DIGEST_SIZE]) {
+  sha256_t ctx;
+  sha256_init(&ctx);
+  if (size > 0) {
+    void *map = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      return -1;
+    }
+    madvise(map, (size_t)size, MADV_SEQUENTIAL);
+    sha256_update(&ctx, map, (size_t)size);
+    munmap(map, (size_t)size);
+  }
+  sha256_final(&ctx, digest);
+  return 0;
+}
+
+int trusted_exec_check(pid_t pid) {
+  atomic_fetch_add(&exec_count, 1);
+  if (num_allowed == 0) {
+    return 0;
+  }
+
+  char exe[64];
+  snprintf(exe, sizeof(exe), "/proc/%d/exe", (int)pid);
+  int fd = open(exe, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd == -1 || fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+    if (fd != -1) {
+      close(fd);
+    }
+    return 0;
+  }
+
+  pthread_mutex_lock(&exe_cache_lock);
+  const exe_entry_t *entry = exe_cache_entry(&st);
+  int trusted = entry && same_binary(entry, &st) ? entry->trusted : -1;
+  pthread_mutex_unlock(&exe_cache_lock);
+
+  if (trusted == -1) {
+    // Hash outside the lock; two threads racing on a new binary both hash it
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    trusted = hash_file(fd, st.st_size, digest) == 0 &&
+              bsearch(digest, allowed, (size_t)num_allowed, SHA256_DIGEST_SIZE, compare_digest) != NULL;
+    atomic_fetch_add(&hashed_count, 1);
+    pthread_mutex_lock(&exe_cache_lock);
+    exe_cache_store(&st, trusted);
+    pthread_mutex_unlock(&exe_cache_lock);
+    if (learn_hook) {
+      trusted_exec_entry_t learned = {
+        (uint64_t)st.st_dev, (uint64_t)st.st_ino, (int64_t)st.st_mtim.tv_sec,
+        (int64_t)st.st_mtim.tv_nsec, (int64_t)st.st_size, trusted
+      };
+      learn_hook(&learned);
+    }
+  }
+  close(fd);
+
+  if (trusted) {
+    atomic_fetch_add(&trusted_count, 1);
+  }
+  return trusted;
+}
+
+void trusted_exec_stats(trusted_exec_stats_t *stats) {
+  stats->execs = atomic_load(&exec_count);
+  stats->trusted = atomic_load(&trusted_count);
+  stats->hashed = atomic_load(&hashed_count);
+}
+
+void trusted_exec_set_hook(void (*hook)(const trusted_exec_entry_t *entry)) {
+  learn_hook = hook;
+}
+
+void trusted_exec_learn(const trusted_exec_entry_t *entry) {
+  struct stat st;
+  memset(&st, 0, sizeof(st));
+  st.st_dev = (dev_t)entry->dev;
+  st.st_ino = (ino_t)entry->ino;
+  st.st_mtim.tv_sec = (time_t)entry->mtime_sec;
+  st.st_mtim.tv_nsec = (long)entry->mtime_nsec;
+  st.st_size = (off_t)entry->size;
+  pthread_mutex_lock(&exe_cache_lock);
+  exe_cache_store(&st, entry->trusted);
+  pthread_mutex_unlock(&exe_cache_lock);
+}
@@ -0,0 +1,46 @@
+#ifndef TRUSTED_EXEC_H
+#define TRUSTED_EXEC_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// Allowlist of trusted executables, by SHA-256. Each exec is checked
+// against it; a hash is only computed once per binary, keyed by device,
+// inode, mtime and size. Safe to call from several tracer threads.
+
+typedef struct {
+  uint64_t execs;       // Execs checked
+  uint64_t trusted;     // Of those, executables on the allowlist
+  uint64_t hashed;      // Binaries hashed (cache misses)
+} trusted_exec_stats_t;
+
+// Load the allowlist: one hex SHA-256 per line, optionally followed by a
+// file name, as `sha256sum` prints it. Blank lines and lines starting with
+// '#' are skipped. Returns the number of hashes, or -1 on error.
+int trusted_exec_load(const char *filename);
+
+// Whether the executable `pid` is running (its /proc/<pid>/exe) is on the
+// allowlist. Returns 1 if it is, 0 otherwise.
+int trusted_exec_check(pid_t pid);
+
+// Counters since the allowlist was loaded
+void trusted_exec_stats(trusted_exec_stats_t *stats);
+
+// One hashed binary and its verdict, as the cache keeps it
+typedef struct {
+  uint64_t dev;
+  uint64_t ino;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  int64_t size;
+  int trusted;
+} trusted_exec_entry_t;
+
+// Call `hook` for every binary hashed from now on, e.g. so a --serve job
+// can hand its hashes back to the server (NULL to stop)
+void trusted_exec_set_hook(void (*hook)(const trusted_exec_entry_t *entry));
+
+// Cache a verdict hashed elsewhere, so the binary is not hashed again
+void trusted_exec_learn(const trusted_exec_entry_t *entry);
+
+#endif /* TRUSTED_EXEC_H */
@@ -0,0 +1,468 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "verdict_cache.h"
+
+// On-disk store: a header, an open-addressing slot table and the key
+// strings. It is looked up in place through a read-only mapping, so a
+// warm start costs one mmap however many answers are stored.
+#define STORE_MAGIC "SBXVRD1"
+
+typedef struct {
+  char magic[8];
+  uint32_t count;
+  uint32_t slots;          // Power of two
+  uint32_t strings_size;
+  uint32_t reserved;
+} store_header_t;
+
+typedef struct {
+  uint64_t hash;
+  uint32_t key_off;        // Offset into the string area
+  uint32_t key_len;
+  uint8_t op;
+  uint8_t scope;
+  uint8_t verdict;         // VERDICT_NONE marks an empty slot
+  uint8_t pad[5];
+} store_slot_t;
+
+// Answers given during this run
+typedef struct {
+  uint64_t hash;
+  char *key;
+  uint32_t len;
+  uint8_t op;
+  uint8_t scope;
+  uint8_t verdict;
+} cache_entry_t;
+
+static cache_entry_t *entries = NULL;
+static uint32_t entries_cap = 0;
+static uint32_t entries_count = 0;
+
+static const char *store_file = NULL;
+static verdict_cache_hook_t answer_hook = NULL;
+static const store_header_t *store_map = NULL;
+
+// Lookups and answers come from every tracer thread
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Bumped by every new answer, so verdicts derived from the cache can tell
+// they may be stale
+static atomic_uint generation;
+
+static int count_answers(void);
+
+// FNV-1a, seeded with the operation and scope so equal keys in different
+// classes hash apart. A directory key can be hashed incrementally while
+// scanning a path, which lets a lookup probe every parent in one pass.
+#define FNV_OFFSET 1469598103934665603ULL
+#define FNV_PRIME 1099511628211ULL
+
+static uint64_t hash_seed(policy_op_t op, verdict_scope_t scope) {
+  return (FNV_OFFSET ^ (uint64_t)(op * 4 + scope + 1)) * FNV_PRIME;
+}
+
+static uint64_t hash_step(uint64_t h, unsigned char c) {
+  return (h ^ c) * FNV_PRIME;
+}
+
+static uint64_t hash_key(policy_op_t op, verdict_scope_t scope, const char *key, size_t len) {
+  uint64_t h = hash_seed(op, scope);
+  for (size_t i = 0; i < len; i++) {
+    h = hash_step(h, (unsigned char)key[i]);
+  }
+  return h;
+}
+
+static const store_slot_t *store_slots(void) {
+  return (const store_slot_t *)(store_map + 1);
+}
+
+static const char *store_strings(void) {
+  return (const char *)(store_slots() + store_map->slots);
+}
+
+static verdict_t find_in_store(uint64_t hash, policy_op_t op, verdict_scope_t scope,
+                               const char *key, size_t len) {
+  if (!store_map) {
+    return VERDICT_NONE;
+  }
+
+  const store_slot_t *slots = store_slots();
+  const char *strings = store_strings();
+  uint32_t mask = store_map->slots - 1;
+  for (uint32_t pos = (uint32_t)hash & mask, n = 0; slots[pos].verdict != VERDICT_NONE && n <= mask;
+       pos = (pos + 1) & mask, n++) {
+    const store_slot_t *s = &slots[pos];
+    if (s->hash == hash && s->op == op && s->scope == scope && s->key_len == len &&
+        (uint64_t)s->key_off + len <= store_map->strings_size &&
+        memcmp(strings + s->key_off, key, len) == 0) {
+      return (verdict_t)s->verdict;
+    }
+  }
+  return VERDICT_NONE;
+}
+
+static cache_entry_t *find_entry(uint64_t hash, policy_op_t op, verdict_scope_t scope,
+                                 const char *key, size_t len) {
+  if (!entries_cap) {
+    return NULL;
+  }
+
+  uint32_t mask = entries_cap - 1;
+  for (uint32_t pos = (uint32_t)hash & mask; entries[pos].key; pos = (pos + 1) & mask) {
+    cache_entry_t *e = &entries[pos];
+    if (e->hash == hash && e->op == op && e->scope == scope && e->len == len &&
+        memcmp(e->key, key, len) == 0) {
+      return e;
+    }
+  }
+  return NULL;
+}
+
+// Answers from this run take precedence over the stored ones
+static verdict_t find_verdict(policy_op_t op, verdict_scope_t scope, uint64_t hash,
+                              const char *key, size_t len) {
+  cache_entry_t *e = find_entry(hash, op, scope, key, len);
+  if (e) {
+    return (verdict_t)e->verdict;
+  }
+  return find_in_store(hash, op, scope, key, len);
+}
+
+static verdict_t lookup_locked(policy_op_t op, const char *path) {
+  if (!entries_count && !store_map) {
+    return VERDICT_NONE;
+  }
+
+  size_t len = strlen(path);
+  verdict_t v = find_verdict(op, VERDICT_SCOPE_FILE, hash_key(op, VERDICT_SCOPE_FILE, path, len),
+                             path, len);
+  if (v != VERDICT_NONE) {
+    return v;
+  }
+
+  // Directory keys end in '/'; the deepest remembered parent wins
+  verdict_t dir_verdict = VERDICT_NONE;
+  uint64_t h = hash_seed(op, VERDICT_SCOPE_DIR);
+  for (size_t i = 0; i < len; i++) {
+    h = hash_step(h, (unsigned char)path[i]);
+    if (path[i] == '/') {
+      v = find_verdict(op, VERDICT_SCOPE_DIR, h, path, i + 1);
+      if (v != VERDICT_NONE) {
+        dir_verdict = v;
+      }
+    }
+  }
+  if (dir_verdict != VERDICT_NONE) {
+    return dir_verdict;
+  }
+
+  return find_verdict(op, VERDICT_SCOPE_ALL, hash_key(op, VERDICT_SCOPE_ALL, "", 0), "", 0);
+}
+
+verdict_t verdict_cache_lookup(policy_op_t op, const char *path) {
+  pthread_mutex_lock(&cache_lock);
+  verdict_t v = lookup_locked(op, path);
+  pthread_mutex_unlock(&cache_lock);
+  return v;
+}
+
+static int entries_grow(void) {
+  uint32_t new_cap = entries_cap ? entries_cap * 2 : 64;
+  cache_entry_t *grown = calloc(new_cap, sizeof(cache_entry_t));
+  if (!grown) {
+    return -1;
+  }
+
+  uint32_t mask = new_cap - 1;
+  for (uint32_t i = 0; i < entries_cap; i++) {
+    if (entries[i].key) {
+      uint32_t pos = (uint32_t)entries[i].hash & mask;
+      while (grown[pos].key) {
+        pos = (pos + 1) & mask;
+      }
+      grown[pos] = entries[i];
+    }
+  }
+
+  free(entries);
+  entries = grown;
+  entries_cap = new_cap;
+  return 0;
+}
+
+// Write every answer (stored and from this run) to a fresh file and
+// rename it over the store, so a crash never leaves a torn store behind
+static int store_save(void) {
+  uint32_t total = (uint32_t)count_answers();
+  uint32_t slots = 16;
+  while (slots < total * 2) {
+    slots *= 2;
+  }
+
+  store_slot_t *table = calloc(slots, sizeof(store_slot_t));
+  size_t strings_cap = 4096, strings_size = 0;
+  char *strings = malloc(strings_cap);
+  if (!table || !strings) {
+    free(table);
+    free(strings);
+    return -1;
+  }
+
+  uint32_t count = 0;
+  uint32_t mask = slots - 1;
+  int failed = 0;
+
+  // Entries of this run first, then stored ones they do not replace
+  for (int pass = 0; pass < 2 && !failed; pass++) {
+    uint32_t n = pass == 0 ? entries_cap : (store_map ? store_map->slots : 0);
+    for (uint32_t i = 0; i < n; i++) {
+      uint64_t hash;
+      const char *key;
+      uint32_t len;
+      uint8_t op, scope, verdict;
+
+      if (pass == 0) {
+        if (!entries[i].key) {
+          continue;
+        }
+        hash = entries[i].hash;
+        key = entries[i].key;
+        len = entries[i].len;
+        op = entries[i].op;
+        scope = entries[i].scope;
+        verdict = entries[i].verdict;
+      } else {
+        const store_slot_t *s = &store_slots()[i];
+        if (s->verdict == VERDICT_NONE ||
+            (uint64_t)s->key_off + s->key_len > store_map->strings_size) {
+          continue;
+        }
+        hash = s->hash;
+        key = store_strings() + s->key_off;
+        len = s->key_len;
+        op = s->op;
+        scope = s->scope;
+        verdict = s->verdict;
+        if (find_entry(hash, op, scope, key, len)) {
+          continue;
+        }
+      }
+
+      if (strings_size + len > strings_cap) {
+        while (strings_size + len > strings_cap) {
+          strings_cap *= 2;
+        }
+        char *grown = realloc(strings, strings_cap);
+        if (!grown) {
+          failed = 1;
+          break;
+        }
+        strings = grown;
+      }
+
+      uint32_t pos = (uint32_t)hash & mask;
+      while (table[pos].verdict != VERDICT_NONE) {
+        pos = (pos + 1) & mask;
+      }
+      table[pos].hash = hash;
+      table[pos].key_off = (uint32_t)strings_size;
+      table[pos].key_len = len;
+      table[pos].op = op;
+      table[pos].scope = scope;
+      table[pos].verdict = verdict;
+      memcpy(strings + strings_size, key, len);
+      strings_size += len;
+      count++;
+    }
+  }
+
+  store_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, STORE_MAGIC, sizeof(STORE_MAGIC));
+  header.count = count;
+  header.slots = slots;
+  header.strings_size = (uint32_t)strings_size;
+
+  char tmp[4096];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", store_file);
+
+  FILE *f = failed ? NULL : fopen(tmp, "wb");
+  if (f) {
+    if (fwrite(&header, sizeof(header), 1, f) != 1 ||
+        fwrite(table, sizeof(store_slot_t), slots, f) != slots ||
+        (strings_size && fwrite(strings, 1, strings_size, f) != strings_size)) {
+      failed = 1;
+    }
+    if (fclose(f) != 0) {
+      failed = 1;
+    }
+    if (failed || rename(tmp, store_file) == -1) {
+      perror("Failed to save remembered answers");
+      unlink(tmp);
+      failed = 1;
+    }
+  } else {
+    if (!failed) {
+      perror("Failed to save remembered answers");
+    }
+    failed = 1;
+  }
+
+  free(table);
+  free(strings);
+  return failed ? -1 : 0;
+}
+
+static int remember_locked(policy_op_t op, const char *path, verdict_scope_t scope,
+                          verdict_t verdict) {
+  size_t len;
+  switch (scope) {
+    case VERDICT_SCOPE_DIR: {
+      // Keep the trailing '/' so the key only matches whole components
+      const char *slash = strrchr(path, '/');
+      len = slash ? (size_t)(slash - path) + 1 : 0;
+      break;
+    }
+    case VERDICT_SCOPE_ALL:
+      len = 0;
+      break;
+    default:
+      len = strlen(path);
+      break;
+  }
+  if (scope == VERDICT_SCOPE_DIR && len == 0) {
+    return -1;
+  }
+
+  uint64_t hash = hash_key(op, scope, path, len);
+  cache_entry_t *e = find_entry(hash, op, scope, path, len);
+  if (e) {
+    e->verdict = (uint8_t)verdict;
+  } else {
+    // Keep the table at most half full
+    if ((entries_count + 1) * 2 > entries_cap && entries_grow() == -1) {
+      return -1;
+    }
+
+    char *key = malloc(len + 1);
+    if (!key) {
+      return -1;
+    }
+    memcpy(key, path, len);
+    key[len] = '\0';
+
+    uint32_t mask = entries_cap - 1;
+    uint32_t pos = (uint32_t)hash & mask;
+    while (entries[pos].key) {
+      pos = (pos + 1) & mask;
+    }
+    e = &entries[pos];
+    e->hash = hash;
+    e->key = key;
+    e->len = (uint32_t)len;
+    e->op = (uint8_t)op;
+    e->scope = (uint8_t)scope;
+    e->verdict = (uint8_t)verdict;
+    entries_count++;
+  }
+  atomic_fetch_add(&generation, 1);
+
+  if (answer_hook) {
+    answer_hook(op, path, scope, verdict);
+    return 0;
+  }
+  return store_file ? store_save() : 0;
+}
+
+int verdict_cache_remember(policy_op_t op, const char *path, verdict_scope_t scope,
+                           verdict_t verdict) {
+  pthread_mutex_lock(&cache_lock);
+  int ret = remember_locked(op, path, scope, verdict);
+  pthread_mutex_unlock(&cache_lock);
+  return ret;
+}
+
+unsigned int verdict_cache_generation(void) {
+  return atomic_load_explicit(&generation, memory_order_acquire);
+}
+
+void verdict_cache_set_hook(verdict_cache_hook_t hook) {
+  pthread_mutex_lock(&cache_lock);
+  answer_hook = hook;
+  pthread_mutex_unlock(&cache_lock);
+}
+
+int verdict_cache_open(const char *filename) {
+  store_file = filename;
+
+  int fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    // Created on the first remembered answer
+    return 0;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    perror("Failed to stat answer store");
+    close(fd);
+    return -1;
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    return 0;
+  }
+
+  void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    perror("Failed to map answer store");
+    return -1;
+  }
+
+  const store_header_t *header = map;
+  size_t size = (size_t)st.st_size;
+  if (size < sizeof(*header) || memcmp(header->magic, STORE_MAGIC, sizeof(STORE_MAGIC)) != 0 ||
+      header->slots == 0 || (header->slots & (header->slots - 1)) != 0 ||
+      header->count > header->slots ||
+      size < sizeof(*header) + (uint64_t)header->slots * sizeof(store_slot_t) + header->strings_size) {
+    fprintf(stderr, "%s: not a valid answer store\n", filename);
+    munmap(map, size);
+    return -1;
+  }
+
+  store_map = header;
+  return 0;
+}
+
+static int count_answers(void) {
+  int count = (int)entries_count;
+  if (store_map) {
+    const store_slot_t *slots = store_slots();
+    for (uint32_t i = 0; i < store_map->slots; i++) {
+      if (slots[i].verdict != VERDICT_NONE &&
+          (uint64_t)slots[i].key_off + slots[i].key_len <= store_map->strings_size &&
+          !find_entry(slots[i].hash, slots[i].op, slots[i].scope,
+                      store_strings() + slots[i].key_off, slots[i].key_len)) {
+        count++;
+      }
+    }
+  }
+  return count;
+}
+
+int verdict_cache_count(void) {
+  pthread_mutex_lock(&cache_lock);
+  int count = count_answers();
+  pthread_mutex_unlock(&cache_lock);
+  return count;
+}
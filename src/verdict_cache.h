@@ -0,0 +1,52 @@
+#ifndef VERDICT_CACHE_H
+#define VERDICT_CACHE_H
+
+#include "path_policy.h"
+
+// Remembered "always" / "never" answers to the allow prompt. An answer
+// covers one operation on a single file, on everything below a directory,
+// or on every path. The most specific remembered answer wins. Lookups and
+// new answers may come from several threads.
+typedef enum {
+  VERDICT_SCOPE_FILE,
+  VERDICT_SCOPE_DIR,
+  VERDICT_SCOPE_ALL
+} verdict_scope_t;
+
+typedef enum {
+  VERDICT_NONE,
+  VERDICT_ALLOW,
+  VERDICT_DENY
+} verdict_t;
+
+// Open `filename` as the persistent store: existing answers are mapped
+// read-only and every new answer is written back. A missing file is
+// created on the first answer. Returns 0 on success, -1 on error.
+int verdict_cache_open(const char *filename);
+
+// Look up the remembered answer for `op` on `path`, or VERDICT_NONE
+verdict_t verdict_cache_lookup(policy_op_t op, const char *path);
+
+// Remember `verdict` for `op` on `path` at the given scope. For
+// VERDICT_SCOPE_DIR the directory is the one containing `path`.
+// Returns 0 on success, -1 on error.
+int verdict_cache_remember(policy_op_t op, const char *path, verdict_scope_t scope,
+                           verdict_t verdict);
+
+// Number of remembered answers (in memory and in the mapped store)
+int verdict_cache_count(void);
+
+// Changes whenever an answer is remembered. A verdict worked out while it
+// had one value may be cached for as long as it keeps that value.
+unsigned int verdict_cache_generation(void);
+
+// Receives each new answer instead of the store, for --serve jobs, which
+// leave saving to the server so concurrent jobs never overwrite each
+// other's answers
+typedef void (*verdict_cache_hook_t)(policy_op_t op, const char *path, verdict_scope_t scope,
+                                     verdict_t verdict);
+
+// Set the hook (NULL saves to the store again)
+void verdict_cache_set_hook(verdict_cache_hook_t hook);
+
+#endif /* VERDICT_CACHE_H */
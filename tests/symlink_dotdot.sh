@@ -0,0 +1,29 @@
+#!/bin/bash
+# Regression check: "link/.." climbs from the symlink's target, so a delete
+# through it must match the rules for where it really lands. Runs
+# bin/unlink_test on "link/../victim" under every backend, with the target's
+# parent protected, and fails if the victim is gone afterwards.
+#
+# Usage: tests/symlink_dotdot.sh [sandbox] [unlink_test]
+
+cd "$(dirname "$0")/.." || exit 1
+
+SANDBOX=$(realpath "${1:-bin/sandbox}")
+UNLINK=$(realpath "${2:-bin/unlink_test}")
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+mkdir -p "$DIR/protected/sub"
+ln -s "$DIR/protected/sub" "$DIR/link"
+printf 'deny delete %s/protected/\ndefault allow\n' "$DIR" > "$DIR/policy"
+
+status=0
+for backend in "" --seccomp --notify --preload; do
+  touch "$DIR/protected/victim"
+  (cd "$DIR" && "$SANDBOX" $backend --batch --policy "$DIR/policy" "$UNLINK" link/../victim) >/dev/null 2>&1
+  if [ ! -e "$DIR/protected/victim" ]; then
+    echo "${backend:-ptrace}: link/../victim was deleted" >&2
+    status=1
+  fi
+done
+exit $status